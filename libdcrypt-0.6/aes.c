@@ -28,6 +28,7 @@
  *
  */
 
+#include <pthread.h>
 #include "dcinternal.h"
 
 #define FULL_UNROLL
@@ -44,6 +45,13 @@ Td1[x] = Si[x].[0b, 0e, 09, 0d];
 Td2[x] = Si[x].[0d, 0b, 0e, 09];
 Td3[x] = Si[x].[09, 0d, 0b, 0e];
 Td4[x] = Si[x].[01, 01, 01, 01];
+
+Se[x] = S [x];
+Sd[x] = Si[x];
+
+Te1-Te3 (Td1-Td3) are Te0 (Td0) rotated right by 8, 16 and 24 bits,
+which the compact block functions use to get by with only Te0 and Se
+(Td0 and Sd) in the data path.
 */
 
 static const u_int32_t Te0[256] = {
@@ -706,6 +714,78 @@ static const u_int32_t Td4[256] = {
   0xe1e1e1e1U, 0x69696969U, 0x14141414U, 0x63636363U,
   0x55555555U, 0x21212121U, 0x0c0c0c0cU, 0x7d7d7d7dU,
 };
+static const u_char Se[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+  0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+  0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+  0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+  0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+  0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+  0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+  0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+  0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+  0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+  0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+  0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+  0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+  0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+  0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+  0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+  0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+static const u_char Sd[256] = {
+  0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38,
+  0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+  0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87,
+  0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+  0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d,
+  0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+  0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2,
+  0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+  0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16,
+  0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+  0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda,
+  0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+  0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a,
+  0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+  0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02,
+  0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+  0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea,
+  0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+  0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85,
+  0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+  0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89,
+  0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+  0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20,
+  0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+  0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31,
+  0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+  0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d,
+  0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+  0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0,
+  0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+  0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26,
+  0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+/* for the vectorized table code in aes_avx2.c */
+const u_int32_t *const aes_te[5] = { Te0, Te1, Te2, Te3, Te4 };
+const u_int32_t *const aes_td[5] = { Td0, Td1, Td2, Td3, Td4 };
+
 static const u_int32_t rcon[] = {
   0x01000000, 0x02000000, 0x04000000, 0x08000000,
   0x10000000, 0x20000000, 0x40000000, 0x80000000,
@@ -714,15 +794,15 @@ static const u_int32_t rcon[] = {
 };
 
 static void
-aes_setkey_e (aes_ctx *aes, const char *key, u_int keylen)
+aes_setkey_e (aes_ectx *aes, const char *key, u_int keylen)
 {
   int i;
   u_int32_t *rk = aes->e_key;
 
-  rk[0] = getint (key);
-  rk[1] = getint (key + 4);
-  rk[2] = getint (key + 8);
-  rk[3] = getint (key + 12);
+  rk[0] = get32be (key);
+  rk[1] = get32be (key + 4);
+  rk[2] = get32be (key + 8);
+  rk[3] = get32be (key + 12);
   if (keylen == 16) {
     aes->nrounds = 10;
     for (i = 0;;) {
@@ -742,8 +822,8 @@ aes_setkey_e (aes_ctx *aes, const char *key, u_int keylen)
     }
   }
 
-  rk[4] = getint (key + 16);
-  rk[5] = getint (key + 20);
+  rk[4] = get32be (key + 16);
+  rk[5] = get32be (key + 20);
   if (keylen == 24) {
     aes->nrounds = 12;
     for (i = 0;;) {
@@ -765,8 +845,8 @@ aes_setkey_e (aes_ctx *aes, const char *key, u_int keylen)
     }
   }
 
-  rk[6] = getint (key + 24);
-  rk[7] = getint (key + 28);
+  rk[6] = get32be (key + 24);
+  rk[7] = get32be (key + 28);
   if (keylen == 32) {
     aes->nrounds = 14;
     for (i = 0;;) {
@@ -801,14 +881,13 @@ aes_setkey_e (aes_ctx *aes, const char *key, u_int keylen)
 }
 
 static void
-aes_setkey_d (aes_ctx *aes)
+aes_setkey_d (const aes_ctx *aes, u_int32_t *rk)
 {
   int i, j;
-  u_int32_t *rk = aes->d_key;
-  memcpy (rk, aes->e_key, sizeof (aes->e_key));
+  memcpy (rk, aes->e.e_key, sizeof (aes->e.e_key));
 
   /* invert the order of the round keys: */
-  for (i = 0, j = 4 * aes->nrounds; i < j; i += 4, j -= 4) {
+  for (i = 0, j = 4 * aes->e.nrounds; i < j; i += 4, j -= 4) {
     u_int32_t temp = rk[i];
     rk[i] = rk[j];
     rk[j] = temp;
@@ -824,7 +903,7 @@ aes_setkey_d (aes_ctx *aes)
   }
   /* apply the inverse MixColumn transform to all round keys but the
    * first and the last: */
-  for (i = 1; i < aes->nrounds; i++) {
+  for (i = 1; i < aes->e.nrounds; i++) {
     rk += 4;
     rk[0] = Td0[Te4[(rk[0] >> 24)] & 0xff]
       ^ Td1[Te4[(rk[0] >> 16) & 0xff] & 0xff]
@@ -845,41 +924,114 @@ aes_setkey_d (aes_ctx *aes)
   }
 }
 
+static pthread_mutex_t aes_dlock = PTHREAD_MUTEX_INITIALIZER;
+
+static void aes_bind (aes_ectx *aes);
+static void aes_dbind (aes_ctx *aes);
+
+/* The decryption schedule is derived from the encryption one the
+ * first time it is needed; CTR mode and CBC-MAC never need it.  It is
+ * built aside and published, with the decrypt function for its round
+ * count, under aes_dlock, d_ready being set last with release
+ * semantics, so threads sharing a const context see either no
+ * schedule or a whole one. */
+const u_int32_t *
+aes_dkey (const aes_ctx *aes)
+{
+  aes_ctx *w = (aes_ctx *) aes;
+  u_int32_t rk[60];
+
+  if (__atomic_load_n (&aes->d_ready, __ATOMIC_ACQUIRE))
+    return aes->d_key;
+  aes_setkey_d (aes, rk);
+  pthread_mutex_lock (&aes_dlock);
+  if (!__atomic_load_n (&aes->d_ready, __ATOMIC_RELAXED)) {
+    memcpy (w->d_key, rk, sizeof (rk));
+    aes_dbind (w);
+    __atomic_store_n (&w->d_ready, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock (&aes_dlock);
+  bzero (rk, sizeof (rk));
+  return aes->d_key;
+}
+
 void
-aes_setkey (aes_ctx *aes, const void *key, u_int keylen)
+aes_esetkey (aes_ectx *aes, const void *key, u_int keylen)
 {
   aes_setkey_e (aes, key, keylen);
-  aes_setkey_d (aes);
+  aes_bind (aes);
 }
 
 void
-aes_clrkey (aes_ctx *aes)
+aes_setkey (aes_ctx *aes, const void *key, u_int keylen)
+{
+  aes_esetkey (&aes->e, key, keylen);
+  aes->d_ready = 0;
+}
+
+/* installs an encryption schedule from an earlier aes_setkey, of
+   which only the 4 * (nrounds + 1) words in use are read; nrounds
+   must be 10, 12 or 14 */
+void
+aes_esetsched (aes_ectx *aes, int nrounds, const u_int32_t *e_key)
+{
+  aes->nrounds = nrounds;
+  aes_bind (aes);
+  memcpy (aes->e_key, e_key, 4 * (nrounds + 1) * sizeof (aes->e_key[0]));
+}
+
+void
+aes_eclrkey (aes_ectx *aes)
 {
   u_int i;
 
   aes->nrounds = 0;
-  for (i = 0; i < 60; i++) {
+  aes->encrypt = NULL;
+  for (i = 0; i < 60; i++)
     aes->e_key[i] = 0;
-    aes->d_key[i] = 0;
-  }
 }
 
 void
-aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
+aes_clrkey (aes_ctx *aes)
+{
+  u_int i;
+
+  aes_eclrkey (&aes->e);
+  aes->d_ready = 0;
+  aes->decrypt = NULL;
+  for (i = 0; i < 60; i++)
+    aes->d_key[i] = 0;
+}
+
+/*
+ * The block functions below take the round count as an argument, but
+ * they are only ever expanded with a constant one (see AES_SPECIALIZE
+ * further down), so the round-count tests and the round key offsets
+ * all fold away at compile time.
+ */
+
+#if __GNUC__ >= 3
+# define AES_INLINE static inline __attribute__ ((always_inline))
+#else /* !gcc 3 */
+# define AES_INLINE static inline
+#endif /* !gcc 3 */
+
+AES_INLINE void
+aes_encrypt_rk (const u_int32_t *rk, const int nrounds,
+		void *buf, const void *ibuf)
 {
   const char *pt = ibuf;
   char *ct = buf;
   u_int32_t s0, s1, s2, s3, t0, t1, t2, t3;
-  const u_int32_t *rk = aes->e_key;
 
   /*
    * map byte array block to cipher state
    * and add initial round key:
    */
-  s0 = getint (pt) ^ rk[0];
-  s1 = getint (pt + 4) ^ rk[1];
-  s2 = getint (pt + 8) ^ rk[2];
-  s3 = getint (pt + 12) ^ rk[3];
+  s0 = get32be (pt) ^ rk[0];
+  s1 = get32be (pt + 4) ^ rk[1];
+  s2 = get32be (pt + 8) ^ rk[2];
+  s3 = get32be (pt + 12) ^ rk[3];
 #ifdef FULL_UNROLL
   /* round 1: */
   t0 = Te0[s0 >> 24] ^ Te1[(s1 >> 16) & 0xff]
@@ -962,7 +1114,7 @@ aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
     ^ Te2[(s0 >> 8) & 0xff] ^ Te3[s1 & 0xff] ^ rk[38];
   t3 = Te0[s3 >> 24] ^ Te1[(s0 >> 16) & 0xff]
     ^ Te2[(s1 >> 8) & 0xff] ^ Te3[s2 & 0xff] ^ rk[39];
-  if (aes->nrounds > 10) {
+  if (nrounds > 10) {
     /* round 10: */
     s0 = Te0[t0 >> 24] ^ Te1[(t1 >> 16) & 0xff]
       ^ Te2[(t2 >> 8) & 0xff] ^ Te3[t3 & 0xff] ^ rk[40];
@@ -981,7 +1133,7 @@ aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
       ^ Te2[(s0 >> 8) & 0xff] ^ Te3[s1 & 0xff] ^ rk[46];
     t3 = Te0[s3 >> 24] ^ Te1[(s0 >> 16) & 0xff]
       ^ Te2[(s1 >> 8) & 0xff] ^ Te3[s2 & 0xff] ^ rk[47];
-    if (aes->nrounds > 12) {
+    if (nrounds > 12) {
       /* round 12: */
       s0 = Te0[t0 >> 24] ^ Te1[(t1 >> 16) & 0xff]
 	^ Te2[(t2 >> 8) & 0xff] ^ Te3[t3 & 0xff] ^ rk[48];
@@ -1002,12 +1154,12 @@ aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
 	^ Te2[(s1 >> 8) & 0xff] ^ Te3[s2 & 0xff] ^ rk[55];
     }
   }
-  rk += aes->nrounds << 2;
+  rk += nrounds << 2;
 #else /* !FULL_UNROLL */
   /*
    * nrounds - 1 full rounds:
    */
-  int r = aes->nrounds >> 1;
+  int r = nrounds >> 1;
   for (;;) {
     t0 = Te0[(s0 >> 24)] ^ Te1[(s1 >> 16) & 0xff]
       ^ Te2[(s2 >> 8) & 0xff] ^ Te3[(s3) & 0xff] ^ rk[4];
@@ -1041,43 +1193,43 @@ aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
     ^ (Te4[(t2 >> 8) & 0xff] & 0x0000ff00)
     ^ (Te4[(t3) & 0xff] & 0x000000ff)
     ^ rk[0];
-  putint (ct, s0);
+  put32be (ct, s0);
   s1 = (Te4[(t1 >> 24)] & 0xff000000)
     ^ (Te4[(t2 >> 16) & 0xff] & 0x00ff0000)
     ^ (Te4[(t3 >> 8) & 0xff] & 0x0000ff00)
     ^ (Te4[(t0) & 0xff] & 0x000000ff)
     ^ rk[1];
-  putint (ct + 4, s1);
+  put32be (ct + 4, s1);
   s2 = (Te4[(t2 >> 24)] & 0xff000000)
     ^ (Te4[(t3 >> 16) & 0xff] & 0x00ff0000)
     ^ (Te4[(t0 >> 8) & 0xff] & 0x0000ff00)
     ^ (Te4[(t1) & 0xff] & 0x000000ff)
     ^ rk[2];
-  putint (ct + 8, s2);
+  put32be (ct + 8, s2);
   s3 = (Te4[(t3 >> 24)] & 0xff000000)
     ^ (Te4[(t0 >> 16) & 0xff] & 0x00ff0000)
     ^ (Te4[(t1 >> 8) & 0xff] & 0x0000ff00)
     ^ (Te4[(t2) & 0xff] & 0x000000ff)
     ^ rk[3];
-  putint (ct + 12, s3);
+  put32be (ct + 12, s3);
 }
 
-void
-aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
+AES_INLINE void
+aes_decrypt_rk (const u_int32_t *rk, const int nrounds,
+		void *buf, const void *ibuf)
 {
   const char *ct = ibuf;
   char *pt = buf;
   u_int32_t s0, s1, s2, s3, t0, t1, t2, t3;
-  const u_int32_t *rk = aes->d_key;
 
   /*
    * map byte array block to cipher state
    * and add initial round key:
    */
-  s0 = getint (ct) ^ rk[0];
-  s1 = getint (ct + 4) ^ rk[1];
-  s2 = getint (ct + 8) ^ rk[2];
-  s3 = getint (ct + 12) ^ rk[3];
+  s0 = get32be (ct) ^ rk[0];
+  s1 = get32be (ct + 4) ^ rk[1];
+  s2 = get32be (ct + 8) ^ rk[2];
+  s3 = get32be (ct + 12) ^ rk[3];
 #ifdef FULL_UNROLL
   /* round 1: */
   t0 = Td0[s0 >> 24] ^ Td1[(s3 >> 16) & 0xff]
@@ -1160,7 +1312,7 @@ aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
     ^ Td2[(s0 >> 8) & 0xff] ^ Td3[s3 & 0xff] ^ rk[38];
   t3 = Td0[s3 >> 24] ^ Td1[(s2 >> 16) & 0xff]
     ^ Td2[(s1 >> 8) & 0xff] ^ Td3[s0 & 0xff] ^ rk[39];
-  if (aes->nrounds > 10) {
+  if (nrounds > 10) {
     /* round 10: */
     s0 = Td0[t0 >> 24] ^ Td1[(t3 >> 16) & 0xff]
       ^ Td2[(t2 >> 8) & 0xff] ^ Td3[t1 & 0xff] ^ rk[40];
@@ -1179,7 +1331,7 @@ aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
       ^ Td2[(s0 >> 8) & 0xff] ^ Td3[s3 & 0xff] ^ rk[46];
     t3 = Td0[s3 >> 24] ^ Td1[(s2 >> 16) & 0xff]
       ^ Td2[(s1 >> 8) & 0xff] ^ Td3[s0 & 0xff] ^ rk[47];
-    if (aes->nrounds > 12) {
+    if (nrounds > 12) {
       /* round 12: */
       s0 = Td0[t0 >> 24] ^ Td1[(t3 >> 16) & 0xff]
 	^ Td2[(t2 >> 8) & 0xff] ^ Td3[t1 & 0xff] ^ rk[48];
@@ -1200,12 +1352,12 @@ aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
 	^ Td2[(s1 >> 8) & 0xff] ^ Td3[s0 & 0xff] ^ rk[55];
     }
   }
-  rk += aes->nrounds << 2;
+  rk += nrounds << 2;
 #else /* !FULL_UNROLL */
   /*
    * Nr - 1 full rounds:
    */
-  int r = aes->nrounds >> 1;
+  int r = nrounds >> 1;
   for (;;) {
     t0 = Td0[(s0 >> 24)] ^ Td1[(s3 >> 16) & 0xff]
       ^ Td2[(s2 >> 8) & 0xff] ^ Td3[(s1) & 0xff] ^ rk[4];
@@ -1239,23 +1391,306 @@ aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
     ^ (Td4[(t2 >> 8) & 0xff] & 0x0000ff00)
     ^ (Td4[(t1) & 0xff] & 0x000000ff)
     ^ rk[0];
-  putint (pt, s0);
+  put32be (pt, s0);
   s1 = (Td4[(t1 >> 24)] & 0xff000000)
     ^ (Td4[(t0 >> 16) & 0xff] & 0x00ff0000)
     ^ (Td4[(t3 >> 8) & 0xff] & 0x0000ff00)
     ^ (Td4[(t2) & 0xff] & 0x000000ff)
     ^ rk[1];
-  putint (pt + 4, s1);
+  put32be (pt + 4, s1);
   s2 = (Td4[(t2 >> 24)] & 0xff000000)
     ^ (Td4[(t1 >> 16) & 0xff] & 0x00ff0000)
     ^ (Td4[(t0 >> 8) & 0xff] & 0x0000ff00)
     ^ (Td4[(t3) & 0xff] & 0x000000ff)
     ^ rk[2];
-  putint (pt + 8, s2);
+  put32be (pt + 8, s2);
   s3 = (Td4[(t3 >> 24)] & 0xff000000)
     ^ (Td4[(t2 >> 16) & 0xff] & 0x00ff0000)
     ^ (Td4[(t1 >> 8) & 0xff] & 0x0000ff00)
     ^ (Td4[(t0) & 0xff] & 0x000000ff)
     ^ rk[3];
-  putint (pt + 12, s3);
+  put32be (pt + 12, s3);
+}
+
+/*
+ * Compact variants: the same rounds computed from Te0/Td0 alone plus a
+ * byte S-box for the last round, so the data path touches 1.25 KiB of
+ * tables per direction instead of 5 KiB.  Slower on an idle core, but
+ * kinder to the caches when many threads run AES next to other work.
+ */
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CE(a, b, c, d)						\
+  (Te0[(a) >> 24] ^ ROR (Te0[((b) >> 16) & 0xff], 8)		\
+   ^ ROR (Te0[((c) >> 8) & 0xff], 16) ^ ROR (Te0[(d) & 0xff], 24))
+#define CD(a, b, c, d)						\
+  (Td0[(a) >> 24] ^ ROR (Td0[((b) >> 16) & 0xff], 8)		\
+   ^ ROR (Td0[((c) >> 8) & 0xff], 16) ^ ROR (Td0[(d) & 0xff], 24))
+#define CLAST(S, a, b, c, d)					\
+  ((u_int32_t) S[(a) >> 24] << 24 ^ (u_int32_t) S[((b) >> 16) & 0xff] << 16 \
+   ^ (u_int32_t) S[((c) >> 8) & 0xff] << 8 ^ (u_int32_t) S[(d) & 0xff])
+
+AES_INLINE void
+aes_cencrypt_rk (const u_int32_t *rk, const int nrounds,
+		 void *buf, const void *ibuf)
+{
+  const char *pt = ibuf;
+  char *ct = buf;
+  u_int32_t s0, s1, s2, s3, t0, t1, t2, t3;
+  int r;
+
+  s0 = get32be (pt) ^ rk[0];
+  s1 = get32be (pt + 4) ^ rk[1];
+  s2 = get32be (pt + 8) ^ rk[2];
+  s3 = get32be (pt + 12) ^ rk[3];
+  for (r = 1; r < nrounds; r++) {
+    rk += 4;
+    t0 = CE (s0, s1, s2, s3) ^ rk[0];
+    t1 = CE (s1, s2, s3, s0) ^ rk[1];
+    t2 = CE (s2, s3, s0, s1) ^ rk[2];
+    t3 = CE (s3, s0, s1, s2) ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+  rk += 4;
+  put32be (ct, CLAST (Se, s0, s1, s2, s3) ^ rk[0]);
+  put32be (ct + 4, CLAST (Se, s1, s2, s3, s0) ^ rk[1]);
+  put32be (ct + 8, CLAST (Se, s2, s3, s0, s1) ^ rk[2]);
+  put32be (ct + 12, CLAST (Se, s3, s0, s1, s2) ^ rk[3]);
+}
+
+AES_INLINE void
+aes_cdecrypt_rk (const u_int32_t *rk, const int nrounds,
+		 void *buf, const void *ibuf)
+{
+  const char *ct = ibuf;
+  char *pt = buf;
+  u_int32_t s0, s1, s2, s3, t0, t1, t2, t3;
+  int r;
+
+  s0 = get32be (ct) ^ rk[0];
+  s1 = get32be (ct + 4) ^ rk[1];
+  s2 = get32be (ct + 8) ^ rk[2];
+  s3 = get32be (ct + 12) ^ rk[3];
+  for (r = 1; r < nrounds; r++) {
+    rk += 4;
+    t0 = CD (s0, s3, s2, s1) ^ rk[0];
+    t1 = CD (s1, s0, s3, s2) ^ rk[1];
+    t2 = CD (s2, s1, s0, s3) ^ rk[2];
+    t3 = CD (s3, s2, s1, s0) ^ rk[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+  rk += 4;
+  put32be (pt, CLAST (Sd, s0, s3, s2, s1) ^ rk[0]);
+  put32be (pt + 4, CLAST (Sd, s1, s0, s3, s2) ^ rk[1]);
+  put32be (pt + 8, CLAST (Sd, s2, s1, s0, s3) ^ rk[2]);
+  put32be (pt + 12, CLAST (Sd, s3, s2, s1, s0) ^ rk[3]);
+}
+
+void
+aes_cencrypt (const aes_ectx *aes, void *buf, const void *ibuf)
+{
+  switch (aes->nrounds) {
+  case 10:
+    aes_cencrypt_rk (aes->e_key, 10, buf, ibuf);
+    break;
+  case 12:
+    aes_cencrypt_rk (aes->e_key, 12, buf, ibuf);
+    break;
+  default:
+    aes_cencrypt_rk (aes->e_key, 14, buf, ibuf);
+    break;
+  }
+}
+
+/* the caller must have built the decryption schedule with aes_dkey */
+void
+aes_cdecrypt (const aes_ctx *aes, void *buf, const void *ibuf)
+{
+  switch (aes->e.nrounds) {
+  case 10:
+    aes_cdecrypt_rk (aes->d_key, 10, buf, ibuf);
+    break;
+  case 12:
+    aes_cdecrypt_rk (aes->d_key, 12, buf, ibuf);
+    break;
+  default:
+    aes_cdecrypt_rk (aes->d_key, 14, buf, ibuf);
+    break;
+  }
+}
+
+#define AES_SPECIALIZE(nr)						\
+static void								\
+aes_encrypt##nr (const aes_ectx *aes, void *buf, const void *ibuf)	\
+{									\
+  aes_encrypt_rk (aes->e_key, nr, buf, ibuf);				\
+}									\
+static void								\
+aes_decrypt##nr (const u_int32_t *d_key, void *buf, const void *ibuf)	\
+{									\
+  aes_decrypt_rk (d_key, nr, buf, ibuf);				\
+}
+
+AES_SPECIALIZE (10)		/* AES-128 */
+AES_SPECIALIZE (12)		/* AES-192 */
+AES_SPECIALIZE (14)		/* AES-256 */
+
+static void
+aes_bind (aes_ectx *aes)
+{
+  switch (aes->nrounds) {
+  case 10:
+    aes->encrypt = aes_encrypt10;
+    break;
+  case 12:
+    aes->encrypt = aes_encrypt12;
+    break;
+  case 14:
+    aes->encrypt = aes_encrypt14;
+    break;
+  default:
+    abort ();
+  }
+}
+
+static void
+aes_dbind (aes_ctx *aes)
+{
+  switch (aes->e.nrounds) {
+  case 10:
+    aes->decrypt = aes_decrypt10;
+    break;
+  case 12:
+    aes->decrypt = aes_decrypt12;
+    break;
+  case 14:
+    aes->decrypt = aes_decrypt14;
+    break;
+  default:
+    abort ();
+  }
+}
+
+void
+aes_eencrypt (const aes_ectx *aes, void *buf, const void *ibuf)
+{
+  aes->encrypt (aes, buf, ibuf);
+}
+
+void
+aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf)
+{
+  aes->e.encrypt (&aes->e, buf, ibuf);
+}
+
+void
+aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf)
+{
+  const u_int32_t *d_key = aes_dkey (aes);
+
+  aes->decrypt (d_key, buf, ibuf);
+}
+
+/*
+ * Multi-key encryption for aes_mkey.  Each round is applied to every
+ * key's state before moving on to the next round, so the table lookups
+ * of the independent chains overlap instead of waiting on each other.
+ */
+void
+aes_mcbc_ttable (const aes_mkey *mk, u_char (*state)[16],
+		 const u_char *const msgs[], size_t nblocks)
+{
+  u_int32_t s0[aes_mkeys_max], s1[aes_mkeys_max];
+  u_int32_t s2[aes_mkeys_max], s3[aes_mkeys_max];
+  u_int32_t t0, t1, t2, t3;
+  const u_int32_t (*rk)[4];
+  const int n = mk->nkeys, nr = mk->nrounds;
+  size_t b;
+  int k, r;
+
+  for (k = 0; k < n; k++) {
+    s0[k] = get32be (state[k]);
+    s1[k] = get32be (state[k] + 4);
+    s2[k] = get32be (state[k] + 8);
+    s3[k] = get32be (state[k] + 12);
+  }
+  if (!msgs)
+    nblocks = 1;
+
+  for (b = 0; b < nblocks; b++) {
+    rk = mk->rk[0];
+    for (k = 0; k < n; k++) {
+      if (msgs) {
+	const u_char *m = msgs[k] + b * aes_blocklen;
+	s0[k] ^= get32be (m);
+	s1[k] ^= get32be (m + 4);
+	s2[k] ^= get32be (m + 8);
+	s3[k] ^= get32be (m + 12);
+      }
+      s0[k] ^= rk[k][0];
+      s1[k] ^= rk[k][1];
+      s2[k] ^= rk[k][2];
+      s3[k] ^= rk[k][3];
+    }
+
+    for (r = 1; r < nr; r++) {
+      rk = mk->rk[r];
+      for (k = 0; k < n; k++) {
+	t0 = Te0[(s0[k] >> 24)] ^ Te1[(s1[k] >> 16) & 0xff]
+	  ^ Te2[(s2[k] >> 8) & 0xff] ^ Te3[(s3[k]) & 0xff] ^ rk[k][0];
+	t1 = Te0[(s1[k] >> 24)] ^ Te1[(s2[k] >> 16) & 0xff]
+	  ^ Te2[(s3[k] >> 8) & 0xff] ^ Te3[(s0[k]) & 0xff] ^ rk[k][1];
+	t2 = Te0[(s2[k] >> 24)] ^ Te1[(s3[k] >> 16) & 0xff]
+	  ^ Te2[(s0[k] >> 8) & 0xff] ^ Te3[(s1[k]) & 0xff] ^ rk[k][2];
+	t3 = Te0[(s3[k] >> 24)] ^ Te1[(s0[k] >> 16) & 0xff]
+	  ^ Te2[(s1[k] >> 8) & 0xff] ^ Te3[(s2[k]) & 0xff] ^ rk[k][3];
+	s0[k] = t0;
+	s1[k] = t1;
+	s2[k] = t2;
+	s3[k] = t3;
+      }
+    }
+
+    rk = mk->rk[nr];
+    for (k = 0; k < n; k++) {
+      t0 = (Te4[(s0[k] >> 24)] & 0xff000000)
+	^ (Te4[(s1[k] >> 16) & 0xff] & 0x00ff0000)
+	^ (Te4[(s2[k] >> 8) & 0xff] & 0x0000ff00)
+	^ (Te4[(s3[k]) & 0xff] & 0x000000ff)
+	^ rk[k][0];
+      t1 = (Te4[(s1[k] >> 24)] & 0xff000000)
+	^ (Te4[(s2[k] >> 16) & 0xff] & 0x00ff0000)
+	^ (Te4[(s3[k] >> 8) & 0xff] & 0x0000ff00)
+	^ (Te4[(s0[k]) & 0xff] & 0x000000ff)
+	^ rk[k][1];
+      t2 = (Te4[(s2[k] >> 24)] & 0xff000000)
+	^ (Te4[(s3[k] >> 16) & 0xff] & 0x00ff0000)
+	^ (Te4[(s0[k] >> 8) & 0xff] & 0x0000ff00)
+	^ (Te4[(s1[k]) & 0xff] & 0x000000ff)
+	^ rk[k][2];
+      t3 = (Te4[(s3[k] >> 24)] & 0xff000000)
+	^ (Te4[(s0[k] >> 16) & 0xff] & 0x00ff0000)
+	^ (Te4[(s1[k] >> 8) & 0xff] & 0x0000ff00)
+	^ (Te4[(s2[k]) & 0xff] & 0x000000ff)
+	^ rk[k][3];
+      s0[k] = t0;
+      s1[k] = t1;
+      s2[k] = t2;
+      s3[k] = t3;
+    }
+  }
+
+  for (k = 0; k < n; k++) {
+    put32be (state[k], s0[k]);
+    put32be (state[k] + 4, s1[k]);
+    put32be (state[k] + 8, s2[k]);
+    put32be (state[k] + 12, s3[k]);
+  }
 }
@@ -0,0 +1,224 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * AVX2 table-driven AES for CPUs without AES instructions.  Eight
+ * blocks are processed at once: after a 4x4 transpose, register sN
+ * holds column N of every block, and each T-table lookup of the scalar
+ * code becomes one vpgatherdd over all eight blocks.  The tables are
+ * the ones aes.c uses, so the results are bit-for-bit those of
+ * aes_encrypt/aes_decrypt.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_AVX2
+
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+
+#define AVX2_INLINE static inline __attribute__ ((always_inline))
+
+#define GATHER(t, i) _mm256_i32gather_epi32 ((const int *) (t), (i), 4)
+#define BYTE(x, n) \
+  _mm256_and_si256 (_mm256_srli_epi32 ((x), (n)), _mm256_set1_epi32 (0xff))
+
+/* register-wise 4x4 transpose of 32-bit words within each 128-bit lane */
+#define TRANSPOSE4(a, b, c, d) do {					\
+  __m256i _t0 = _mm256_unpacklo_epi32 (a, b);				\
+  __m256i _t1 = _mm256_unpackhi_epi32 (a, b);				\
+  __m256i _t2 = _mm256_unpacklo_epi32 (c, d);				\
+  __m256i _t3 = _mm256_unpackhi_epi32 (c, d);				\
+  a = _mm256_unpacklo_epi64 (_t0, _t2);					\
+  b = _mm256_unpackhi_epi64 (_t0, _t2);					\
+  c = _mm256_unpacklo_epi64 (_t1, _t3);					\
+  d = _mm256_unpackhi_epi64 (_t1, _t3);					\
+} while (0)
+
+AVX2_INLINE __m256i
+avx2_round (const u_int32_t *const T[5], __m256i a, __m256i b,
+	    __m256i c, __m256i d, u_int32_t k)
+{
+  __m256i x = GATHER (T[0], _mm256_srli_epi32 (a, 24));
+  x = _mm256_xor_si256 (x, GATHER (T[1], BYTE (b, 16)));
+  x = _mm256_xor_si256 (x, GATHER (T[2], BYTE (c, 8)));
+  x = _mm256_xor_si256 (x, GATHER (T[3], BYTE (d, 0)));
+  return _mm256_xor_si256 (x, _mm256_set1_epi32 (k));
+}
+
+AVX2_INLINE __m256i
+avx2_lastround (const u_int32_t *const T[5], __m256i a, __m256i b,
+		__m256i c, __m256i d, u_int32_t k)
+{
+  __m256i x;
+  x = _mm256_and_si256 (GATHER (T[4], _mm256_srli_epi32 (a, 24)),
+			_mm256_set1_epi32 (0xff000000));
+  x = _mm256_xor_si256 (x, _mm256_and_si256 (GATHER (T[4], BYTE (b, 16)),
+					     _mm256_set1_epi32 (0x00ff0000)));
+  x = _mm256_xor_si256 (x, _mm256_and_si256 (GATHER (T[4], BYTE (c, 8)),
+					     _mm256_set1_epi32 (0x0000ff00)));
+  x = _mm256_xor_si256 (x, _mm256_and_si256 (GATHER (T[4], BYTE (d, 0)),
+					     _mm256_set1_epi32 (0x000000ff)));
+  return _mm256_xor_si256 (x, _mm256_set1_epi32 (k));
+}
+
+/* Encrypts (dec == 0) or decrypts eight blocks.  The decryption
+   rounds take their columns in the opposite rotation. */
+AVX2_INLINE void
+avx2_crypt8 (const u_int32_t *rk, int nr, int dec,
+	     u_char *out, const u_char *in)
+{
+  const __m256i bswap32 = _mm256_setr_epi8
+    (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+     3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const u_int32_t *const *T = dec ? aes_td : aes_te;
+  __m256i s0, s1, s2, s3, t0, t1, t2, t3;
+  int r;
+
+  s0 = _mm256_shuffle_epi8 (_mm256_loadu_si256 ((const __m256i *) in),
+			    bswap32);
+  s1 = _mm256_shuffle_epi8 (_mm256_loadu_si256 ((const __m256i *) in + 1),
+			    bswap32);
+  s2 = _mm256_shuffle_epi8 (_mm256_loadu_si256 ((const __m256i *) in + 2),
+			    bswap32);
+  s3 = _mm256_shuffle_epi8 (_mm256_loadu_si256 ((const __m256i *) in + 3),
+			    bswap32);
+  TRANSPOSE4 (s0, s1, s2, s3);
+  s0 = _mm256_xor_si256 (s0, _mm256_set1_epi32 (rk[0]));
+  s1 = _mm256_xor_si256 (s1, _mm256_set1_epi32 (rk[1]));
+  s2 = _mm256_xor_si256 (s2, _mm256_set1_epi32 (rk[2]));
+  s3 = _mm256_xor_si256 (s3, _mm256_set1_epi32 (rk[3]));
+
+  for (r = 1; r < nr; r++) {
+    rk += 4;
+    if (!dec) {
+      t0 = avx2_round (T, s0, s1, s2, s3, rk[0]);
+      t1 = avx2_round (T, s1, s2, s3, s0, rk[1]);
+      t2 = avx2_round (T, s2, s3, s0, s1, rk[2]);
+      t3 = avx2_round (T, s3, s0, s1, s2, rk[3]);
+    }
+    else {
+      t0 = avx2_round (T, s0, s3, s2, s1, rk[0]);
+      t1 = avx2_round (T, s1, s0, s3, s2, rk[1]);
+      t2 = avx2_round (T, s2, s1, s0, s3, rk[2]);
+      t3 = avx2_round (T, s3, s2, s1, s0, rk[3]);
+    }
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+  rk += 4;
+  if (!dec) {
+    t0 = avx2_lastround (T, s0, s1, s2, s3, rk[0]);
+    t1 = avx2_lastround (T, s1, s2, s3, s0, rk[1]);
+    t2 = avx2_lastround (T, s2, s3, s0, s1, rk[2]);
+    t3 = avx2_lastround (T, s3, s0, s1, s2, rk[3]);
+  }
+  else {
+    t0 = avx2_lastround (T, s0, s3, s2, s1, rk[0]);
+    t1 = avx2_lastround (T, s1, s0, s3, s2, rk[1]);
+    t2 = avx2_lastround (T, s2, s1, s0, s3, rk[2]);
+    t3 = avx2_lastround (T, s3, s2, s1, s0, rk[3]);
+  }
+
+  TRANSPOSE4 (t0, t1, t2, t3);
+  _mm256_storeu_si256 ((__m256i *) out, _mm256_shuffle_epi8 (t0, bswap32));
+  _mm256_storeu_si256 ((__m256i *) out + 1,
+		       _mm256_shuffle_epi8 (t1, bswap32));
+  _mm256_storeu_si256 ((__m256i *) out + 2,
+		       _mm256_shuffle_epi8 (t2, bswap32));
+  _mm256_storeu_si256 ((__m256i *) out + 3,
+		       _mm256_shuffle_epi8 (t3, bswap32));
+}
+
+AVX2_INLINE void
+avx2_ecb (const u_int32_t *rk, int nr, int dec,
+	  u_char *out, const u_char *in, size_t nblocks)
+{
+  u_char buf[8 * aes_blocklen];
+
+  for (; nblocks >= 8; nblocks -= 8, in += sizeof (buf), out += sizeof (buf))
+    avx2_crypt8 (rk, nr, dec, out, in);
+  if (nblocks) {
+    memcpy (buf, in, nblocks * aes_blocklen);
+    avx2_crypt8 (rk, nr, dec, buf, buf);
+    memcpy (out, buf, nblocks * aes_blocklen);
+    bzero (buf, sizeof (buf));
+  }
+}
+
+static void
+avx2_ecb_encrypt (const aes_ectx *aes, u_char *out, const u_char *in,
+		  size_t nblocks)
+{
+  avx2_ecb (aes->e_key, aes->nrounds, 0, out, in, nblocks);
+}
+
+static void
+avx2_ecb_decrypt (const aes_ctx *aes, u_char *out, const u_char *in,
+		  size_t nblocks)
+{
+  avx2_ecb (aes->d_key, aes->e.nrounds, 1, out, in, nblocks);
+}
+
+static void
+avx2_ctr_xor (const aes_ectx *aes, u_char *out, const u_char *in,
+	      size_t len, const u_char ctr[16])
+{
+  u_char c[aes_blocklen], ks[8 * aes_blocklen];
+  size_t i, n;
+
+  memcpy (c, ctr, aes_blocklen);
+  while (len) {
+    for (i = 0; i < 8; i++) {
+      memcpy (ks + i * aes_blocklen, c, aes_blocklen);
+      aes_ctr_add (c, 1);
+    }
+    avx2_crypt8 (aes->e_key, aes->nrounds, 0, ks, ks);
+    n = len < sizeof (ks) ? len : sizeof (ks);
+    for (i = 0; i < n; i++)
+      out[i] = in[i] ^ ks[i];
+    in += n;
+    out += n;
+    len -= n;
+  }
+  bzero (ks, sizeof (ks));
+}
+
+#pragma GCC pop_options
+
+static int
+avx2_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+}
+
+/* independent CBC chains cannot share a gather, so multi-key work
+   stays on the scalar tables */
+const aes_bulkops aes_avx2 = {
+  "avx2", avx2_probe,
+  avx2_ecb_encrypt, avx2_ecb_decrypt, avx2_ctr_xor,
+  aes_mcbc_ttable
+};
+
+#endif /* DC_HAVE_AVX2 */
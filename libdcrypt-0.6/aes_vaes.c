@@ -0,0 +1,612 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * VAES kernels for the bulk AES interfaces.  aes_vaes512 keeps four
+ * blocks in each zmm register and runs 32 blocks per loop iteration;
+ * aes_vaes256 is the same scheme on ymm registers (16 blocks per
+ * iteration) for CPUs that have VAES but no AVX-512.
+ *
+ * The round keys in aes_ctx are stored as host-order words, so they
+ * are byte-swapped once per call into the layout aesenc expects.  The
+ * d_key schedule already is the "equivalent inverse cipher" schedule
+ * that aesdec wants.  In CTR mode the final round key is XORed with
+ * the input before aesenclast, which fuses the keystream XOR into the
+ * last round.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_VAES
+
+#include <immintrin.h>
+
+/* Each group of kernels is compiled for exactly the instruction set
+   its probe checks for, so that e.g. no EVEX encodings leak into the
+   256-bit path. */
+#pragma GCC push_options
+#pragma GCC target ("aes,avx2")
+
+static inline void
+vaes_loadkeys (__m128i rk[15], const u_int32_t *key, int nrounds)
+{
+  const __m128i bswap32 = _mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11,
+					4, 5, 6, 7, 0, 1, 2, 3);
+  int i;
+
+  for (i = 0; i <= nrounds; i++)
+    rk[i] = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) key + i),
+			      bswap32);
+}
+
+static inline __m128i
+vaes_rev128 (void)
+{
+  return _mm_set_epi8 (0, 1, 2, 3, 4, 5, 6, 7,
+		       8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+#pragma GCC pop_options
+
+/*
+ * 512-bit kernels
+ */
+
+#pragma GCC push_options
+#pragma GCC target ("aes,avx2,avx512f,avx512bw,avx512vl,vaes")
+
+#define K512(i) _mm512_broadcast_i32x4 (rk[i])
+
+#define ENC8(op, k) do {						\
+  __typeof__ (x0) _k = (k);						\
+  x0 = op (x0, _k); x1 = op (x1, _k); x2 = op (x2, _k);			\
+  x3 = op (x3, _k); x4 = op (x4, _k); x5 = op (x5, _k);			\
+  x6 = op (x6, _k); x7 = op (x7, _k);					\
+} while (0)
+
+/* Counters are kept byte-reversed, i.e. as little-endian 128-bit
+   integers, so that they can be advanced with 64-bit adds; the carry
+   out of the low quadword of each lane is propagated with a mask. */
+static inline __m512i
+vaes512_ctradd (__m512i c, __m512i inc)
+{
+  __m512i s = _mm512_add_epi64 (c, inc);
+  __mmask8 carry = _mm512_cmplt_epu64_mask (s, c) & 0x55;
+  return _mm512_mask_add_epi64 (s, (__mmask8) (carry << 1), s,
+				_mm512_set1_epi64 (1));
+}
+
+static void
+vaes512_ctr_xor (const aes_ectx *aes, u_char *out, const u_char *in,
+		 size_t len, const u_char ctr[16])
+{
+  __m128i rk[15];
+  __m512i rev, c, four, klast;
+  __m512i x0, x1, x2, x3, x4, x5, x6, x7;
+  int r, nr = aes->nrounds;
+
+  vaes_loadkeys (rk, aes->e_key, nr);
+  rev = _mm512_broadcast_i32x4 (vaes_rev128 ());
+  c = _mm512_broadcast_i32x4 (_mm_shuffle_epi8
+			      (_mm_loadu_si128 ((const __m128i *) ctr),
+			       vaes_rev128 ()));
+  c = vaes512_ctradd (c, _mm512_set_epi64 (0, 3, 0, 2, 0, 1, 0, 0));
+  four = _mm512_set_epi64 (0, 4, 0, 4, 0, 4, 0, 4);
+  klast = K512 (nr);
+
+  for (; len >= 512; in += 512, out += 512, len -= 512) {
+    x0 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x1 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x2 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x3 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x4 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x5 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x6 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    x7 = _mm512_shuffle_epi8 (c, rev); c = vaes512_ctradd (c, four);
+    ENC8 (_mm512_xor_si512, K512 (0));
+    for (r = 1; r < nr; r++)
+      ENC8 (_mm512_aesenc_epi128, K512 (r));
+    x0 = _mm512_aesenclast_epi128
+      (x0, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in)));
+    x1 = _mm512_aesenclast_epi128
+      (x1, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 64)));
+    x2 = _mm512_aesenclast_epi128
+      (x2, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 128)));
+    x3 = _mm512_aesenclast_epi128
+      (x3, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 192)));
+    x4 = _mm512_aesenclast_epi128
+      (x4, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 256)));
+    x5 = _mm512_aesenclast_epi128
+      (x5, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 320)));
+    x6 = _mm512_aesenclast_epi128
+      (x6, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 384)));
+    x7 = _mm512_aesenclast_epi128
+      (x7, _mm512_xor_si512 (klast, _mm512_loadu_si512 (in + 448)));
+    _mm512_storeu_si512 (out, x0);
+    _mm512_storeu_si512 (out + 64, x1);
+    _mm512_storeu_si512 (out + 128, x2);
+    _mm512_storeu_si512 (out + 192, x3);
+    _mm512_storeu_si512 (out + 256, x4);
+    _mm512_storeu_si512 (out + 320, x5);
+    _mm512_storeu_si512 (out + 384, x6);
+    _mm512_storeu_si512 (out + 448, x7);
+  }
+
+  /* four blocks at a time, then a masked load/store for the rest */
+  while (len) {
+    __mmask64 m = len >= 64 ? ~(__mmask64) 0 : ((__mmask64) 1 << len) - 1;
+    x0 = _mm512_shuffle_epi8 (c, rev);
+    c = vaes512_ctradd (c, four);
+    x0 = _mm512_xor_si512 (x0, K512 (0));
+    for (r = 1; r < nr; r++)
+      x0 = _mm512_aesenc_epi128 (x0, K512 (r));
+    x0 = _mm512_aesenclast_epi128
+      (x0, _mm512_xor_si512 (klast, _mm512_maskz_loadu_epi8 (m, in)));
+    _mm512_mask_storeu_epi8 (out, m, x0);
+    if (len < 64)
+      break;
+    in += 64;
+    out += 64;
+    len -= 64;
+  }
+}
+
+static inline void
+vaes512_ecb (const u_int32_t *key, int nr, int enc,
+	     u_char *out, const u_char *in, size_t nblocks)
+{
+  __m128i rk[15];
+  __m512i x0, x1, x2, x3, x4, x5, x6, x7;
+  int r;
+
+  vaes_loadkeys (rk, key, nr);
+
+  for (; nblocks >= 32; in += 512, out += 512, nblocks -= 32) {
+    x0 = _mm512_loadu_si512 (in);
+    x1 = _mm512_loadu_si512 (in + 64);
+    x2 = _mm512_loadu_si512 (in + 128);
+    x3 = _mm512_loadu_si512 (in + 192);
+    x4 = _mm512_loadu_si512 (in + 256);
+    x5 = _mm512_loadu_si512 (in + 320);
+    x6 = _mm512_loadu_si512 (in + 384);
+    x7 = _mm512_loadu_si512 (in + 448);
+    ENC8 (_mm512_xor_si512, K512 (0));
+    if (enc) {
+      for (r = 1; r < nr; r++)
+	ENC8 (_mm512_aesenc_epi128, K512 (r));
+      ENC8 (_mm512_aesenclast_epi128, K512 (nr));
+    }
+    else {
+      for (r = 1; r < nr; r++)
+	ENC8 (_mm512_aesdec_epi128, K512 (r));
+      ENC8 (_mm512_aesdeclast_epi128, K512 (nr));
+    }
+    _mm512_storeu_si512 (out, x0);
+    _mm512_storeu_si512 (out + 64, x1);
+    _mm512_storeu_si512 (out + 128, x2);
+    _mm512_storeu_si512 (out + 192, x3);
+    _mm512_storeu_si512 (out + 256, x4);
+    _mm512_storeu_si512 (out + 320, x5);
+    _mm512_storeu_si512 (out + 384, x6);
+    _mm512_storeu_si512 (out + 448, x7);
+  }
+
+  while (nblocks) {
+    size_t n = nblocks < 4 ? nblocks : 4;
+    __mmask64 m = n == 4 ? ~(__mmask64) 0 : ((__mmask64) 1 << (16 * n)) - 1;
+    x0 = _mm512_xor_si512 (_mm512_maskz_loadu_epi8 (m, in), K512 (0));
+    if (enc) {
+      for (r = 1; r < nr; r++)
+	x0 = _mm512_aesenc_epi128 (x0, K512 (r));
+      x0 = _mm512_aesenclast_epi128 (x0, K512 (nr));
+    }
+    else {
+      for (r = 1; r < nr; r++)
+	x0 = _mm512_aesdec_epi128 (x0, K512 (r));
+      x0 = _mm512_aesdeclast_epi128 (x0, K512 (nr));
+    }
+    _mm512_mask_storeu_epi8 (out, m, x0);
+    in += 16 * n;
+    out += 16 * n;
+    nblocks -= n;
+  }
+}
+
+static void
+vaes512_ecb_encrypt (const aes_ectx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  vaes512_ecb (aes->e_key, aes->nrounds, 1, out, in, nblocks);
+}
+
+static void
+vaes512_ecb_decrypt (const aes_ctx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  vaes512_ecb (aes->d_key, aes->e.nrounds, 0, out, in, nblocks);
+}
+
+/* Multi-key CBC: four keys per register, one per 128-bit lane, so the
+   round key for round r of a group is a single load from mk->rk[r].
+   Lanes past nkeys run on the all-zero keys aes_msetkey leaves there
+   and are never copied out. */
+static inline __attribute__ ((always_inline)) void
+vaes512_mcbc_n (const aes_mkey *mk, u_char (*state)[16],
+		const u_char *const msgs[], size_t nblocks, const int ng)
+{
+  static const u_char zero[aes_blocklen];
+  const __m512i bswap32 = _mm512_broadcast_i32x4
+    (_mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+  u_char st[aes_mkeys_max][16];
+  const u_char *m[aes_mkeys_max];
+  size_t step[aes_mkeys_max];
+  __m512i rk[2][15], x[2], v;
+  const int n = mk->nkeys, nr = mk->nrounds;
+  size_t b;
+  int g, k, r;
+
+  bzero (st, sizeof (st));
+  memcpy (st, state, n * sizeof (st[0]));
+  for (k = 0; k < aes_mkeys_max; k++) {
+    m[k] = msgs && k < n ? msgs[k] : zero;
+    step[k] = msgs && k < n ? aes_blocklen : 0;
+  }
+  for (g = 0; g < ng; g++) {
+    for (r = 0; r <= nr; r++)
+      rk[g][r] = _mm512_shuffle_epi8
+	(_mm512_loadu_si512 (mk->rk[r][4 * g]), bswap32);
+    x[g] = _mm512_loadu_si512 (st[4 * g]);
+  }
+
+  for (b = 0; b < nblocks; b++) {
+    for (g = 0; g < ng; g++) {
+      v = _mm512_castsi128_si512
+	(_mm_loadu_si128 ((const __m128i *) m[4 * g]));
+      v = _mm512_inserti32x4
+	(v, _mm_loadu_si128 ((const __m128i *) m[4 * g + 1]), 1);
+      v = _mm512_inserti32x4
+	(v, _mm_loadu_si128 ((const __m128i *) m[4 * g + 2]), 2);
+      v = _mm512_inserti32x4
+	(v, _mm_loadu_si128 ((const __m128i *) m[4 * g + 3]), 3);
+      x[g] = _mm512_ternarylogic_epi64 (x[g], v, rk[g][0], 0x96);
+    }
+    for (k = 0; k < aes_mkeys_max; k++)
+      m[k] += step[k];
+    for (r = 1; r < nr; r++)
+#pragma GCC unroll 4
+      for (g = 0; g < ng; g++)
+	x[g] = _mm512_aesenc_epi128 (x[g], rk[g][r]);
+    for (g = 0; g < ng; g++)
+      x[g] = _mm512_aesenclast_epi128 (x[g], rk[g][nr]);
+  }
+
+  for (g = 0; g < ng; g++)
+    _mm512_storeu_si512 (st[4 * g], x[g]);
+  memcpy (state, st, n * sizeof (st[0]));
+  bzero (st, sizeof (st));
+}
+
+static void
+vaes512_mcbc (const aes_mkey *mk, u_char (*state)[16],
+	      const u_char *const msgs[], size_t nblocks)
+{
+  if (!msgs)
+    nblocks = 1;
+  if (mk->nkeys <= 4)
+    vaes512_mcbc_n (mk, state, msgs, nblocks, 1);
+  else
+    vaes512_mcbc_n (mk, state, msgs, nblocks, 2);
+}
+
+#pragma GCC pop_options
+
+/*
+ * 256-bit kernels
+ */
+
+#pragma GCC push_options
+#pragma GCC target ("aes,avx2,vaes")
+
+#define K256(i) _mm256_broadcastsi128_si256 (rk[i])
+
+/* AVX2 has no unsigned 64-bit compare, so detect the carry with a
+   signed compare on sign-flipped values and subtract the all-ones
+   result (i.e. add 1) in the high quadword. */
+static inline __m256i
+vaes256_ctradd (__m256i c, __m256i inc)
+{
+  const __m256i flip = _mm256_set1_epi64x ((long long) 1 << 63);
+  __m256i s = _mm256_add_epi64 (c, inc);
+  __m256i carry = _mm256_cmpgt_epi64 (_mm256_xor_si256 (c, flip),
+				      _mm256_xor_si256 (s, flip));
+  carry = _mm256_and_si256 (carry, _mm256_set_epi64x (0, -1, 0, -1));
+  return _mm256_sub_epi64 (s, _mm256_slli_si256 (carry, 8));
+}
+
+static void
+vaes256_ctr_xor (const aes_ectx *aes, u_char *out, const u_char *in,
+		 size_t len, const u_char ctr[16])
+{
+  __m128i rk[15];
+  __m256i rev, c, two, klast;
+  __m256i x0, x1, x2, x3, x4, x5, x6, x7;
+  u_char tmp[32];
+  int r, nr = aes->nrounds;
+
+  vaes_loadkeys (rk, aes->e_key, nr);
+  rev = _mm256_broadcastsi128_si256 (vaes_rev128 ());
+  c = _mm256_broadcastsi128_si256 (_mm_shuffle_epi8
+				   (_mm_loadu_si128 ((const __m128i *) ctr),
+				    vaes_rev128 ()));
+  c = vaes256_ctradd (c, _mm256_set_epi64x (0, 1, 0, 0));
+  two = _mm256_set_epi64x (0, 2, 0, 2);
+  klast = K256 (nr);
+
+  for (; len >= 256; in += 256, out += 256, len -= 256) {
+    x0 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x1 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x2 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x3 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x4 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x5 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x6 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    x7 = _mm256_shuffle_epi8 (c, rev); c = vaes256_ctradd (c, two);
+    ENC8 (_mm256_xor_si256, K256 (0));
+    for (r = 1; r < nr; r++)
+      ENC8 (_mm256_aesenc_epi128, K256 (r));
+#define LAST(x, off) \
+    x = _mm256_aesenclast_epi128 \
+      (x, _mm256_xor_si256 (klast, \
+			    _mm256_loadu_si256 ((const __m256i *) (in + off))))
+    LAST (x0, 0); LAST (x1, 32); LAST (x2, 64); LAST (x3, 96);
+    LAST (x4, 128); LAST (x5, 160); LAST (x6, 192); LAST (x7, 224);
+#undef LAST
+    _mm256_storeu_si256 ((__m256i *) out, x0);
+    _mm256_storeu_si256 ((__m256i *) (out + 32), x1);
+    _mm256_storeu_si256 ((__m256i *) (out + 64), x2);
+    _mm256_storeu_si256 ((__m256i *) (out + 96), x3);
+    _mm256_storeu_si256 ((__m256i *) (out + 128), x4);
+    _mm256_storeu_si256 ((__m256i *) (out + 160), x5);
+    _mm256_storeu_si256 ((__m256i *) (out + 192), x6);
+    _mm256_storeu_si256 ((__m256i *) (out + 224), x7);
+  }
+
+  /* two blocks at a time; a short tail goes through a bounce buffer */
+  while (len) {
+    x0 = _mm256_shuffle_epi8 (c, rev);
+    c = vaes256_ctradd (c, two);
+    x0 = _mm256_xor_si256 (x0, K256 (0));
+    for (r = 1; r < nr; r++)
+      x0 = _mm256_aesenc_epi128 (x0, K256 (r));
+    if (len >= 32) {
+      x0 = _mm256_aesenclast_epi128
+	(x0, _mm256_xor_si256 (klast,
+			       _mm256_loadu_si256 ((const __m256i *) in)));
+      _mm256_storeu_si256 ((__m256i *) out, x0);
+      in += 32;
+      out += 32;
+      len -= 32;
+      continue;
+    }
+    memcpy (tmp, in, len);
+    x0 = _mm256_aesenclast_epi128
+      (x0, _mm256_xor_si256 (klast, _mm256_loadu_si256 ((__m256i *) tmp)));
+    _mm256_storeu_si256 ((__m256i *) tmp, x0);
+    memcpy (out, tmp, len);
+    bzero (tmp, sizeof (tmp));
+    break;
+  }
+}
+
+static inline void
+vaes256_ecb (const u_int32_t *key, int nr, int enc,
+	     u_char *out, const u_char *in, size_t nblocks)
+{
+  __m128i rk[15], b;
+  __m256i x0, x1, x2, x3, x4, x5, x6, x7;
+  int r;
+
+  vaes_loadkeys (rk, key, nr);
+
+  for (; nblocks >= 16; in += 256, out += 256, nblocks -= 16) {
+    x0 = _mm256_loadu_si256 ((const __m256i *) in);
+    x1 = _mm256_loadu_si256 ((const __m256i *) (in + 32));
+    x2 = _mm256_loadu_si256 ((const __m256i *) (in + 64));
+    x3 = _mm256_loadu_si256 ((const __m256i *) (in + 96));
+    x4 = _mm256_loadu_si256 ((const __m256i *) (in + 128));
+    x5 = _mm256_loadu_si256 ((const __m256i *) (in + 160));
+    x6 = _mm256_loadu_si256 ((const __m256i *) (in + 192));
+    x7 = _mm256_loadu_si256 ((const __m256i *) (in + 224));
+    ENC8 (_mm256_xor_si256, K256 (0));
+    if (enc) {
+      for (r = 1; r < nr; r++)
+	ENC8 (_mm256_aesenc_epi128, K256 (r));
+      ENC8 (_mm256_aesenclast_epi128, K256 (nr));
+    }
+    else {
+      for (r = 1; r < nr; r++)
+	ENC8 (_mm256_aesdec_epi128, K256 (r));
+      ENC8 (_mm256_aesdeclast_epi128, K256 (nr));
+    }
+    _mm256_storeu_si256 ((__m256i *) out, x0);
+    _mm256_storeu_si256 ((__m256i *) (out + 32), x1);
+    _mm256_storeu_si256 ((__m256i *) (out + 64), x2);
+    _mm256_storeu_si256 ((__m256i *) (out + 96), x3);
+    _mm256_storeu_si256 ((__m256i *) (out + 128), x4);
+    _mm256_storeu_si256 ((__m256i *) (out + 160), x5);
+    _mm256_storeu_si256 ((__m256i *) (out + 192), x6);
+    _mm256_storeu_si256 ((__m256i *) (out + 224), x7);
+  }
+
+  for (; nblocks >= 2; in += 32, out += 32, nblocks -= 2) {
+    x0 = _mm256_xor_si256 (_mm256_loadu_si256 ((const __m256i *) in),
+			   K256 (0));
+    if (enc) {
+      for (r = 1; r < nr; r++)
+	x0 = _mm256_aesenc_epi128 (x0, K256 (r));
+      x0 = _mm256_aesenclast_epi128 (x0, K256 (nr));
+    }
+    else {
+      for (r = 1; r < nr; r++)
+	x0 = _mm256_aesdec_epi128 (x0, K256 (r));
+      x0 = _mm256_aesdeclast_epi128 (x0, K256 (nr));
+    }
+    _mm256_storeu_si256 ((__m256i *) out, x0);
+  }
+
+  /* a single leftover block uses the 128-bit AES-NI instructions */
+  if (nblocks) {
+    b = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) in), rk[0]);
+    if (enc) {
+      for (r = 1; r < nr; r++)
+	b = _mm_aesenc_si128 (b, rk[r]);
+      b = _mm_aesenclast_si128 (b, rk[nr]);
+    }
+    else {
+      for (r = 1; r < nr; r++)
+	b = _mm_aesdec_si128 (b, rk[r]);
+      b = _mm_aesdeclast_si128 (b, rk[nr]);
+    }
+    _mm_storeu_si128 ((__m128i *) out, b);
+  }
+}
+
+static void
+vaes256_ecb_encrypt (const aes_ectx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  vaes256_ecb (aes->e_key, aes->nrounds, 1, out, in, nblocks);
+}
+
+static void
+vaes256_ecb_decrypt (const aes_ctx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  vaes256_ecb (aes->d_key, aes->e.nrounds, 0, out, in, nblocks);
+}
+
+/* As vaes512_mcbc_n, with two keys per register */
+static inline __attribute__ ((always_inline)) void
+vaes256_mcbc_n (const aes_mkey *mk, u_char (*state)[16],
+		const u_char *const msgs[], size_t nblocks, const int ng)
+{
+  static const u_char zero[aes_blocklen];
+  const __m256i bswap32 = _mm256_broadcastsi128_si256
+    (_mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+  u_char st[aes_mkeys_max][16];
+  const u_char *m[aes_mkeys_max];
+  size_t step[aes_mkeys_max];
+  __m256i rk[4][15], x[4], v;
+  const int n = mk->nkeys, nr = mk->nrounds;
+  size_t b;
+  int g, k, r;
+
+  bzero (st, sizeof (st));
+  memcpy (st, state, n * sizeof (st[0]));
+  for (k = 0; k < aes_mkeys_max; k++) {
+    m[k] = msgs && k < n ? msgs[k] : zero;
+    step[k] = msgs && k < n ? aes_blocklen : 0;
+  }
+  for (g = 0; g < ng; g++) {
+    for (r = 0; r <= nr; r++)
+      rk[g][r] = _mm256_shuffle_epi8
+	(_mm256_loadu_si256 ((const __m256i *) mk->rk[r][2 * g]), bswap32);
+    x[g] = _mm256_loadu_si256 ((const __m256i *) st[2 * g]);
+  }
+
+  for (b = 0; b < nblocks; b++) {
+    for (g = 0; g < ng; g++) {
+      v = _mm256_castsi128_si256
+	(_mm_loadu_si128 ((const __m128i *) m[2 * g]));
+      v = _mm256_inserti128_si256
+	(v, _mm_loadu_si128 ((const __m128i *) m[2 * g + 1]), 1);
+      x[g] = _mm256_xor_si256 (x[g], _mm256_xor_si256 (v, rk[g][0]));
+    }
+    for (k = 0; k < aes_mkeys_max; k++)
+      m[k] += step[k];
+    for (r = 1; r < nr; r++)
+#pragma GCC unroll 4
+      for (g = 0; g < ng; g++)
+	x[g] = _mm256_aesenc_epi128 (x[g], rk[g][r]);
+    for (g = 0; g < ng; g++)
+      x[g] = _mm256_aesenclast_epi128 (x[g], rk[g][nr]);
+  }
+
+  for (g = 0; g < ng; g++)
+    _mm256_storeu_si256 ((__m256i *) st[2 * g], x[g]);
+  memcpy (state, st, n * sizeof (st[0]));
+  bzero (st, sizeof (st));
+}
+
+static void
+vaes256_mcbc (const aes_mkey *mk, u_char (*state)[16],
+	      const u_char *const msgs[], size_t nblocks)
+{
+  if (!msgs)
+    nblocks = 1;
+  switch ((mk->nkeys + 1) / 2) {
+  case 1:
+    vaes256_mcbc_n (mk, state, msgs, nblocks, 1);
+    break;
+  case 2:
+    vaes256_mcbc_n (mk, state, msgs, nblocks, 2);
+    break;
+  case 3:
+    vaes256_mcbc_n (mk, state, msgs, nblocks, 3);
+    break;
+  default:
+    vaes256_mcbc_n (mk, state, msgs, nblocks, 4);
+    break;
+  }
+}
+
+#pragma GCC pop_options
+
+static int
+vaes512_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("vaes")
+    && __builtin_cpu_supports ("avx512f")
+    && __builtin_cpu_supports ("avx512bw")
+    && __builtin_cpu_supports ("avx512vl");
+}
+
+static int
+vaes256_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("vaes")
+    && __builtin_cpu_supports ("aes")
+    && __builtin_cpu_supports ("avx2");
+}
+
+const aes_bulkops aes_vaes512 = {
+  "vaes512", vaes512_probe,
+  vaes512_ecb_encrypt, vaes512_ecb_decrypt, vaes512_ctr_xor,
+  vaes512_mcbc
+};
+
+const aes_bulkops aes_vaes256 = {
+  "vaes256", vaes256_probe,
+  vaes256_ecb_encrypt, vaes256_ecb_decrypt, vaes256_ctr_xor,
+  vaes256_mcbc
+};
+
+#endif /* DC_HAVE_VAES */
@@ -0,0 +1,255 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * Bulk ECB and CTR interfaces to AES.  The work is handed to the
+ * fastest implementation in aes_bulkconf[] (see aesconf.c) that the
+ * running CPU supports; aes_ttable, which just loops over
+ * aes_encrypt/aes_decrypt, is always available.  aes_compact is the
+ * same loop over the small-table block functions, for hosts where many
+ * threads compete for cache; it is never picked by default.
+ */
+
+#include "dcinternal.h"
+
+static const aes_bulkops *aes_bulk;
+
+static const aes_bulkops *
+aes_bulkinit (void)
+{
+  const aes_bulkops **bp;
+
+  for (bp = aes_bulkconf; *bp; bp++)
+    if (!(*bp)->probe || (*bp)->probe ())
+      return aes_bulk = *bp;
+  return aes_bulk = &aes_ttable;
+}
+
+#define AES_BULK (aes_bulk ? aes_bulk : aes_bulkinit ())
+
+const char *
+aes_backend (void)
+{
+  return AES_BULK->name;
+}
+
+int
+aes_setbackend (const char *name)
+{
+  const aes_bulkops **bp;
+
+  for (bp = aes_bulkconf; *bp; bp++)
+    if (!strcmp ((*bp)->name, name)) {
+      if ((*bp)->probe && !(*bp)->probe ())
+	return -1;
+      aes_bulk = *bp;
+      return 0;
+    }
+  return -1;
+}
+
+void
+aes_ctr_add (u_char ctr[16], u_int64_t n)
+{
+  int i;
+  u_int carry;
+
+  for (i = 15; i >= 0 && n; i--) {
+    carry = ctr[i] + (u_int) (n & 0xff);
+    ctr[i] = carry;
+    n = (n >> 8) + (carry >> 8);
+  }
+}
+
+void
+aes_ecb_encrypt (const aes_ctx *aes, void *buf, const void *ibuf,
+		 size_t nblocks)
+{
+  AES_BULK->ecb_encrypt (&aes->e, buf, ibuf, nblocks);
+}
+
+void
+aes_ecb_decrypt (const aes_ctx *aes, void *buf, const void *ibuf,
+		 size_t nblocks)
+{
+  aes_dkey (aes);
+  AES_BULK->ecb_decrypt (aes, buf, ibuf, nblocks);
+}
+
+void
+aes_ectr_xor (const aes_ectx *aes, void *buf, const void *ibuf,
+	      size_t len, void *ctr)
+{
+  if (!len)
+    return;
+  AES_BULK->ctr_xor (aes, buf, ibuf, len, ctr);
+  aes_ctr_add (ctr, (len + aes_blocklen - 1) / aes_blocklen);
+}
+
+void
+aes_ctr_xor (const aes_ctx *aes, void *buf, const void *ibuf,
+	     size_t len, void *ctr)
+{
+  aes_ectr_xor (&aes->e, buf, ibuf, len, ctr);
+}
+
+int
+aes_msetkey (aes_mkey *mk, const aes_ectx *const keys[], int nkeys)
+{
+  int i, k;
+
+  if (nkeys < 1 || nkeys > aes_mkeys_max)
+    return -1;
+  for (k = 1; k < nkeys; k++)
+    if (keys[k]->nrounds != keys[0]->nrounds)
+      return -1;
+
+  bzero (mk, sizeof (*mk));
+  mk->nkeys = nkeys;
+  mk->nrounds = keys[0]->nrounds;
+  for (k = 0; k < nkeys; k++)
+    for (i = 0; i <= mk->nrounds; i++)
+      memcpy (mk->rk[i][k], keys[k]->e_key + 4 * i, sizeof (mk->rk[i][k]));
+  return 0;
+}
+
+void
+aes_mclrkey (aes_mkey *mk)
+{
+  bzero (mk, sizeof (*mk));
+}
+
+void
+aes_mencrypt (const aes_mkey *mk, void *blocks)
+{
+  AES_BULK->mcbc (mk, blocks, NULL, 1);
+}
+
+void
+aes_mcbcmac (const aes_mkey *mk, void *macs,
+	     const void *const msgs[], size_t nblocks)
+{
+  if (nblocks)
+    AES_BULK->mcbc (mk, macs, (const u_char *const *) msgs, nblocks);
+}
+
+static void
+ttable_ecb_encrypt (const aes_ectx *aes, u_char *out, const u_char *in,
+		    size_t nblocks)
+{
+  for (; nblocks; nblocks--, in += aes_blocklen, out += aes_blocklen)
+    aes_eencrypt (aes, out, in);
+}
+
+static void
+ttable_ecb_decrypt (const aes_ctx *aes, u_char *out, const u_char *in,
+		    size_t nblocks)
+{
+  for (; nblocks; nblocks--, in += aes_blocklen, out += aes_blocklen)
+    aes_decrypt (aes, out, in);
+}
+
+static void
+blockwise_ctr_xor (void (*encrypt) (const aes_ectx *, void *, const void *),
+		   const aes_ectx *aes, u_char *out, const u_char *in,
+		   size_t len, const u_char ctr[16])
+{
+  u_char c[aes_blocklen], ks[aes_blocklen];
+  size_t i, n;
+
+  memcpy (c, ctr, aes_blocklen);
+  while (len) {
+    encrypt (aes, ks, c);
+    aes_ctr_add (c, 1);
+    n = len < aes_blocklen ? len : aes_blocklen;
+    for (i = 0; i < n; i++)
+      out[i] = in[i] ^ ks[i];
+    in += n;
+    out += n;
+    len -= n;
+  }
+  bzero (ks, sizeof (ks));
+}
+
+static void
+ttable_ctr_xor (const aes_ectx *aes, u_char *out, const u_char *in,
+		size_t len, const u_char ctr[16])
+{
+  blockwise_ctr_xor (aes_eencrypt, aes, out, in, len, ctr);
+}
+
+const aes_bulkops aes_ttable = {
+  "ttable", NULL,
+  ttable_ecb_encrypt, ttable_ecb_decrypt, ttable_ctr_xor,
+  aes_mcbc_ttable
+};
+
+static void
+compact_ecb_encrypt (const aes_ectx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  for (; nblocks; nblocks--, in += aes_blocklen, out += aes_blocklen)
+    aes_cencrypt (aes, out, in);
+}
+
+static void
+compact_ecb_decrypt (const aes_ctx *aes, u_char *out, const u_char *in,
+		     size_t nblocks)
+{
+  for (; nblocks; nblocks--, in += aes_blocklen, out += aes_blocklen)
+    aes_cdecrypt (aes, out, in);
+}
+
+static void
+compact_ctr_xor (const aes_ectx *aes, u_char *out, const u_char *in,
+		 size_t len, const u_char ctr[16])
+{
+  blockwise_ctr_xor (aes_cencrypt, aes, out, in, len, ctr);
+}
+
+static void
+compact_mcbc (const aes_mkey *mk, u_char (*state)[16],
+	      const u_char *const msgs[], size_t nblocks)
+{
+  aes_ectx keys[aes_mkeys_max];
+  size_t b;
+  int i, k;
+
+  for (k = 0; k < mk->nkeys; k++) {
+    keys[k].nrounds = mk->nrounds;
+    for (i = 0; i <= mk->nrounds; i++)
+      memcpy (keys[k].e_key + 4 * i, mk->rk[i][k], sizeof (mk->rk[i][k]));
+  }
+  if (!msgs)
+    nblocks = 1;
+  for (b = 0; b < nblocks; b++)
+    for (k = 0; k < mk->nkeys; k++) {
+      if (msgs)
+	for (i = 0; i < aes_blocklen; i++)
+	  state[k][i] ^= msgs[k][b * aes_blocklen + i];
+      aes_cencrypt (&keys[k], state[k], state[k]);
+    }
+  bzero (keys, sizeof (keys));
+}
+
+const aes_bulkops aes_compact = {
+  "compact", NULL,
+  compact_ecb_encrypt, compact_ecb_decrypt, compact_ctr_xor,
+  compact_mcbc
+};
@@ -0,0 +1,287 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * A bounded cache of AES encryption schedules, for callers that hold
+ * far more keys than they use at any one time.  Entries are keyed by a
+ * fingerprint of the raw key and hold only the round keys in use; the
+ * caller gets a private copy, and a decryption schedule is built in it
+ * only if it decrypts.
+ *
+ * Lookups take no lock.  The index is an open-addressed table of slot
+ * numbers, and every slot carries a sequence count that is odd while
+ * the slot is being rewritten, so a reader copies the schedule, checks
+ * that the count did not move, and compares the copied first round
+ * keys (the raw key itself) with the key it was asked for.  Inserts
+ * and evictions are serialized by a spinlock; a reader that races with
+ * one may miss and then finds the entry again under the lock.
+ * Eviction is CLOCK: a hit sets the slot's reference bit, and the hand
+ * clears bits until it finds a slot without one.
+ */
+
+#include "dcinternal.h"
+#include <sched.h>
+
+struct aes_cslot {
+  u_int32_t seq;		/* odd while being written */
+  u_int32_t nrounds;
+  u_int64_t fp;
+  u_int32_t rk[60];
+};
+
+struct aes_cache {
+  u_int64_t seed;
+  u_int32_t mask;		/* index size - 1 */
+  u_int32_t nslots;
+  u_int32_t used;
+  u_int32_t hand;
+  char lock;
+  u_int64_t hits;
+  u_int64_t misses;
+  u_int64_t evictions;
+  u_int32_t *index;		/* slot number + 1, or 0 if empty */
+  u_char *ref;
+  struct aes_cslot *slots;
+};
+
+#define LOAD(p) __atomic_load_n (p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n (p, v, __ATOMIC_RELEASE)
+#define COUNT(p) __atomic_fetch_add (p, 1, __ATOMIC_RELAXED)
+
+static u_int64_t
+aes_cache_fp (const aes_cache *c, const u_int32_t *kw, int nkw)
+{
+  u_int64_t h = c->seed ^ nkw;
+  int i;
+
+  for (i = 0; i < nkw; i++) {
+    h = (h ^ kw[i]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+/* copies slot s into rk if it holds the key kw; returns its nrounds,
+   or 0 if it holds another key */
+static int
+aes_cache_read (const struct aes_cslot *s, u_int64_t fp,
+		const u_int32_t *kw, int nkw, u_int32_t *rk)
+{
+  u_int32_t seq, nr;
+
+  for (;;) {
+    seq = LOAD (&s->seq);
+    if (seq & 1) {
+      sched_yield ();
+      continue;
+    }
+    nr = s->nrounds;
+    if (s->fp != fp || nr != (u_int32_t) nkw + 6)
+      nr = 0;
+    else
+      memcpy (rk, s->rk, 4 * (nr + 1) * sizeof (rk[0]));
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&s->seq, __ATOMIC_RELAXED) == seq)
+      break;
+  }
+  if (nr && memcmp (rk, kw, nkw * sizeof (kw[0])))
+    nr = 0;
+  return nr;
+}
+
+/* returns the slot holding kw, or -1 */
+static int
+aes_cache_find (const aes_cache *c, u_int64_t fp,
+		const u_int32_t *kw, int nkw, u_int32_t *rk)
+{
+  u_int32_t i, n, s;
+
+  for (i = fp & c->mask, n = 0; n <= c->mask; i = (i + 1) & c->mask, n++) {
+    if (!(s = LOAD (&c->index[i])))
+      break;
+    if (aes_cache_read (&c->slots[s - 1], fp, kw, nkw, rk))
+      return s - 1;
+  }
+  return -1;
+}
+
+/* removes slot s from the index, shifting later entries of its probe
+   run back so no lookup stops early at the hole; lock held */
+static void
+aes_cache_unlink (aes_cache *c, u_int32_t s)
+{
+  u_int32_t i, j, home, e;
+
+  for (i = c->slots[s].fp & c->mask; c->index[i] != s + 1;
+       i = (i + 1) & c->mask)
+    ;
+  for (j = i;;) {
+    j = (j + 1) & c->mask;
+    if (!(e = c->index[j])) {
+      STORE (&c->index[i], 0);
+      return;
+    }
+    home = c->slots[e - 1].fp & c->mask;
+    /* e may move to i unless its home lies cyclically in (i, j] */
+    if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+      STORE (&c->index[i], e);
+      i = j;
+    }
+  }
+}
+
+/* lock held */
+static u_int32_t
+aes_cache_victim (aes_cache *c)
+{
+  u_int32_t s;
+
+  if (c->used < c->nslots) {
+    s = c->used;
+    __atomic_store_n (&c->used, s + 1, __ATOMIC_RELAXED);
+    return s;
+  }
+  for (;;) {
+    s = c->hand;
+    c->hand = (c->hand + 1) % c->nslots;
+    if (!LOAD (&c->ref[s]))
+      break;
+    STORE (&c->ref[s], 0);
+  }
+  aes_cache_unlink (c, s);
+  COUNT (&c->evictions);
+  return s;
+}
+
+aes_cache *
+aes_cache_alloc (size_t budget)
+{
+  const size_t per = sizeof (struct aes_cslot) + 1 + 2 * sizeof (u_int32_t);
+  aes_cache *c;
+  size_t nslots, nindex;
+
+  if (budget < sizeof (*c))
+    return NULL;
+  nslots = (budget - sizeof (*c)) / per;
+  for (nindex = 1; nindex < 2 * nslots; nindex <<= 1)
+    ;
+  /* rounding the index up may leave less room for slots */
+  if (sizeof (*c) + nindex * sizeof (u_int32_t) > budget)
+    return NULL;
+  nslots = (budget - sizeof (*c) - nindex * sizeof (u_int32_t))
+    / (sizeof (struct aes_cslot) + 1);
+  if (nslots > nindex / 2)
+    nslots = nindex / 2;
+  if (!nslots || nindex > 0x80000000)
+    return NULL;
+
+  c = xmalloc (sizeof (*c));
+  bzero (c, sizeof (*c));
+  c->seed = prng_gethyper ();
+  c->mask = nindex - 1;
+  c->nslots = nslots;
+  c->index = xmalloc (nindex * sizeof (c->index[0]));
+  bzero (c->index, nindex * sizeof (c->index[0]));
+  c->ref = xmalloc (nslots);
+  bzero (c->ref, nslots);
+  c->slots = xmalloc (nslots * sizeof (c->slots[0]));
+  bzero (c->slots, nslots * sizeof (c->slots[0]));
+  return c;
+}
+
+void
+aes_cache_free (aes_cache *c)
+{
+  bzero (c->slots, c->nslots * sizeof (c->slots[0]));
+  xfree (c->slots);
+  xfree (c->ref);
+  xfree (c->index);
+  bzero (c, sizeof (*c));
+  xfree (c);
+}
+
+int
+aes_cache_eget (aes_cache *c, aes_ectx *aes, const void *key, u_int keylen)
+{
+  const char *kp = key;
+  u_int32_t kw[8], rk[60];
+  struct aes_cslot *sp;
+  int nkw = keylen / 4, i, s;
+  u_int64_t fp;
+
+  /* kw only has room for the longest key, so check before copying,
+     as aes_setkey would on a miss */
+  if (keylen != 16 && keylen != 24 && keylen != 32) {
+    fprintf (stderr, "invalid AES key length %d (should be 16, 24, or 32).\n",
+	     keylen);
+    abort ();
+  }
+  for (i = 0; i < nkw; i++)
+    kw[i] = get32be (kp + 4 * i);
+  fp = aes_cache_fp (c, kw, nkw);
+
+  if ((s = aes_cache_find (c, fp, kw, nkw, rk)) < 0) {
+    while (__atomic_test_and_set (&c->lock, __ATOMIC_ACQUIRE))
+      sched_yield ();
+    if ((s = aes_cache_find (c, fp, kw, nkw, rk)) < 0) {
+      aes_esetkey (aes, key, keylen);
+      s = aes_cache_victim (c);
+      sp = &c->slots[s];
+      __atomic_store_n (&sp->seq, sp->seq + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence (__ATOMIC_RELEASE);
+      sp->fp = fp;
+      sp->nrounds = aes->nrounds;
+      memcpy (sp->rk, aes->e_key, 4 * (aes->nrounds + 1) * sizeof (rk[0]));
+      STORE (&sp->seq, sp->seq + 1);
+      for (i = fp & c->mask; c->index[i]; i = (i + 1) & c->mask)
+	;
+      STORE (&c->index[i], s + 1);
+      __atomic_clear (&c->lock, __ATOMIC_RELEASE);
+      COUNT (&c->misses);
+      bzero (kw, sizeof (kw));
+      return 0;
+    }
+    __atomic_clear (&c->lock, __ATOMIC_RELEASE);
+  }
+
+  if (!LOAD (&c->ref[s]))
+    STORE (&c->ref[s], 1);
+  COUNT (&c->hits);
+  aes_esetsched (aes, nkw + 6, rk);
+  bzero (kw, sizeof (kw));
+  bzero (rk, sizeof (rk));
+  return 1;
+}
+
+int
+aes_cache_get (aes_cache *c, aes_ctx *aes, const void *key, u_int keylen)
+{
+  aes->d_ready = 0;
+  return aes_cache_eget (c, &aes->e, key, keylen);
+}
+
+void
+aes_cache_stats (const aes_cache *c, aes_cache_stat *st)
+{
+  st->hits = __atomic_load_n (&c->hits, __ATOMIC_RELAXED);
+  st->misses = __atomic_load_n (&c->misses, __ATOMIC_RELAXED);
+  st->evictions = __atomic_load_n (&c->evictions, __ATOMIC_RELAXED);
+  st->entries = __atomic_load_n (&c->used, __ATOMIC_RELAXED);
+  st->capacity = c->nslots;
+}
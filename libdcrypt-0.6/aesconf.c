@@ -0,0 +1,37 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+#include "dcinternal.h"
+
+/* bulk AES implementations, fastest first; the first one whose probe
+   succeeds on this CPU is used unless aes_setbackend says otherwise.
+   The list is kept out of dcconf.c, whose public-key table would link
+   the public-key code and GMP into every program that uses AES. */
+const aes_bulkops *aes_bulkconf[] = {
+#ifdef DC_HAVE_VAES
+  &aes_vaes512,
+  &aes_vaes256,
+#endif /* DC_HAVE_VAES */
+#ifdef DC_HAVE_AVX2
+  &aes_avx2,
+#endif /* DC_HAVE_AVX2 */
+  &aes_ttable,
+  &aes_compact,
+  NULL
+};
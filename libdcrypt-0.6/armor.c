@@ -230,24 +230,144 @@ static const signed char a2b64[256] = {
   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 };
 
+static size_t
+portable_encode (char *d, const u_char *p, size_t ngroups)
+{
+  size_t n;
+
+  for (n = 0; n < ngroups; n++, p += 3, d += 4) {
+    d[0] = b2a64[p[0] >> 2];
+    d[1] = b2a64[(p[0] & 0x3) << 4 | p[1] >> 4];
+    d[2] = b2a64[(p[1] & 0xf) << 2 | p[2] >> 6];
+    d[3] = b2a64[p[2] & 0x3f];
+  }
+  return ngroups;
+}
+
+static size_t
+portable_decode (u_char *d, const u_char *s, size_t len)
+{
+  int c0, c1, c2, c3;
+  size_t n;
+
+  for (n = 0; len >= 4; n++, len -= 4, s += 4, d += 3) {
+    c0 = a2b64[s[0]];
+    c1 = a2b64[s[1]];
+    c2 = a2b64[s[2]];
+    c3 = a2b64[s[3]];
+    if ((c0 | c1 | c2 | c3) < 0)
+      break;
+    d[0] = c0 << 2 | c1 >> 4;
+    d[1] = c1 << 4 | c2 >> 2;
+    d[2] = c2 << 6 | c3;
+  }
+  return n;
+}
+
+static size_t
+portable_span (const u_char *s, size_t len)
+{
+  size_t n;
+
+  for (n = 0; n < len && a2b64[s[n]] >= 0; n++)
+    ;
+  return n;
+}
+
+const armor64_ops armor64_portable = {
+  "portable", NULL, portable_encode, portable_decode, portable_span
+};
+
+const armor64_ops *armor64conf[] = {
+#ifdef DC_HAVE_ARMORSIMD
+  &armor64_avx2,
+  &armor64_ssse3,
+#endif /* DC_HAVE_ARMORSIMD */
+  &armor64_portable,
+  NULL
+};
+
+static const armor64_ops *armor64_impl;
+
+static const armor64_ops *
+armor64_implinit (void)
+{
+  const armor64_ops **ap;
+
+  for (ap = armor64conf; *ap; ap++)
+    if (!(*ap)->probe || (*ap)->probe ())
+      return armor64_impl = *ap;
+  return armor64_impl = &armor64_portable;
+}
+
+#define ARMOR64_IMPL (armor64_impl ? armor64_impl : armor64_implinit ())
+
+const char *
+armor64_backend (void)
+{
+  return ARMOR64_IMPL->name;
+}
+
+int
+armor64_setbackend (const char *name)
+{
+  const armor64_ops **ap;
+
+  for (ap = armor64conf; *ap; ap++)
+    if (!strcmp ((*ap)->name, name)) {
+      if ((*ap)->probe && !(*ap)->probe ())
+	return -1;
+      armor64_impl = *ap;
+      return 0;
+    }
+  return -1;
+}
+
+/* The decoders run over NUL-terminated strings of unknown length, so
+   they are only handed the bytes from p to the end of its page: past
+   the NUL those can be read without a fault, and the kernels make
+   nothing of them.  A step of the scalar code then carries on across
+   the page boundary or finds the end of the string. */
+enum { armor_pagesize = 4096 };
+
+static inline size_t
+armor_readable (const u_char *p)
+{
+  return armor_pagesize - ((unsigned long) p & (armor_pagesize - 1));
+}
+
+/* the number of base64 characters s starts with */
+static size_t
+armor64span (const u_char *s)
+{
+  const armor64_ops *impl = ARMOR64_IMPL;
+  const u_char *p = s;
+
+  for (;;) {
+    p += impl->span (p, armor_readable (p));
+    if (a2b64[*p] < 0)
+      return p - s;
+    p++;
+  }
+}
+
 char *
 armor64 (const void *dp, size_t len)
 {
   const u_char *p = dp;
   int rem = len % 3;
-  const u_char *e = p + (len - rem);
+  size_t ngroups = len / 3, n;
   size_t reslen = ((len + 2) / 3) * 4;
   char *res = malloc (reslen + 1);
   char *d = res;
 
-  while (p < e) {
-    d[0] = b2a64[p[0] >> 2];
-    d[1] = b2a64[(p[0] & 0x3) << 4 | p[1] >> 4];
-    d[2] = b2a64[(p[1] & 0xf) << 2 | p[2] >> 6];
-    d[3] = b2a64[p[2] & 0x3f];
-    d += 4;
-    p += 3;
-  }
+  if (!res)
+    return NULL;
+
+  n = ARMOR64_IMPL->encode (d, p, ngroups);
+  n += portable_encode (d + 4 * n, p + 3 * n, ngroups - n);
+  p += 3 * n;
+  d += 4 * n;
 
   switch (rem) {
   case 1:
@@ -274,10 +394,8 @@ ssize_t
 armor64len (const char *_s)
 {
   const u_char *s = (const u_char *) _s;
-  const u_char *p = s;
+  const u_char *p = s + armor64span (s);
   ssize_t len;
-  while (a2b64[*p] >= 0)
-    p++;
   if (*p == '=')
     p++;
   if (*p == '=')
@@ -290,11 +408,8 @@ ssize_t
 dearmor64len (const char *_s)
 {
   const u_char *s = (const u_char *) _s;
-  const u_char *p = s;
-  ssize_t len;
-  while (a2b64[*p] >= 0)
-    p++;
-  len = p - s;
+  ssize_t len = armor64span (s);
+  const u_char *p = s + len;
 
   switch (len & 3) {
   case 0:
@@ -307,40 +422,209 @@ dearmor64len (const char *_s)
   return -1;
 }
 
+/* validates and converts in the one pass: whole groups go to the
+   kernel, and the group that stops it is either another whole group,
+   done here, or the end of the string and its padding */
 ssize_t
 dearmor64 (void *out, const char *_s)
 {
+  const armor64_ops *impl = ARMOR64_IMPL;
   const u_char *s = (const u_char *) _s;
-  ssize_t outlen = dearmor64len (_s);
-  ssize_t len = ((outlen + 2) / 3) * 4;
-  char *d = out;
+  u_char *d = out;
   int c0, c1, c2, c3;
-  const u_char *e;
-
-  if (outlen < 0)
-    return -1;
-  if (len <= 0)
-    return len;
-
-  for (e = s + len - 4; s < e; s += 4, d += 3) {
-    c0 = a2b64[s[0]];
-    c1 = a2b64[s[1]];
+  size_t n;
+
+  for (;;) {
+    n = impl->decode (d, s, armor_readable (s));
+    s += 4 * n;
+    d += 3 * n;
+    if ((c0 = a2b64[s[0]]) < 0)
+      return d - (u_char *) out;
+    if ((c1 = a2b64[s[1]]) < 0)
+      return -1;
+    if ((c2 = a2b64[s[2]]) < 0) {
+      if (s[2] != '=' || s[3] != '=')
+	return -1;
+      *d++ = c0 << 2 | c1 >> 4;
+      return d - (u_char *) out;
+    }
+    if ((c3 = a2b64[s[3]]) < 0) {
+      if (s[3] != '=')
+	return -1;
+      *d++ = c0 << 2 | c1 >> 4;
+      *d++ = c1 << 4 | c2 >> 2;
+      return d - (u_char *) out;
+    }
     d[0] = c0 << 2 | c1 >> 4;
-    c2 = a2b64[s[2]];
     d[1] = c1 << 4 | c2 >> 2;
-    c3 = a2b64[s[3]];
     d[2] = c2 << 6 | c3;
+    s += 4;
+    d += 3;
   }
+}
+
+/* the streaming encoder first encodes a run of whole lines here, in
+   one call to the kernel, then copies it out a line at a time */
+enum { armor64_runlines = 48 };
+
+void
+armor64_encinit (armor64_enc *ae)
+{
+  ae->ncarry = 0;
+  ae->col = 0;
+}
+
+size_t
+armor64_encmax (size_t len)
+{
+  size_t chars = (len + 2) / 3 * 4;
+  return chars + chars / armor64_linelen + 1;
+}
 
-  c0 = a2b64[s[0]];
-  c1 = a2b64[s[1]];
-  *d++ = c0 << 2 | c1 >> 4;
-  if ((c2 = a2b64[s[2]]) >= 0) {
-    *d++ = c1 << 4 | c2 >> 2;
-    if ((c3 = a2b64[s[3]]) >= 0)
-      *d++ = c2 << 6 | c3;
+/* encodes ngroups whole groups from p onto the lines at d */
+static char *
+armor64_encgroups (armor64_enc *ae, char *d, const u_char *p, size_t ngroups)
+{
+  const armor64_ops *impl = ARMOR64_IMPL;
+  char run[armor64_runlines * armor64_linelen];
+  size_t n, k, room;
+
+  while (ngroups) {
+    n = sizeof (run) / 4 < ngroups ? sizeof (run) / 4 : ngroups;
+    k = impl->encode (run, p, n);
+    portable_encode (run + 4 * k, p + 3 * k, n - k);
+    p += 3 * n;
+    ngroups -= n;
+    for (k = 0; k < 4 * n; k += room) {
+      room = armor64_linelen - ae->col;
+      if (room > 4 * n - k)
+	room = 4 * n - k;
+      memcpy (d, run + k, room);
+      d += room;
+      if ((ae->col += room) == armor64_linelen) {
+	*d++ = '\n';
+	ae->col = 0;
+      }
+    }
   }
+  return d;
+}
 
-  /*  *d = '\0'; */
-  return outlen;
+size_t
+armor64_encupdate (armor64_enc *ae, char *out, const void *in, size_t len)
+{
+  const u_char *p = in;
+  char *d = out;
+
+  if (ae->ncarry) {
+    while (ae->ncarry < 3 && len) {
+      ae->carry[ae->ncarry++] = *p++;
+      len--;
+    }
+    if (ae->ncarry < 3)
+      return 0;
+    d = armor64_encgroups (ae, d, ae->carry, 1);
+    ae->ncarry = 0;
+  }
+  d = armor64_encgroups (ae, d, p, len / 3);
+  p += len - len % 3;
+  ae->ncarry = len % 3;
+  memcpy (ae->carry, p, ae->ncarry);
+  return d - out;
+}
+
+size_t
+armor64_encfinal (armor64_enc *ae, char *out)
+{
+  char *d = out;
+  const u_char *p = ae->carry;
+
+  if (ae->ncarry) {
+    d[0] = b2a64[p[0] >> 2];
+    if (ae->ncarry == 1) {
+      d[1] = b2a64[(p[0] & 0x3) << 4];
+      d[2] = '=';
+    }
+    else {
+      d[1] = b2a64[(p[0] & 0x3) << 4 | p[1] >> 4];
+      d[2] = b2a64[(p[1] & 0xf) << 2];
+    }
+    d[3] = '=';
+    d += 4;
+    ae->col += 4;
+  }
+  if (ae->col)
+    *d++ = '\n';
+  bzero (ae, sizeof (*ae));
+  return d - out;
+}
+
+void
+armor64_decinit (armor64_dec *ad)
+{
+  ad->ncarry = 0;
+  ad->end = 0;
+  ad->padleft = 0;
+}
+
+ssize_t
+armor64_decupdate (armor64_dec *ad, void *out, const char *in, size_t len)
+{
+  const armor64_ops *impl = ARMOR64_IMPL;
+  const u_char *s = (const u_char *) in;
+  u_char *d = out, *c = ad->carry;
+  size_t n;
+  int v;
+
+  while (len) {
+    if (!ad->ncarry && !ad->end) {
+      n = impl->decode (d, s, len);
+      n += portable_decode (d + 3 * n, s + 4 * n, len - 4 * n);
+      s += 4 * n;
+      d += 3 * n;
+      if (!(len -= 4 * n))
+	break;
+    }
+    len--;
+    switch (*s) {
+    case '\n': case '\r': case ' ': case '\t':
+      s++;
+      continue;
+    case '=':
+      s++;
+      if (ad->end) {
+	if (!ad->padleft--)
+	  return -1;
+	continue;
+      }
+      if (ad->ncarry < 2)
+	return -1;
+      *d++ = c[0] << 2 | c[1] >> 4;
+      if (ad->ncarry == 3)
+	*d++ = c[1] << 4 | c[2] >> 2;
+      ad->padleft = 3 - ad->ncarry;
+      ad->ncarry = 0;
+      ad->end = 1;
+      continue;
+    }
+    if ((v = a2b64[*s++]) < 0 || ad->end)
+      return -1;
+    c[ad->ncarry++] = v;
+    if (ad->ncarry == 4) {
+      d[0] = c[0] << 2 | c[1] >> 4;
+      d[1] = c[1] << 4 | c[2] >> 2;
+      d[2] = c[2] << 6 | c[3];
+      d += 3;
+      ad->ncarry = 0;
+    }
+  }
+  return d - (u_char *) out;
+}
+
+int
+armor64_decfinal (armor64_dec *ad)
+{
+  int ok = !ad->ncarry && !ad->padleft;
+  bzero (ad, sizeof (*ad));
+  return ok ? 0 : -1;
 }
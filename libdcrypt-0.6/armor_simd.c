@@ -0,0 +1,241 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+/*
+ * Base64 kernels for armor64 and dearmor64, after the SSSE3 methods
+ * of Wojciech Mula.  Decoding validates and translates a vector of
+ * characters with nibble lookups through pshufb, then packs each group
+ * of four 6-bit values into three bytes with pmaddubsw and pmaddwd;
+ * encoding runs the same steps backwards.  Each kernel does whole
+ * vectors only and leaves whatever is left over to armor.c.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_ARMORSIMD
+
+#include <immintrin.h>
+
+/* the tables, each as the bytes of one 128-bit lane */
+#define LANE(...) __VA_ARGS__
+#define LUT_LO LANE (0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,	\
+		     0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a)
+#define LUT_HI LANE (0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,	\
+		     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10)
+#define LUT_ROLL LANE (0, 16, 19, 4, -65, -65, -71, -71,		\
+		       0, 0, 0, 0, 0, 0, 0, 0)
+#define PACK LANE (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+#define SPREAD LANE (1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10)
+#define LUT_ASCII LANE ('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+			'0' - 52, '+' - 62, '/' - 63, 'A', 0, 0)
+
+/* The steps, for either vector width: W is the intrinsic prefix, _mm
+   or _mm256, S the suffix of the whole-register operations, si128 or
+   si256, and SET a constructor from one lane's bytes.
+
+   CHECK leaves a nonzero byte wherever v holds something other than a
+   base64 character: lut_lo and lut_hi, indexed by the low and high
+   nibbles, have a bit in common exactly there.  VALUES turns base64
+   characters into their 6-bit values by adding an offset chosen by
+   the high nibble, '/' being the one character its nibble does not
+   settle.  GROUPS packs each four values into three big-endian bytes
+   at the bottom of their 32-bit word.  INDICES and ASCII undo GROUPS
+   and VALUES for encoding, on input bytes spread so that each 32-bit
+   word holds one group. */
+#define CHECK_CONSTS(T, W, SET)						\
+  const T lut_lo = SET (LUT_LO);					\
+  const T lut_hi = SET (LUT_HI);					\
+  const T nib = W##_set1_epi8 (0x0f)
+#define CHECK(W, S, v)							\
+  W##_and_##S (W##_shuffle_epi8 (lut_lo, W##_and_##S (v, nib)),	\
+	       W##_shuffle_epi8 (lut_hi,					\
+				 W##_and_##S (W##_srli_epi32 (v, 4), nib)))
+#define BADMASK(W, S, v)						\
+  W##_movemask_epi8 (W##_cmpgt_epi8 (CHECK (W, S, v), W##_setzero_##S ()))
+
+#define DECODE_CONSTS(T, W, SET)					\
+  CHECK_CONSTS (T, W, SET);						\
+  const T lut_roll = SET (LUT_ROLL);					\
+  const T pack = SET (PACK);						\
+  const T slash = W##_set1_epi8 ('/');					\
+  const T mul1 = W##_set1_epi32 (0x01400140);				\
+  const T mul2 = W##_set1_epi32 (0x00011000)
+#define VALUES(W, S, v)							\
+  W##_add_epi8 (v, W##_shuffle_epi8 (lut_roll,				\
+    W##_add_epi8 (W##_cmpeq_epi8 (v, slash),				\
+		  W##_and_##S (W##_srli_epi32 (v, 4), nib))))
+#define GROUPS(W, v)							\
+  W##_shuffle_epi8 (W##_madd_epi16 (W##_maddubs_epi16 (v, mul1), mul2), pack)
+
+#define ENCODE_CONSTS(T, W, SET)					\
+  const T spread = SET (SPREAD);					\
+  const T ascii = SET (LUT_ASCII);					\
+  const T msk1 = W##_set1_epi32 (0x0fc0fc00);				\
+  const T shf1 = W##_set1_epi32 (0x04000040);				\
+  const T msk2 = W##_set1_epi32 (0x003f03f0);				\
+  const T shf2 = W##_set1_epi32 (0x01000010)
+#define INDICES(W, S, v)						\
+  W##_or_##S (W##_mulhi_epu16 (W##_and_##S (v, msk1), shf1),		\
+	      W##_mullo_epi16 (W##_and_##S (v, msk2), shf2))
+#define ASCII(W, S, i)							\
+  W##_add_epi8 (i, W##_shuffle_epi8 (ascii,				\
+    W##_or_##S (W##_subs_epu8 (i, W##_set1_epi8 (51)),			\
+		W##_and_##S (W##_cmpgt_epi8 (W##_set1_epi8 (26), i),	\
+			     W##_set1_epi8 (13)))))
+
+#pragma GCC push_options
+#pragma GCC target ("ssse3")
+
+#define SET128(x) _mm_setr_epi8 (x)
+
+static size_t
+ssse3_encode (char *out, const u_char *in, size_t ngroups)
+{
+  ENCODE_CONSTS (__m128i, _mm, SET128);
+  __m128i v;
+  size_t n;
+
+  /* four groups at a time, from 16-byte loads */
+  for (n = 0; ngroups - n >= 6; n += 4, in += 12, out += 16) {
+    v = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) in), spread);
+    v = INDICES (_mm, si128, v);
+    _mm_storeu_si128 ((__m128i *) out, ASCII (_mm, si128, v));
+  }
+  return n;
+}
+
+static size_t
+ssse3_decode (u_char *out, const u_char *in, size_t len)
+{
+  DECODE_CONSTS (__m128i, _mm, SET128);
+  __m128i v;
+  u_int32_t w;
+  size_t n;
+
+  for (n = 0; len >= 16; len -= 16, in += 16, out += 12, n += 4) {
+    v = _mm_loadu_si128 ((const __m128i *) in);
+    if (BADMASK (_mm, si128, v))
+      break;
+    v = GROUPS (_mm, VALUES (_mm, si128, v));
+    _mm_storel_epi64 ((__m128i *) out, v);
+    w = _mm_cvtsi128_si32 (_mm_srli_si128 (v, 8));
+    memcpy (out + 8, &w, 4);
+  }
+  return n;
+}
+
+static size_t
+ssse3_span (const u_char *in, size_t len)
+{
+  CHECK_CONSTS (__m128i, _mm, SET128);
+  size_t n;
+  int bad;
+
+  for (n = 0; len - n >= 16; n += 16)
+    if ((bad = BADMASK (_mm, si128,
+			_mm_loadu_si128 ((const __m128i *) (in + n)))))
+      return n + __builtin_ctz (bad);
+  return n;
+}
+
+#pragma GCC pop_options
+
+static int
+ssse3_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("ssse3");
+}
+
+const armor64_ops armor64_ssse3 = {
+  "ssse3", ssse3_probe, ssse3_encode, ssse3_decode, ssse3_span
+};
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+
+#define SET256(x) _mm256_setr_epi8 (x, x)
+
+static size_t
+avx2_encode (char *out, const u_char *in, size_t ngroups)
+{
+  ENCODE_CONSTS (__m256i, _mm256, SET256);
+  __m256i v;
+  size_t n;
+
+  /* eight groups at a time, each lane loading 16 bytes to use 12 */
+  for (n = 0; ngroups - n >= 10; n += 8, in += 24, out += 32) {
+    v = _mm256_inserti128_si256
+      (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) in)),
+       _mm_loadu_si128 ((const __m128i *) (in + 12)), 1);
+    v = INDICES (_mm256, si256, _mm256_shuffle_epi8 (v, spread));
+    _mm256_storeu_si256 ((__m256i *) out, ASCII (_mm256, si256, v));
+  }
+  return n;
+}
+
+static size_t
+avx2_decode (u_char *out, const u_char *in, size_t len)
+{
+  DECODE_CONSTS (__m256i, _mm256, SET256);
+  /* brings the twelve bytes of each lane together */
+  const __m256i join = _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 3, 7);
+  __m256i v;
+  size_t n;
+
+  for (n = 0; len >= 32; len -= 32, in += 32, out += 24, n += 8) {
+    v = _mm256_loadu_si256 ((const __m256i *) in);
+    if (BADMASK (_mm256, si256, v))
+      break;
+    v = GROUPS (_mm256, VALUES (_mm256, si256, v));
+    v = _mm256_permutevar8x32_epi32 (v, join);
+    _mm_storeu_si128 ((__m128i *) out, _mm256_castsi256_si128 (v));
+    _mm_storel_epi64 ((__m128i *) (out + 16), _mm256_extracti128_si256 (v, 1));
+  }
+  return n;
+}
+
+static size_t
+avx2_span (const u_char *in, size_t len)
+{
+  CHECK_CONSTS (__m256i, _mm256, SET256);
+  size_t n;
+  u_int32_t bad;
+
+  for (n = 0; len - n >= 32; n += 32)
+    if ((bad = BADMASK (_mm256, si256,
+			_mm256_loadu_si256 ((const __m256i *) (in + n)))))
+      return n + __builtin_ctz (bad);
+  return n;
+}
+
+#pragma GCC pop_options
+
+static int
+avx2_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+}
+
+const armor64_ops armor64_avx2 = {
+  "avx2", avx2_probe, avx2_encode, avx2_decode, avx2_span
+};
+
+#endif /* DC_HAVE_ARMORSIMD */
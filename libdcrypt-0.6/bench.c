@@ -0,0 +1,1127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "dcinternal.h"
+
+/* Simple throughput benchmarks for libdcrypt.
+   Usage: bench [-t nthreads] [test ...]; without tests runs every test.
+   nthreads (default: twice the number of CPUs) is used by the
+   multi-threaded tests. */
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+# include <x86intrin.h>
+# define HAVE_RDTSC 1
+#endif /* gcc && x86 */
+
+#define BENCH_BUFSIZE (64 * 1024)
+#define BENCH_REPS 5		/* report the best of this many runs */
+
+static u_char benchbuf[BENCH_BUFSIZE + 64];
+static int bench_nthreads;
+
+struct bench_timer {
+  struct timeval tv;
+  u_int64_t tsc;
+  double secs;			/* best run so far */
+  double cycles;
+};
+
+static u_int64_t
+cycles_now (void)
+{
+#ifdef HAVE_RDTSC
+  return __rdtsc ();
+#else /* !HAVE_RDTSC */
+  return 0;
+#endif /* !HAVE_RDTSC */
+}
+
+static void
+timer_init (struct bench_timer *t)
+{
+  t->secs = 0;
+  t->cycles = 0;
+}
+
+static void
+timer_start (struct bench_timer *t)
+{
+  gettimeofday (&t->tv, NULL);
+  t->tsc = cycles_now ();
+}
+
+static void
+timer_stop (struct bench_timer *t)
+{
+  struct timeval now;
+  double secs, cycles;
+
+  cycles = (double) (cycles_now () - t->tsc);
+  gettimeofday (&now, NULL);
+  secs = (now.tv_sec - t->tv.tv_sec) + (now.tv_usec - t->tv.tv_usec) / 1e6;
+  if (!t->secs || secs < t->secs) {
+    t->secs = secs;
+    t->cycles = cycles;
+  }
+}
+
+/* Runs stmt BENCH_REPS times, keeping the fastest run in timer t */
+#define BENCH_RUN(t, stmt)				\
+do {							\
+  int _r;						\
+  timer_init (t);					\
+  for (_r = 0; _r < BENCH_REPS; _r++) {			\
+    timer_start (t);					\
+    stmt;						\
+    timer_stop (t);					\
+  }							\
+} while (0)
+
+/* prints bytes/sec and (where a cycle counter exists) cycles/byte */
+static void
+timer_report (const struct bench_timer *t, const char *what, double bytes)
+{
+  if (t->cycles)
+    printf ("  %-32s %10.1f MB/s %8.2f cycles/byte\n", what,
+	    bytes / t->secs / 1e6, t->cycles / bytes);
+  else
+    printf ("  %-32s %10.1f MB/s\n", what, bytes / t->secs / 1e6);
+}
+
+/* prints the cost of one operation */
+static void
+timer_report_op (const struct bench_timer *t, const char *what, double ops)
+{
+  if (t->cycles)
+    printf ("  %-32s %10.1f ns/op %8.0f cycles/op\n", what,
+	    t->secs / ops * 1e9, t->cycles / ops);
+  else
+    printf ("  %-32s %10.1f ns/op\n", what, t->secs / ops * 1e9);
+}
+
+static void
+aes_encrypt_buf (const aes_ctx *aes, u_char *buf, size_t len)
+{
+  u_char *p;
+  for (p = buf; p < buf + len; p += aes_blocklen)
+    aes_encrypt (aes, p, p);
+}
+
+static void
+aes_decrypt_buf (const aes_ctx *aes, u_char *buf, size_t len)
+{
+  u_char *p;
+  for (p = buf; p < buf + len; p += aes_blocklen)
+    aes_decrypt (aes, p, p);
+}
+
+static void
+bench_aes (void)
+{
+  const aes_bulkops **bp;
+  struct bench_timer t;
+  char what[64];
+  u_char key[32], ctr[16];
+  aes_ctx aes;
+  size_t i, n;
+  int k;
+
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i;
+  bzero (ctr, sizeof (ctr));
+
+  for (k = 16; k <= 32; k += 8) {
+    printf ("AES-%d:\n", 8 * k);
+
+    n = 200000;
+    BENCH_RUN (&t, for (i = 0; i < n; i++) {
+	key[0] = i;
+	aes_setkey (&aes, key, k);
+      });
+    timer_report_op (&t, "aes_setkey", n);
+
+    n = 16;
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 aes_encrypt_buf (&aes, benchbuf, BENCH_BUFSIZE));
+    timer_report (&t, "aes_encrypt", (double) n * BENCH_BUFSIZE);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 aes_decrypt_buf (&aes, benchbuf, BENCH_BUFSIZE));
+    timer_report (&t, "aes_decrypt", (double) n * BENCH_BUFSIZE);
+
+    for (bp = aes_bulkconf; *bp; bp++) {
+      if (aes_setbackend ((*bp)->name) == -1)
+	continue;
+      n = (*bp)->probe ? 256 : 16;
+      BENCH_RUN (&t, for (i = 0; i < n; i++)
+		   aes_ctr_xor (&aes, benchbuf, benchbuf, BENCH_BUFSIZE, ctr));
+      sprintf (what, "aes_ctr_xor (%s)", (*bp)->name);
+      timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+    }
+    aes_setbackend (aes_bulkconf[0]->name);
+  }
+  aes_clrkey (&aes);
+}
+
+/* n CBC-MAC chains of BENCH_BUFSIZE / aes_mkeys_max bytes each, one
+   chain at a time and stepped together through aes_mcbcmac */
+static void
+bench_aesmulti (void)
+{
+  static const int nkeys[] = { 1, 2, 4, 8 };
+  const size_t len = BENCH_BUFSIZE / aes_mkeys_max;
+  const aes_bulkops **bp;
+  struct bench_timer t;
+  aes_ectx keys[aes_mkeys_max];
+  const aes_ectx *kp[aes_mkeys_max];
+  const void *msgs[aes_mkeys_max];
+  u_char key[16], macs[aes_mkeys_max][16];
+  char what[64];
+  aes_mkey mk;
+  size_t i, j, nrep;
+  int k, m, n;
+
+  printf ("AES-128 multi-key CBC-MAC (%d-byte messages):\n", (int) len);
+  for (k = 0; k < aes_mkeys_max; k++) {
+    for (i = 0; i < sizeof (key); i++)
+      key[i] = k + i;
+    aes_esetkey (&keys[k], key, sizeof (key));
+    kp[k] = &keys[k];
+    msgs[k] = benchbuf + k * len;
+  }
+  bzero (macs, sizeof (macs));
+
+  for (m = 0; m < (int) (sizeof (nkeys) / sizeof (nkeys[0])); m++) {
+    n = nkeys[m];
+    nrep = 64 * aes_mkeys_max / n;
+    BENCH_RUN (&t, for (i = 0; i < nrep; i++)
+		 for (k = 0; k < n; k++)
+		   for (j = 0; j < len; j += aes_blocklen) {
+		     int b;
+		     for (b = 0; b < aes_blocklen; b++)
+		       macs[k][b] ^= benchbuf[k * len + j + b];
+		     aes_eencrypt (&keys[k], macs[k], macs[k]);
+		   });
+    sprintf (what, "%d x aes_eencrypt chain", n);
+    timer_report (&t, what, (double) nrep * n * len);
+
+    aes_msetkey (&mk, kp, n);
+    for (bp = aes_bulkconf; *bp; bp++) {
+      if (aes_setbackend ((*bp)->name) == -1)
+	continue;
+      BENCH_RUN (&t, for (i = 0; i < nrep; i++)
+		   aes_mcbcmac (&mk, macs, msgs, len / aes_blocklen));
+      sprintf (what, "%d x aes_mcbcmac (%s)", n, (*bp)->name);
+      timer_report (&t, what, (double) nrep * n * len);
+    }
+    aes_setbackend (aes_bulkconf[0]->name);
+  }
+  aes_mclrkey (&mk);
+  for (k = 0; k < aes_mkeys_max; k++)
+    aes_eclrkey (&keys[k]);
+}
+
+/*
+ * Each thread alternates between encrypting a 4 KiB chunk and walking
+ * its own 256 KiB working set, standing in for the application code
+ * that shares the core's caches with AES on a busy server.
+ */
+#define AESTHR_CHUNK 4096
+#define AESTHR_WSET (256 * 1024)
+#define AESTHR_ITERS 256
+
+struct aesthr_arg {
+  const aes_ctx *aes;
+  u_char *wset;
+};
+
+static void *
+aesthr_run (void *_arg)
+{
+  struct aesthr_arg *arg = _arg;
+  u_char buf[AESTHR_CHUNK];
+  size_t i, j;
+
+  memcpy (buf, benchbuf, sizeof (buf));
+  for (i = 0; i < AESTHR_ITERS; i++) {
+    aes_ecb_encrypt (arg->aes, buf, buf, sizeof (buf) / aes_blocklen);
+    for (j = 0; j < AESTHR_WSET; j += 64)
+      arg->wset[j]++;
+  }
+  return NULL;
+}
+
+static void
+bench_aesthreads (void)
+{
+  const aes_bulkops **bp;
+  pthread_t *tids;
+  struct aesthr_arg *args;
+  struct timeval start, now;
+  double wall, total;
+  u_char key[16];
+  aes_ctx aes;
+  int i, n = bench_nthreads, ncpu;
+
+  ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1 || ncpu > n)
+    ncpu = n;
+  printf ("AES-128 ECB, %d threads on %d CPUs, %d KiB working set each:\n",
+	  n, ncpu, AESTHR_WSET / 1024);
+  bzero (key, sizeof (key));
+  aes_setkey (&aes, key, sizeof (key));
+  tids = xmalloc (n * sizeof (*tids));
+  args = xmalloc (n * sizeof (*args));
+  for (i = 0; i < n; i++) {
+    args[i].aes = &aes;
+    args[i].wset = xmalloc (AESTHR_WSET);
+    bzero (args[i].wset, AESTHR_WSET);
+  }
+
+  for (bp = aes_bulkconf; *bp; bp++) {
+    if (aes_setbackend ((*bp)->name) == -1)
+      continue;
+    gettimeofday (&start, NULL);
+    for (i = 0; i < n; i++)
+      if (pthread_create (&tids[i], NULL, aesthr_run, &args[i])) {
+	perror ("pthread_create");
+	exit (1);
+      }
+    for (i = 0; i < n; i++)
+      pthread_join (tids[i], NULL);
+    gettimeofday (&now, NULL);
+    wall = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+    total = (double) n * AESTHR_ITERS * AESTHR_CHUNK / wall;
+    printf ("  %-10s %10.1f MB/s total %10.1f MB/s per core\n",
+	    (*bp)->name, total / 1e6, total / ncpu / 1e6);
+  }
+  aes_setbackend (aes_bulkconf[0]->name);
+
+  for (i = 0; i < n; i++)
+    xfree (args[i].wset);
+  xfree (args);
+  xfree (tids);
+  aes_clrkey (&aes);
+}
+
+/* keeps the compiler from discarding benchmark loops */
+static volatile u_int64_t bench_sink;
+
+/*
+ * Key schedule cache: a hit against expanding the key afresh, then
+ * several threads looking up keys from a population twice the size of
+ * the cache, half of them from a hot set that fits.
+ */
+#define AESCACHE_BUDGET (1024 * 1024)
+#define AESCACHE_KEYS 8192
+#define AESCACHE_ITERS (256 * 1024)
+
+struct aescache_arg {
+  aes_cache *c;
+  const u_char *keys;
+  u_int32_t seed;
+};
+
+static void *
+aescache_run (void *_arg)
+{
+  struct aescache_arg *arg = _arg;
+  u_int32_t x = arg->seed, k;
+  aes_ctx aes;
+  u_char buf[16];
+  size_t i;
+
+  bzero (buf, sizeof (buf));
+  for (i = 0; i < AESCACHE_ITERS; i++) {
+    x = x * 1664525 + 1013904223;
+    k = (x >> 8) % (x & 1 ? AESCACHE_KEYS : AESCACHE_KEYS / 8);
+    aes_cache_get (arg->c, &aes, arg->keys + 16 * k, 16);
+    aes_encrypt (&aes, buf, buf);
+  }
+  aes_clrkey (&aes);
+  return NULL;
+}
+
+static void
+bench_aescache (void)
+{
+  struct bench_timer t;
+  struct aescache_arg *args;
+  pthread_t *tids;
+  aes_cache_stat st;
+  aes_cache *c;
+  u_char *keys;
+  aes_ctx aes;
+  const size_t n = 1024;
+  size_t i, j;
+  int nt = bench_nthreads;
+
+  keys = xmalloc (16 * AESCACHE_KEYS);
+  prng_getbytes (keys, 16 * AESCACHE_KEYS);
+  c = aes_cache_alloc (AESCACHE_BUDGET);
+  aes_cache_stats (c, &st);
+  printf ("AES key schedule cache, %d KiB budget, %lu entries:\n",
+	  AESCACHE_BUDGET / 1024, (unsigned long) st.capacity);
+
+  BENCH_RUN (&t, for (j = 0; j < 64; j++)
+	       for (i = 0; i < n; i++)
+		 aes_setkey (&aes, keys + 16 * i, 16));
+  timer_report_op (&t, "aes_setkey (AES-128)", 64.0 * n);
+  BENCH_RUN (&t, for (j = 0; j < 64; j++)
+	       for (i = 0; i < n; i++)
+		 aes_cache_get (c, &aes, keys + 16 * i, 16));
+  timer_report_op (&t, "aes_cache_get hit", 64.0 * n);
+  aes_cache_free (c);
+
+  c = aes_cache_alloc (AESCACHE_BUDGET);
+  tids = xmalloc (nt * sizeof (*tids));
+  args = xmalloc (nt * sizeof (*args));
+  timer_init (&t);
+  timer_start (&t);
+  for (i = 0; i < (size_t) nt; i++) {
+    args[i].c = c;
+    args[i].keys = keys;
+    args[i].seed = i + 1;
+    if (pthread_create (&tids[i], NULL, aescache_run, &args[i])) {
+      perror ("pthread_create");
+      exit (1);
+    }
+  }
+  for (i = 0; i < (size_t) nt; i++)
+    pthread_join (tids[i], NULL);
+  timer_stop (&t);
+  aes_cache_stats (c, &st);
+  timer_report_op (&t, "lookups", (double) nt * AESCACHE_ITERS);
+  printf ("  %d threads, %d keys: %.1f%% hits, %lu evictions\n", nt,
+	  AESCACHE_KEYS, 100.0 * st.hits / (st.hits + st.misses),
+	  (unsigned long) st.evictions);
+
+  aes_cache_free (c);
+  xfree (args);
+  xfree (tids);
+  xfree (keys);
+  aes_clrkey (&aes);
+}
+
+static void
+bench_byteorder (void)
+{
+  struct bench_timer t;
+  const size_t n = 64;
+  u_int64_t sum;
+  size_t i, j;
+
+  printf ("byte order:\n");
+
+  BENCH_RUN (&t, for (sum = i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 4)
+		 sum += getint (benchbuf + j));
+  bench_sink = sum;
+  timer_report (&t, "getint", (double) n * BENCH_BUFSIZE);
+  BENCH_RUN (&t, for (sum = i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 4)
+		 sum += get32be (benchbuf + j));
+  bench_sink = sum;
+  timer_report (&t, "get32be", (double) n * BENCH_BUFSIZE);
+
+  BENCH_RUN (&t, for (i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 4)
+		 putint (benchbuf + j, j));
+  timer_report (&t, "putint", (double) n * BENCH_BUFSIZE);
+  BENCH_RUN (&t, for (i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 4)
+		 put32be (benchbuf + j, j));
+  timer_report (&t, "put32be", (double) n * BENCH_BUFSIZE);
+
+  BENCH_RUN (&t, for (sum = i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 8)
+		 sum += gethyper (benchbuf + j));
+  bench_sink = sum;
+  timer_report (&t, "gethyper", (double) n * BENCH_BUFSIZE);
+  BENCH_RUN (&t, for (sum = i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 8)
+		 sum += get64be (benchbuf + j));
+  bench_sink = sum;
+  timer_report (&t, "get64be", (double) n * BENCH_BUFSIZE);
+
+  BENCH_RUN (&t, for (i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 8)
+		 puthyper (benchbuf + j, j));
+  timer_report (&t, "puthyper", (double) n * BENCH_BUFSIZE);
+  BENCH_RUN (&t, for (i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 8)
+		 put64be (benchbuf + j, j));
+  timer_report (&t, "put64be", (double) n * BENCH_BUFSIZE);
+}
+
+static void
+bench_sha1 (void)
+{
+  struct bench_timer t;
+  sha1oracle_ctx soc;
+  const sha1_ops **sp;
+  const sha1_mbops **mp;
+  u_int32_t state[5];
+  u_char out[256], digs[sha1_mb_maxlanes][20];
+  const void *msgs[sha1_mb_maxlanes];
+  size_t lens[sha1_mb_maxlanes];
+  char what[64];
+  const size_t n = 16;
+  size_t i, k;
+
+  printf ("SHA-1:\n");
+
+  for (sp = sha1conf; *sp; sp++) {
+    if (sha1_setbackend ((*sp)->name) == -1)
+      continue;
+    sha1_newstate (state);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 sha1_blocks (state, benchbuf, BENCH_BUFSIZE / 64));
+    sprintf (what, "sha1_blocks (%s)", (*sp)->name);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 sha1_hash (out, benchbuf, BENCH_BUFSIZE));
+    sprintf (what, "sha1_hash (%s)", (*sp)->name);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+  }
+  sha1_setbackend (sha1conf[0]->name);
+
+  /* the buffer as sha1_mb_maxlanes messages, and sha1oracle with the
+     output size of a 2048-bit OAEP mask, which hashes it 13 times over */
+  for (k = 0; k < sha1_mb_maxlanes; k++) {
+    msgs[k] = benchbuf + k * (BENCH_BUFSIZE / sha1_mb_maxlanes);
+    lens[k] = BENCH_BUFSIZE / sha1_mb_maxlanes;
+  }
+  for (mp = sha1mbconf; *mp; mp++) {
+    if (sha1_mbsetbackend ((*mp)->name) == -1)
+      continue;
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 sha1_hash_many (digs, msgs, lens, sha1_mb_maxlanes));
+    sprintf (what, "sha1_hash_many (%s)", (*mp)->name);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+    BENCH_RUN (&t, for (i = 0; i < n; i++) {
+	sha1oracle_init (&soc, sizeof (out), i);
+	sha1oracle_update (&soc, benchbuf, BENCH_BUFSIZE);
+	sha1oracle_final (&soc, out);
+      });
+    sprintf (what, "sha1oracle %d-byte output (%s)", (int) sizeof (out),
+	     (*mp)->name);
+    timer_report (&t, what,
+		  (double) n * BENCH_BUFSIZE * ((sizeof (out) + 19) / 20));
+  }
+  sha1_mbsetbackend (sha1mbconf[0]->name);
+}
+
+/* SHA-256 per backend, and the two MACs the ctr tools can use: AES-128
+   CBC-MAC one block at a time, as the tools compute it, and
+   HMAC-SHA-256 */
+static void
+bench_sha256 (void)
+{
+  struct bench_timer t;
+  const sha256_ops **sp;
+  aes_ectx mac;
+  u_int32_t state[8];
+  u_char out[32], key[16], cbc[16];
+  char what[64];
+  const size_t n = 16;
+  size_t i, j;
+  int k;
+
+  printf ("SHA-256:\n");
+  for (sp = sha256conf; *sp; sp++) {
+    if (sha256_setbackend ((*sp)->name) == -1)
+      continue;
+    sha256_newstate (state);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 (*sp)->blocks (state, benchbuf, BENCH_BUFSIZE / 64));
+    sprintf (what, "compression (%s)", (*sp)->name);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 hmac_sha256 (key, sizeof (key), out, benchbuf, BENCH_BUFSIZE));
+    sprintf (what, "hmac_sha256 (%s)", (*sp)->name);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+  }
+  sha256_setbackend (sha256conf[0]->name);
+
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i;
+  aes_esetkey (&mac, key, sizeof (key));
+  bzero (cbc, sizeof (cbc));
+  BENCH_RUN (&t, for (i = 0; i < n; i++)
+	       for (j = 0; j < BENCH_BUFSIZE; j += 16) {
+		 for (k = 0; k < 16; k++)
+		   cbc[k] ^= benchbuf[j + k];
+		 aes_eencrypt (&mac, cbc, cbc);
+	       });
+  timer_report (&t, "AES-128 CBC-MAC", (double) n * BENCH_BUFSIZE);
+  aes_eclrkey (&mac);
+}
+
+/* base64 per backend, on the buffer and on a 256-byte key */
+static void
+bench_armor (void)
+{
+  static const size_t sizes[] = { BENCH_BUFSIZE / 2, 256, 0 };
+  struct bench_timer t;
+  const armor64_ops **ap;
+  char *s, what[64];
+  size_t i, n, len;
+  int k;
+
+  printf ("base64:\n");
+  for (ap = armor64conf; *ap; ap++) {
+    if (armor64_setbackend ((*ap)->name) == -1)
+      continue;
+    for (k = 0; (len = sizes[k]); k++) {
+      n = 64 * BENCH_BUFSIZE / len;
+      BENCH_RUN (&t, for (i = 0; i < n; i++)
+		   xfree (armor64 (benchbuf, len)));
+      sprintf (what, "armor64 %d bytes (%s)", (int) len, (*ap)->name);
+      timer_report (&t, what, (double) n * len);
+      s = armor64 (benchbuf, len);
+      BENCH_RUN (&t, for (i = 0; i < n; i++)
+		   dearmor64 (benchbuf + BENCH_BUFSIZE / 2, s));
+      sprintf (what, "dearmor64 %d bytes (%s)", (int) len, (*ap)->name);
+      timer_report (&t, what, (double) n * len);
+      xfree (s);
+    }
+  }
+  armor64_setbackend (armor64conf[0]->name);
+}
+
+/* HMAC of short messages under one key, as for per-record
+   authentication: from the raw key each time, and from a precomputed
+   key, which saves hashing the ipad and opad blocks */
+static void
+bench_hmac (void)
+{
+  static const size_t sizes[] = { 16, 64, 256, 1024, 0 };
+  struct bench_timer t;
+  hmac_sha1_key hk;
+  hmac_sha256_key hk256;
+  u_char out[32], key[16];
+  char what[64];
+  const size_t n = 1 << 16;
+  size_t i, len;
+  int s;
+
+  printf ("HMAC, short messages:\n");
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = i;
+  hmac_sha1_setkey (&hk, key, sizeof (key));
+  hmac_sha256_setkey (&hk256, key, sizeof (key));
+  for (s = 0; (len = sizes[s]); s++) {
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 hmac_sha1 ((char *) key, sizeof (key), out, benchbuf, len));
+    sprintf (what, "hmac_sha1 %d bytes", (int) len);
+    timer_report_op (&t, what, n);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 hmac_sha1_mac (&hk, out, benchbuf, len));
+    sprintf (what, "hmac_sha1_mac %d bytes", (int) len);
+    timer_report_op (&t, what, n);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 hmac_sha256 (key, sizeof (key), out, benchbuf, len));
+    sprintf (what, "hmac_sha256 %d bytes", (int) len);
+    timer_report_op (&t, what, n);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 hmac_sha256_mac (&hk256, out, benchbuf, len));
+    sprintf (what, "hmac_sha256_mac %d bytes", (int) len);
+    timer_report_op (&t, what, n);
+  }
+  hmac_sha1_clrkey (&hk);
+  hmac_sha256_clrkey (&hk256);
+}
+
+/* ElGamal encryption and signing with one key, whose powers of g and
+   y come from the tables the key builds on its second use, or from
+   mpz_powm */
+static void
+bench_elgamal (void)
+{
+  static const size_t sizes[] = { 1024, 2048, 0 };
+  struct bench_timer t;
+  dckey *sk, *pk;
+  char what[64], *s;
+  const int n = 32;
+  int i, fb, z;
+
+  printf ("ElGamal:\n");
+  for (z = 0; sizes[z]; z++) {
+    sk = dckeygen (DC_ELGAMAL, sizes[z], NULL);
+    s = dcexport_pub (sk);
+    pk = dcimport_pub (s);
+    xfree (s);
+    if (!sk || !pk) {
+      fprintf (stderr, "bench: cannot make a %d-bit ElGamal key\n",
+	       (int) sizes[z]);
+      exit (1);
+    }
+    for (fb = 1; fb >= 0; fb--) {
+      eg_fixedbase = fb;
+      BENCH_RUN (&t, for (i = 0; i < n; i++)
+		   xfree (dcencrypt (pk, "attack at dawn")));
+      sprintf (what, "encrypt %d bits%s", (int) sizes[z],
+	       fb ? ", tables" : "");
+      printf ("  %-32s %10.0f encryptions/s\n", what, n / t.secs);
+      BENCH_RUN (&t, for (i = 0; i < n; i++)
+		   xfree (dcsign (sk, "attack at dawn")));
+      sprintf (what, "sign %d bits%s", (int) sizes[z], fb ? ", tables" : "");
+      timer_report_op (&t, what, n);
+    }
+    eg_fixedbase = 1;
+    dcfree (sk);
+    dcfree (pk);
+  }
+}
+
+/* Rabin operations on many short messages under one key: a call per
+   message, and batches in 1 and nthreads threads, with the gain of each
+   over the calls.  The private key operations, being some 50 times
+   slower, are timed on the first RABIN_PRIVBATCH messages only. */
+#define RABIN_BATCH 4096
+#define RABIN_PRIVBATCH 256
+
+static const char *rabin_msgs[RABIN_BATCH], *rabin_sigs[RABIN_BATCH];
+static const char *rabin_ctexts[RABIN_BATCH];
+static char *rabin_out[RABIN_BATCH];
+static int rabin_res[RABIN_BATCH];
+
+enum { RABIN_ENCRYPT, RABIN_VERIFY, RABIN_DECRYPT, RABIN_SIGN };
+
+/* the operation, in nt threads, or a call at a time if nt is 0 */
+static void
+rabin_run (int op, const dckey *pk, const dckey *sk, int n, int nt)
+{
+  int i;
+
+  for (i = 0; !nt && i < n; i++)
+    switch (op) {
+    case RABIN_ENCRYPT:
+      rabin_out[i] = dcencrypt (pk, rabin_msgs[i]);
+      break;
+    case RABIN_VERIFY:
+      rabin_res[i] = dcverify (pk, rabin_msgs[i], rabin_sigs[i]);
+      break;
+    case RABIN_DECRYPT:
+      rabin_out[i] = dcdecrypt (sk, rabin_ctexts[i]);
+      break;
+    case RABIN_SIGN:
+      rabin_out[i] = dcsign (sk, rabin_msgs[i]);
+      break;
+    }
+  if (nt)
+    switch (op) {
+    case RABIN_ENCRYPT:
+      dcencrypt_batch (pk, n, rabin_msgs, rabin_out, nt);
+      break;
+    case RABIN_VERIFY:
+      dcverify_batch (pk, n, rabin_msgs, rabin_sigs, rabin_res, nt);
+      break;
+    case RABIN_DECRYPT:
+      dcdecrypt_batch (sk, n, rabin_ctexts, rabin_out, nt);
+      break;
+    case RABIN_SIGN:
+      dcsign_batch (sk, n, rabin_msgs, rabin_out, nt);
+      break;
+    }
+  if (op != RABIN_VERIFY)
+    for (i = 0; i < n; i++)
+      xfree (rabin_out[i]);
+}
+
+static void
+bench_rabin (void)
+{
+  static const size_t sizes[] = { 1024, 2048, 0 };
+  static const char *const ops[] = { "encrypt", "verify", "decrypt", "sign" };
+  static char buf[RABIN_BATCH][32];
+  struct bench_timer t;
+  dckey *sk, *pk;
+  char what[64], *s;
+  double base = 0;
+  int i, z, op, nt, n;
+
+  printf ("Rabin, batches of %d (%d for private keys):\n", RABIN_BATCH,
+	  RABIN_PRIVBATCH);
+  for (i = 0; i < RABIN_BATCH; i++) {
+    sprintf (buf[i], "file%05d sha1=%08x", i, i * 0x9e3779b9u);
+    rabin_msgs[i] = buf[i];
+  }
+  for (z = 0; sizes[z]; z++) {
+    sk = dckeygen (DC_RABIN, sizes[z], NULL);
+    s = dcexport_pub (sk);
+    pk = dcimport_pub (s);
+    xfree (s);
+    for (i = 0; i < RABIN_BATCH; i++) {
+      rabin_sigs[i] = dcsign (sk, rabin_msgs[i]);
+      rabin_ctexts[i] = dcencrypt (pk, rabin_msgs[i]);
+    }
+
+    for (op = RABIN_ENCRYPT; op <= RABIN_SIGN; op++)
+      for (nt = 0;; nt = nt ? bench_nthreads : 1) {
+	n = op < RABIN_DECRYPT ? RABIN_BATCH : RABIN_PRIVBATCH;
+	BENCH_RUN (&t, rabin_run (op, pk, sk, n, nt));
+	if (!nt) {
+	  base = t.secs;
+	  sprintf (what, "%s %d bits, a call each", ops[op], (int) sizes[z]);
+	  timer_report_op (&t, what, n);
+	  continue;
+	}
+	sprintf (what, "%s %d bits, %d thread%s", ops[op], (int) sizes[z],
+		 nt, nt == 1 ? "" : "s");
+	timer_report_op (&t, what, n);
+	printf ("  %-32s %10.2fx\n", "", base / t.secs);
+	if (nt == bench_nthreads)
+	  break;
+      }
+
+    for (i = 0; i < RABIN_BATCH; i++) {
+      xfree ((char *) rabin_sigs[i]);
+      xfree ((char *) rabin_ctexts[i]);
+    }
+    dcfree (sk);
+    dcfree (pk);
+  }
+}
+
+/* Prime generation: the primes of Rabin keys and the safe primes of
+   eg_paramgen, by testing random candidates one at a time (as before
+   prime_search) and by prime_search in 1 and nthreads threads.  Times
+   are averages, as the cost of each prime varies a lot. */
+static void
+oldprime (MP_INT *p, size_t nbits, int safe)
+{
+  mpz_t q;
+
+  mpz_init (q);
+  do {
+    random_bigint (p, nbits);
+    mpz_setbit (p, 0);
+    mpz_setbit (p, 1);
+  } while (safe ? !sprimecheck (p, q) : !primecheck (p));
+  mpz_clear (q);
+}
+
+static void
+bench_primes (void)
+{
+  static const struct {
+    size_t nbits;
+    int safe, n;
+  } runs[] = { { 512, 0, 64 }, { 1024, 0, 32 }, { 1536, 0, 8 },
+	       { 256, 1, 16 }, { 512, 1, 4 }, { 0, 0, 0 } };
+  struct bench_timer t;
+  char what[64];
+  mpz_t p;
+  int i, r, nt, dflt = prime_nthreads;
+
+  printf ("Prime generation:\n");
+  mpz_init (p);
+  for (r = 0; runs[r].nbits; r++)
+    for (nt = -1;; nt = nt < 0 ? 1 : bench_nthreads) {
+      prime_nthreads = nt;
+      timer_init (&t);
+      timer_start (&t);
+      for (i = 0; i < runs[r].n; i++)
+	if (nt < 0)
+	  oldprime (p, runs[r].nbits, runs[r].safe);
+	else {
+	  random_bigint (p, runs[r].nbits);
+	  prime_search (p, p, runs[r].safe ? 12 : 4,
+			runs[r].safe ? 11 : 3, runs[r].safe);
+	}
+      timer_stop (&t);
+      if (nt < 0)
+	sprintf (what, "%d-bit %sprime, one at a time", (int) runs[r].nbits,
+		 runs[r].safe ? "safe " : "");
+      else
+	sprintf (what, "%d-bit %sprime, sieve, %d thr", (int) runs[r].nbits,
+		 runs[r].safe ? "safe " : "", nt);
+      timer_report_op (&t, what, runs[r].n);
+      if (nt == bench_nthreads)
+	break;
+    }
+  mpz_clear (p);
+  prime_nthreads = dflt;
+}
+
+/* The public key loops with GMP's own memory functions, then with
+   mpzpool's: operations per second, and, from a shim around whichever
+   is in use, the calls to the memory functions per operation and the
+   share of the time spent in them.  mpzpool stays installed from then
+   on, so this runs after the other public key tests. */
+static void *(*shim_alloc) (size_t);
+static void *(*shim_realloc) (void *, size_t, size_t);
+static void (*shim_free) (void *, size_t);
+static int shim_timing;
+static double shim_calls, shim_cycles;
+
+static void *
+shim_allocf (size_t n)
+{
+  u_int64_t t;
+  void *p;
+
+  if (!shim_timing)
+    return shim_alloc (n);
+  t = cycles_now ();
+  p = shim_alloc (n);
+  shim_cycles += cycles_now () - t;
+  shim_calls++;
+  return p;
+}
+
+static void *
+shim_reallocf (void *ptr, size_t oldn, size_t n)
+{
+  u_int64_t t;
+  void *p;
+
+  if (!shim_timing)
+    return shim_realloc (ptr, oldn, n);
+  t = cycles_now ();
+  p = shim_realloc (ptr, oldn, n);
+  shim_cycles += cycles_now () - t;
+  shim_calls++;
+  return p;
+}
+
+static void
+shim_freef (void *ptr, size_t n)
+{
+  u_int64_t t;
+
+  if (!shim_timing) {
+    shim_free (ptr, n);
+    return;
+  }
+  t = cycles_now ();
+  shim_free (ptr, n);
+  shim_cycles += cycles_now () - t;
+  shim_calls++;
+}
+
+enum { PK_ENCRYPT, PK_SIGN, PK_VERIFY };
+
+static void
+mpzpool_run (int op, const dckey *sk, const dckey *pk, const char *sig,
+	     int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    switch (op) {
+    case PK_ENCRYPT:
+      xfree (dcencrypt (pk, "attack at dawn"));
+      break;
+    case PK_SIGN:
+      xfree (dcsign (sk, "attack at dawn"));
+      break;
+    case PK_VERIFY:
+      dcverify (pk, "attack at dawn", sig);
+      break;
+    }
+}
+
+static void
+bench_mpzpool (void)
+{
+  static const struct {
+    const char *type, *name;
+    int n[3];			/* encryptions, signatures, verifications */
+  } keys[] = { { DC_RABIN, "rabin", { 1024, 128, 4096 } },
+	       { DC_ELGAMAL, "elgamal", { 64, 64, 32 } },
+	       { NULL, NULL, { 0 } } };
+  static const char *const ops[] = { "encrypt", "sign", "verify" };
+  struct bench_timer t;
+  dckey *sk, *pk;
+  char what[64], *s, *sig;
+  double cycles;
+  int k, op, pool;
+
+  printf ("GMP memory functions, 1024-bit keys:\n");
+  mp_get_memory_functions (&shim_alloc, &shim_realloc, &shim_free);
+  mp_set_memory_functions (shim_allocf, shim_reallocf, shim_freef);
+  for (pool = 0; pool < 2; pool++) {
+    /* nothing is left from GMP's functions to be freed with mpzpool's */
+    if (pool) {
+      shim_alloc = mpzpool_alloc;
+      shim_realloc = mpzpool_realloc;
+      shim_free = mpzpool_free;
+    }
+    for (k = 0; keys[k].type; k++) {
+      sk = dckeygen (keys[k].type, 1024, NULL);
+      s = dcexport_pub (sk);
+      pk = dcimport_pub (s);
+      xfree (s);
+      sig = dcsign (sk, "attack at dawn");
+      for (op = PK_ENCRYPT; op <= PK_VERIFY; op++) {
+	BENCH_RUN (&t, mpzpool_run (op, sk, pk, sig, keys[k].n[op]));
+	cycles = t.cycles;
+	shim_calls = shim_cycles = 0;
+	shim_timing = 1;
+	mpzpool_run (op, sk, pk, sig, keys[k].n[op]);
+	shim_timing = 0;
+	sprintf (what, "%s %s, %s", keys[k].name, ops[op],
+		 pool ? "mpzpool" : "gmp");
+	printf ("  %-24s %8.0f ops/s %5.1f calls/op", what,
+		keys[k].n[op] / t.secs, shim_calls / keys[k].n[op]);
+	if (cycles && shim_calls)
+	  printf (" %5.0f cycles/call %4.1f%% allocating",
+		  shim_cycles / shim_calls, 100 * shim_cycles / cycles);
+	printf ("\n");
+      }
+      xfree (sig);
+      dcfree (sk);
+      dcfree (pk);
+    }
+  }
+}
+
+static void
+bench_prng (void)
+{
+  static const char *const gens[] = { "aesctr", "sha1", NULL };
+  const char *dflt = prng_backend ();
+  const char *const *g;
+  struct bench_timer t;
+  char what[64];
+  const size_t n = 16;
+  u_int64_t sum;
+  size_t i;
+
+  printf ("PRNG:\n");
+  for (g = gens; *g; g++) {
+    prng_setbackend (*g);
+    BENCH_RUN (&t, for (i = 0; i < n; i++)
+		 prng_getbytes (benchbuf, BENCH_BUFSIZE));
+    sprintf (what, "%s getbytes (64 KiB)", *g);
+    timer_report (&t, what, (double) n * BENCH_BUFSIZE);
+    BENCH_RUN (&t, for (sum = i = 0; i < 1024 * n; i++)
+		 sum += prng_gethyper ());
+    bench_sink = sum;
+    sprintf (what, "%s gethyper", *g);
+    timer_report_op (&t, what, 1024.0 * n);
+  }
+  prng_setbackend (dflt);
+}
+
+/* 16-byte IVs from prng_getbytes, 1, 2, 4, ... threads at a time */
+#define PRNGTHR_IVS (256 * 1024)
+
+static void *
+prngthr_run (void *_arg)
+{
+  u_char iv[16];
+  size_t i;
+
+  for (i = 0; i < PRNGTHR_IVS; i++)
+    prng_getbytes (iv, sizeof (iv));
+  return NULL;
+}
+
+static void
+bench_prngthreads (void)
+{
+  static const char *const gens[] = { "aesctr", "sha1", NULL };
+  const char *dflt = prng_backend ();
+  const char *const *g;
+  struct timeval start, now;
+  pthread_t *tids;
+  double wall;
+  int i, n;
+
+  printf ("PRNG IVs, threads sharing the global generator:\n");
+  tids = xmalloc (bench_nthreads * sizeof (*tids));
+  for (g = gens; *g; g++) {
+    prng_setbackend (*g);
+    for (n = 1;; n = 2 * n < bench_nthreads ? 2 * n : bench_nthreads) {
+      gettimeofday (&start, NULL);
+      for (i = 0; i < n; i++)
+	if (pthread_create (&tids[i], NULL, prngthr_run, NULL)) {
+	  perror ("pthread_create");
+	  exit (1);
+	}
+      for (i = 0; i < n; i++)
+	pthread_join (tids[i], NULL);
+      gettimeofday (&now, NULL);
+      wall = (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1e6;
+      printf ("  %-8s %3d threads %10.2f M IVs/s\n", *g, n,
+	      (double) n * PRNGTHR_IVS / wall / 1e6);
+      if (n == bench_nthreads)
+	break;
+    }
+  }
+  prng_setbackend (dflt);
+  xfree (tids);
+}
+
+struct bench {
+  const char *name;
+  void (*fn) (void);
+};
+
+static const struct bench benches[] = {
+  { "aes", bench_aes },
+  { "aesmulti", bench_aesmulti },
+  { "aesthreads", bench_aesthreads },
+  { "aescache", bench_aescache },
+  { "byteorder", bench_byteorder },
+  { "sha1", bench_sha1 },
+  { "sha256", bench_sha256 },
+  { "hmac", bench_hmac },
+  { "elgamal", bench_elgamal },
+  { "rabin", bench_rabin },
+  { "primes", bench_primes },
+  { "armor", bench_armor },
+  { "prng", bench_prng },
+  { "prngthreads", bench_prngthreads },
+  { "mpzpool", bench_mpzpool },
+  { NULL, NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  const struct bench *b;
+  int i, ch;
+
+  bench_nthreads = 2 * sysconf (_SC_NPROCESSORS_ONLN);
+  while ((ch = getopt (argc, argv, "t:")) != -1)
+    switch (ch) {
+    case 't':
+      bench_nthreads = atoi (optarg);
+      break;
+    default:
+      fprintf (stderr, "usage: %s [-t nthreads] [test ...]\n", argv[0]);
+      return 1;
+    }
+  if (bench_nthreads < 1)
+    bench_nthreads = 1;
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  for (i = 0; i < BENCH_BUFSIZE; i++)
+    benchbuf[i] = i;
+
+  if (argc == 1) {
+    for (b = benches; b->name; b++)
+      b->fn ();
+    return 0;
+  }
+  for (i = 1; i < argc; i++) {
+    for (b = benches; b->name && strcmp (b->name, argv[i]); b++)
+      ;
+    if (!b->name) {
+      fprintf (stderr, "%s: unknown test %s\n", argv[0], argv[i]);
+      return 1;
+    }
+    b->fn ();
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+#ifndef _DCENDIAN_H_
+#define _DCENDIAN_H_ 1
+
+/* Inline byte-order primitives for the hash and cipher inner loops.
+ * getint/putint and friends in dcmisc.c are the exported, out-of-line
+ * equivalents; these compile to a single (possibly unaligned) load or
+ * store plus a bswap where the compiler knows the host byte order, and
+ * to the portable byte-at-a-time code otherwise. */
+
+#include <string.h>
+#include <sys/types.h>
+
+#if defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)) \
+  && defined (__BYTE_ORDER__)
+# if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define DC_LITTLE_ENDIAN 1
+# elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define DC_BIG_ENDIAN 1
+# endif /* __ORDER_BIG_ENDIAN__ */
+#endif /* gcc >= 4.6 */
+
+#ifdef __GNUC__
+# define DC_INLINE static __inline__ __attribute__ ((always_inline))
+#else /* !__GNUC__ */
+# define DC_INLINE static
+#endif /* !__GNUC__ */
+
+DC_INLINE u_int32_t
+get32be (const void *_dp)
+{
+#if DC_LITTLE_ENDIAN
+  u_int32_t v;
+  memcpy (&v, _dp, sizeof (v));
+  return __builtin_bswap32 (v);
+#elif DC_BIG_ENDIAN
+  u_int32_t v;
+  memcpy (&v, _dp, sizeof (v));
+  return v;
+#else /* unknown byte order */
+  const u_char *dp = _dp;
+  return (u_int32_t) dp[0] << 24 | (u_int32_t) dp[1] << 16
+    | (u_int32_t) dp[2] << 8 | dp[3];
+#endif /* unknown byte order */
+}
+
+DC_INLINE void
+put32be (void *_dp, u_int32_t val)
+{
+#if DC_LITTLE_ENDIAN
+  val = __builtin_bswap32 (val);
+  memcpy (_dp, &val, sizeof (val));
+#elif DC_BIG_ENDIAN
+  memcpy (_dp, &val, sizeof (val));
+#else /* unknown byte order */
+  u_char *dp = _dp;
+  dp[0] = val >> 24;
+  dp[1] = val >> 16;
+  dp[2] = val >> 8;
+  dp[3] = val;
+#endif /* unknown byte order */
+}
+
+DC_INLINE u_int64_t
+get64be (const void *_dp)
+{
+#if DC_LITTLE_ENDIAN
+  u_int64_t v;
+  memcpy (&v, _dp, sizeof (v));
+  return __builtin_bswap64 (v);
+#elif DC_BIG_ENDIAN
+  u_int64_t v;
+  memcpy (&v, _dp, sizeof (v));
+  return v;
+#else /* unknown byte order */
+  const u_char *dp = _dp;
+  return (u_int64_t) get32be (dp) << 32 | get32be (dp + 4);
+#endif /* unknown byte order */
+}
+
+DC_INLINE void
+put64be (void *_dp, u_int64_t val)
+{
+#if DC_LITTLE_ENDIAN
+  val = __builtin_bswap64 (val);
+  memcpy (_dp, &val, sizeof (val));
+#elif DC_BIG_ENDIAN
+  memcpy (_dp, &val, sizeof (val));
+#else /* unknown byte order */
+  u_char *dp = _dp;
+  put32be (dp, val >> 32);
+  put32be (dp + 4, val);
+#endif /* unknown byte order */
+}
+
+DC_INLINE void
+put64le (void *_dp, u_int64_t val)
+{
+#if DC_LITTLE_ENDIAN
+  memcpy (_dp, &val, sizeof (val));
+#elif DC_BIG_ENDIAN
+  val = __builtin_bswap64 (val);
+  memcpy (_dp, &val, sizeof (val));
+#else /* unknown byte order */
+  u_char *dp = _dp;
+  int i;
+  for (i = 0; i < 8; i++, val >>= 8)
+    dp[i] = val;
+#endif /* unknown byte order */
+}
+
+#endif /* !_DCENDIAN_H_ */
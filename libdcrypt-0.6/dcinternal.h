@@ -36,6 +36,7 @@ extern "C" {
 #include <string.h>
 #include <assert.h>
 #include <sys/types.h>
+#include "dcendian.h"
 
 typedef struct pkvtbl pkvtbl;
 typedef enum keytype { PUBLIC = 61, PRIVATE = 253 } keytype;
@@ -61,28 +62,185 @@ struct pkvtbl {
   dckey *(*import_priv) (const char *asc);
 
   dckey *(*keygen) (size_t k, const char *extra);
+
+  /* optional: do as encrypt, verify, decrypt and sign would for each
+     of n items, in the calling thread; dcops.c cuts batches up between
+     threads, and loops over the single calls for the types without
+     these */
+  void (*encrypt_batch) (const dckey *key, size_t n,
+			 const char *const *msgs, char **ctexts);
+  void (*verify_batch) (const dckey *key, size_t n,
+			const char *const *msgs, const char *const *sigs,
+			int *res);
+  void (*decrypt_batch) (const dckey *key, size_t n,
+			 const char *const *ctexts, char **msgs);
+  void (*sign_batch) (const dckey *key, size_t n,
+		      const char *const *msgs, char **sigs);
 };
 
 extern const pkvtbl *dcconf[];
 
+/* aes.c */
+extern const u_int32_t *const aes_te[5];
+extern const u_int32_t *const aes_td[5];
+const u_int32_t *aes_dkey (const aes_ctx *aes);
+void aes_esetsched (aes_ectx *aes, int nrounds, const u_int32_t *e_key);
+void aes_cencrypt (const aes_ectx *aes, void *buf, const void *ibuf);
+void aes_cdecrypt (const aes_ctx *aes, void *buf, const void *ibuf);
+void aes_mcbc_ttable (const aes_mkey *mk, u_char (*state)[16],
+		      const u_char *const msgs[], size_t nblocks);
+
+/* aesbulk.c */
+typedef struct aes_bulkops aes_bulkops;
+struct aes_bulkops {
+  const char *name;
+  int (*probe) (void);		/* NULL means always available */
+
+  void (*ecb_encrypt) (const aes_ectx *aes, u_char *out, const u_char *in,
+		       size_t nblocks);
+  /* called with aes_dkey (aes) already built */
+  void (*ecb_decrypt) (const aes_ctx *aes, u_char *out, const u_char *in,
+		       size_t nblocks);
+  /* must not modify ctr; aes_ectr_xor advances it */
+  void (*ctr_xor) (const aes_ectx *aes, u_char *out, const u_char *in,
+		   size_t len, const u_char ctr[16]);
+  /* state[k] = E_k (state[k] ^ msgs[k][i]) for each of nblocks blocks;
+     with msgs NULL, encrypts each state[k] once */
+  void (*mcbc) (const aes_mkey *mk, u_char (*state)[16],
+		const u_char *const msgs[], size_t nblocks);
+};
+
+extern const aes_bulkops *aes_bulkconf[];
+extern const aes_bulkops aes_ttable;
+extern const aes_bulkops aes_compact;
+void aes_ctr_add (u_char ctr[16], u_int64_t n);
+
+/* aes_vaes.c */
+#if defined (__GNUC__) && __GNUC__ >= 8 && defined (__x86_64__)
+# define DC_HAVE_VAES 1
+extern const aes_bulkops aes_vaes512;
+extern const aes_bulkops aes_vaes256;
+#endif /* gcc >= 8 && x86_64 */
+
+/* aes_avx2.c */
+#if defined (__GNUC__) && __GNUC__ >= 5 && defined (__x86_64__)
+# define DC_HAVE_AVX2 1
+extern const aes_bulkops aes_avx2;
+#endif /* gcc >= 5 && x86_64 */
+
+/* armor.c: base64 code for runs of whole groups.  encode does as many
+   of the ngroups 3-byte groups at in as it likes, four characters
+   each, and returns how many.  decode converts four-character groups
+   from the len bytes at in while they hold nothing but base64
+   characters, and returns how many groups it converted; span counts
+   such characters.  Both may stop short of the first bad character,
+   since they only do whole vectors, and may read any of the len bytes,
+   which armor.c keeps within the page holding in. */
+struct armor64_ops {
+  const char *name;
+  int (*probe) (void);
+  size_t (*encode) (char *out, const u_char *in, size_t ngroups);
+  size_t (*decode) (u_char *out, const u_char *in, size_t len);
+  size_t (*span) (const u_char *in, size_t len);
+};
+typedef struct armor64_ops armor64_ops;
+extern const armor64_ops *armor64conf[];
+extern const armor64_ops armor64_portable;
+
+/* armor_simd.c */
+#if defined (__GNUC__) && __GNUC__ >= 5 && defined (__x86_64__)
+# define DC_HAVE_ARMORSIMD 1
+extern const armor64_ops armor64_avx2;
+extern const armor64_ops armor64_ssse3;
+#endif /* gcc >= 5 && x86_64 */
+
 /* mdblock.c */
 void mdblock_init (mdblock *mp,
-		   void (*consume) (mdblock *, const u_char block[64]));
+		   void (*consume) (mdblock *, const u_char *blocks,
+				    size_t nblocks));
 void mdblock_update (mdblock *mp, const void *bytes, size_t len);
 void mdblock_finish (mdblock *mp, int bigendian);
 
 /* sha1.c */
 void sha1_newstate (u_int32_t state[5]);
 void sha1_transform (u_int32_t state[5], const u_char block[64]);
+/* runs the compression function over nblocks consecutive blocks */
+void sha1_blocks (u_int32_t state[5], const u_char *blocks, size_t nblocks);
+/* runs the compression function on each of n independent streams,
+   states[k] over the nblocks consecutive blocks at blocks[k] */
+void sha1_mblocks (u_int32_t *const states[], const u_char *const blocks[],
+		   size_t n, size_t nblocks);
 void sha1_state2bytes (void *_cp, const u_int32_t state[5]);
 
+/* SHA-1 compression functions; sha1conf[] lists them fastest first,
+   and a NULL probe means the implementation runs everywhere.  cost is
+   roughly the cycles one call takes on one block, used to choose
+   between these and the multi-buffer code below. */
+struct sha1_ops {
+  const char *name;
+  int (*probe) (void);
+  int cost;
+  void (*blocks) (u_int32_t state[5], const u_char *blocks, size_t nblocks);
+};
+typedef struct sha1_ops sha1_ops;
+extern const sha1_ops *sha1conf[];
+extern const sha1_ops sha1_portable;
+
+/* sha1_ni.c */
+#if defined (__GNUC__) && __GNUC__ >= 5 && defined (__x86_64__)
+# define DC_HAVE_SHANI 1
+extern const sha1_ops sha1_shani;
+#endif /* gcc >= 5 && x86_64 */
+
+/* Multi-buffer compression functions, each doing a run of blocks for
+   each of exactly lanes streams; sha1mbconf[] lists them fastest first,
+   and cost is roughly the cycles one call takes per block. */
+enum { sha1_mb_maxlanes = 8 };
+struct sha1_mbops {
+  const char *name;
+  int (*probe) (void);
+  int lanes;
+  int cost;
+  void (*mblock) (u_int32_t *const states[], const u_char *const blocks[],
+		  size_t nblocks);
+};
+typedef struct sha1_mbops sha1_mbops;
+extern const sha1_mbops *sha1mbconf[];
+
+/* sha1_mb.c */
+#if defined (__GNUC__) && __GNUC__ >= 5 && defined (__x86_64__)
+# define DC_HAVE_SHA1MB 1
+extern const sha1_mbops sha1_sse2;
+extern const sha1_mbops sha1_avx2;
+#endif /* gcc >= 5 && x86_64 */
+
+/* sha256.c */
+void sha256_newstate (u_int32_t state[8]);
+extern const u_int32_t *const sha256_roundconst;
+struct sha256_ops {
+  const char *name;
+  int (*probe) (void);
+  void (*blocks) (u_int32_t state[8], const u_char *blocks, size_t nblocks);
+};
+typedef struct sha256_ops sha256_ops;
+extern const sha256_ops *sha256conf[];
+extern const sha256_ops sha256_portable;
+
+/* sha256_ni.c */
+#ifdef DC_HAVE_SHANI
+extern const sha256_ops sha256_shani;
+#endif /* DC_HAVE_SHANI */
+
 /* sha1oracle.c */
+enum { sha1oracle_inline = 4 };
 struct sha1oracle_ctx {
   mdblock mdb;
   int firstblock;
   size_t nbytes;
   size_t nstate;
   u_int32_t (*state)[5];
+  /* state for outputs of up to 80 bytes, so seeding needs no malloc */
+  u_int32_t istate[sha1oracle_inline][5];
 };
 typedef struct sha1oracle_ctx sha1oracle_ctx;
 void sha1oracle_init (sha1oracle_ctx *soc, size_t nbytes, u_int64_t idx);
@@ -96,6 +254,30 @@ void random_bigint (MP_INT *, size_t bits);
 void random_zn (MP_INT *, const MP_INT *n);
 int primecheck (const MP_INT *n);
 int sprimecheck (const MP_INT *n, MP_INT *q);
+extern int prime_nthreads;
+void prime_search (MP_INT *p, const MP_INT *start, u_long step, u_long rem,
+		   int safe);
+
+/* fbexp.c: powers of a fixed base; fbexp_powm computes base^e mod the
+   modulus given to fbexp_alloc, falling back on mpz_powm for e of more
+   than nbits bits */
+enum { fbexp_maxwin = 8 };
+struct fbexp {
+  size_t nbits;			/* largest exponent covered, in bits */
+  int w;			/* window width */
+  size_t n;			/* number of windows */
+  MP_INT *pow;			/* pow[i] = base^(2^(w*i)) mod m */
+};
+typedef struct fbexp fbexp;
+fbexp *fbexp_alloc (const MP_INT *base, const MP_INT *mod, size_t nbits);
+void fbexp_free (fbexp *fb);
+void fbexp_powm (MP_INT *r, const fbexp *fb, const MP_INT *e,
+		 const MP_INT *mod);
+
+/* mpzpool.c */
+void *mpzpool_alloc (size_t n);
+void *mpzpool_realloc (void *ptr, size_t oldn, size_t n);
+void mpzpool_free (void *ptr, size_t n);
 
 /* mpz_raw.c */
 size_t mpz_sizeinbase2 (const MP_INT *mp);
@@ -28,41 +28,25 @@
 void
 putint (void *_dp, u_int32_t val)
 {
-  u_char *dp = _dp;
-  dp[0] = val >> 24;
-  dp[1] = val >> 16;
-  dp[2] = val >> 8;
-  dp[3] = val;
+  put32be (_dp, val);
 }
 
 u_int32_t
 getint (const void *_dp)
 {
-  const u_char *dp = _dp;
-  return dp[0] << 24 | dp[1] << 16 | dp[2] << 8 | dp[3];
+  return get32be (_dp);
 }
 
 void
 puthyper (void *_dp, u_int64_t val)
 {
-  u_char *dp = _dp;
-  dp[0] = val >> 56;
-  dp[1] = val >> 48;
-  dp[2] = val >> 40;
-  dp[3] = val >> 32;
-  dp[4] = val >> 24;
-  dp[5] = val >> 16;
-  dp[6] = val >> 8;
-  dp[7] = val;
+  put64be (_dp, val);
 }
 
 u_int64_t
 gethyper (const void *_dp)
 {
-  const u_char *dp = _dp;
-  return (u_int64_t) dp[0] << 56 | (u_int64_t) dp[1] << 48
-    | (u_int64_t) dp[2] << 40 | (u_int64_t) dp[3] << 32
-    | getint (dp + 4);
+  return get64be (_dp);
 }
 
 int
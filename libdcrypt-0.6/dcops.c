@@ -21,6 +21,8 @@
  *
  */
 
+#include <pthread.h>
+#include <unistd.h>
 #include "dcinternal.h"
 
 dckey *
@@ -155,6 +157,198 @@ dcverify (const dckey *key, const char *msg, const char *sig)
   return key->vptr->verify (key, msg, sig);
 }
 
+/* Batches are run in slices, one to a thread.  Slices of fewer items
+   than this are not worth a thread of their own. */
+enum { dcbatch_minslice = 16 };
+
+struct dcbatch {
+  void (*fn) (const struct dcbatch *b);
+  const dckey *key;
+  const char *const *msgs;
+  const char *const *sigs;
+  char **out;
+  int *res;
+  size_t off, n;		/* this slice */
+};
+
+static void *
+dcbatch_thread (void *_b)
+{
+  const struct dcbatch *b = _b;
+  b->fn (b);
+  return NULL;
+}
+
+static void
+dcbatch_run (struct dcbatch *b, size_t n, int nthreads)
+{
+  struct dcbatch *sl;
+  pthread_t *tids;
+  char *started;
+  int t;
+
+  if (nthreads <= 0)
+    nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (nthreads > 1 && (size_t) nthreads > n / dcbatch_minslice)
+    nthreads = n / dcbatch_minslice;
+  if (nthreads <= 1
+      || !(sl = malloc (nthreads * (sizeof (*sl) + sizeof (*tids) + 1)))) {
+    b->off = 0;
+    b->n = n;
+    b->fn (b);
+    return;
+  }
+  tids = (pthread_t *) (sl + nthreads);
+  started = (char *) (tids + nthreads);
+
+  for (t = 0; t < nthreads; t++) {
+    sl[t] = *b;
+    sl[t].off = n * t / nthreads;
+    sl[t].n = n * (t + 1) / nthreads - sl[t].off;
+  }
+  /* the caller's thread does the first slice, and any slice whose
+     thread could not be started */
+  for (t = 1; t < nthreads; t++)
+    started[t] = !pthread_create (&tids[t], NULL, dcbatch_thread, &sl[t]);
+  b->fn (&sl[0]);
+  for (t = 1; t < nthreads; t++)
+    if (started[t])
+      pthread_join (tids[t], NULL);
+    else
+      b->fn (&sl[t]);
+  free (sl);
+}
+
+static void
+dcbatch_encrypt (const struct dcbatch *b)
+{
+  const pkvtbl *vp = b->key->vptr;
+  size_t i;
+
+  if (vp->encrypt_batch)
+    vp->encrypt_batch (b->key, b->n, b->msgs + b->off, b->out + b->off);
+  else
+    for (i = b->off; i < b->off + b->n; i++)
+      b->out[i] = vp->encrypt (b->key, b->msgs[i]);
+}
+
+size_t
+dcencrypt_batch (const dckey *key, size_t n, const char *const *msgs,
+		 char **ctexts, int nthreads)
+{
+  struct dcbatch b;
+  size_t i, bad = 0;
+
+  assert (key->type == PUBLIC || key->type == PRIVATE);
+  bzero (&b, sizeof (b));
+  b.fn = dcbatch_encrypt;
+  b.key = key;
+  b.msgs = msgs;
+  b.out = ctexts;
+  dcbatch_run (&b, n, nthreads);
+  for (i = 0; i < n; i++)
+    bad += !ctexts[i];
+  return bad;
+}
+
+static void
+dcbatch_verify (const struct dcbatch *b)
+{
+  const pkvtbl *vp = b->key->vptr;
+  size_t i;
+
+  if (vp->verify_batch)
+    vp->verify_batch (b->key, b->n, b->msgs + b->off, b->sigs + b->off,
+		      b->res + b->off);
+  else
+    for (i = b->off; i < b->off + b->n; i++)
+      b->res[i] = vp->verify (b->key, b->msgs[i], b->sigs[i]);
+}
+
+size_t
+dcverify_batch (const dckey *key, size_t n, const char *const *msgs,
+		const char *const *sigs, int *res, int nthreads)
+{
+  struct dcbatch b;
+  size_t i, bad = 0;
+
+  assert (key->type == PUBLIC || key->type == PRIVATE);
+  bzero (&b, sizeof (b));
+  b.fn = dcbatch_verify;
+  b.key = key;
+  b.msgs = msgs;
+  b.sigs = sigs;
+  b.res = res;
+  dcbatch_run (&b, n, nthreads);
+  for (i = 0; i < n; i++)
+    bad += res[i] != 0;
+  return bad;
+}
+
+static void
+dcbatch_decrypt (const struct dcbatch *b)
+{
+  const pkvtbl *vp = b->key->vptr;
+  size_t i;
+
+  if (vp->decrypt_batch)
+    vp->decrypt_batch (b->key, b->n, b->msgs + b->off, b->out + b->off);
+  else
+    for (i = b->off; i < b->off + b->n; i++)
+      b->out[i] = vp->decrypt (b->key, b->msgs[i]);
+}
+
+size_t
+dcdecrypt_batch (const dckey *key, size_t n, const char *const *ctexts,
+		 char **msgs, int nthreads)
+{
+  struct dcbatch b;
+  size_t i, bad = 0;
+
+  assert (key->type == PRIVATE);
+  bzero (&b, sizeof (b));
+  b.fn = dcbatch_decrypt;
+  b.key = key;
+  b.msgs = ctexts;
+  b.out = msgs;
+  dcbatch_run (&b, n, nthreads);
+  for (i = 0; i < n; i++)
+    bad += !msgs[i];
+  return bad;
+}
+
+static void
+dcbatch_sign (const struct dcbatch *b)
+{
+  const pkvtbl *vp = b->key->vptr;
+  size_t i;
+
+  if (vp->sign_batch)
+    vp->sign_batch (b->key, b->n, b->msgs + b->off, b->out + b->off);
+  else
+    for (i = b->off; i < b->off + b->n; i++)
+      b->out[i] = vp->sign (b->key, b->msgs[i]);
+}
+
+size_t
+dcsign_batch (const dckey *key, size_t n, const char *const *msgs,
+	      char **sigs, int nthreads)
+{
+  struct dcbatch b;
+  size_t i, bad = 0;
+
+  assert (key->type == PRIVATE);
+  bzero (&b, sizeof (b));
+  b.fn = dcbatch_sign;
+  b.key = key;
+  b.msgs = msgs;
+  b.out = sigs;
+  dcbatch_run (&b, n, nthreads);
+  for (i = 0; i < n; i++)
+    bad += !sigs[i];
+  return bad;
+}
+
 int
 dcispriv (const dckey *key)
 {
@@ -31,9 +31,23 @@ extern "C" {
 typedef struct dckey dckey;
 
 /* aes.c */
-struct aes_ctx {
+/* encryption-only key, 256 bytes on LP64 against 512 for an aes_ctx;
+   enough for CTR mode and CBC-MAC */
+struct aes_ectx {
   int nrounds;
+  /* block function unrolled for nrounds, bound by the setkey call */
+  void (*encrypt) (const struct aes_ectx *, void *, const void *);
   u_int32_t  e_key[60];
+};
+typedef struct aes_ectx aes_ectx;
+/* the decryption schedule in d_key is only built by the first
+   aes_decrypt or aes_ecb_decrypt on the key; threads may share a
+   context set up with aes_setkey and race to do so */
+struct aes_ctx {
+  aes_ectx e;
+  int d_ready;
+  /* bound for e.nrounds along with d_key */
+  void (*decrypt) (const u_int32_t *, void *, const void *);
   u_int32_t  d_key[60];
 };
 typedef struct aes_ctx aes_ctx;
@@ -42,6 +56,69 @@ void aes_setkey (aes_ctx *aes, const void *key, u_int keylen);
 void aes_clrkey (aes_ctx *aes);
 void aes_encrypt (const aes_ctx *aes, void *buf, const void *ibuf);
 void aes_decrypt (const aes_ctx *aes, void *buf, const void *ibuf);
+void aes_esetkey (aes_ectx *aes, const void *key, u_int keylen);
+void aes_eclrkey (aes_ectx *aes);
+void aes_eencrypt (const aes_ectx *aes, void *buf, const void *ibuf);
+
+/* aesbulk.c */
+void aes_ecb_encrypt (const aes_ctx *aes, void *buf, const void *ibuf,
+		      size_t nblocks);
+void aes_ecb_decrypt (const aes_ctx *aes, void *buf, const void *ibuf,
+		      size_t nblocks);
+/* XORs len bytes of keystream E(ctr), E(ctr+1), ... into buf; ctr is a
+   big-endian 128-bit counter and is left pointing past the last block
+   used (a partial final block consumes a whole counter value) */
+void aes_ctr_xor (const aes_ctx *aes, void *buf, const void *ibuf,
+		  size_t len, void *ctr);
+void aes_ectr_xor (const aes_ectx *aes, void *buf, const void *ibuf,
+		   size_t len, void *ctr);
+const char *aes_backend (void);
+/* returns 0 upon success, -1 if name is unknown or unsupported here */
+int aes_setbackend (const char *name);
+
+/* Up to aes_mkeys_max independent keys of one size, encrypted side by
+   side so that independent streams (e.g. several CBC-MAC chains) keep
+   the AES pipeline full.  Round keys are stored struct-of-arrays, so
+   round r of every key is contiguous. */
+enum { aes_mkeys_max = 8 };
+struct aes_mkey {
+  int nkeys;
+  int nrounds;
+  u_int32_t rk[15][aes_mkeys_max][4];
+};
+typedef struct aes_mkey aes_mkey;
+/* returns 0 upon success, -1 if nkeys is out of range or the keys
+   are not all the same size */
+int aes_msetkey (aes_mkey *mk, const aes_ectx *const keys[], int nkeys);
+void aes_mclrkey (aes_mkey *mk);
+/* encrypts blocks[k] under key k, in place */
+void aes_mencrypt (const aes_mkey *mk, void *blocks);
+/* advances CBC-MAC chain k (macs[k], 16 bytes) over nblocks blocks
+   starting at msgs[k] */
+void aes_mcbcmac (const aes_mkey *mk, void *macs,
+		  const void *const msgs[], size_t nblocks);
+
+/* aescache.c: a byte-bounded cache of encryption schedules keyed by
+   raw key, safe to use from several threads at once */
+typedef struct aes_cache aes_cache;
+struct aes_cache_stat {
+  u_int64_t hits;
+  u_int64_t misses;
+  u_int64_t evictions;
+  size_t entries;
+  size_t capacity;
+};
+typedef struct aes_cache_stat aes_cache_stat;
+/* returns NULL if budget bytes cannot hold a single key */
+aes_cache *aes_cache_alloc (size_t budget);
+void aes_cache_free (aes_cache *c);
+/* sets up aes for key as aes_setkey would, from the cache if it holds
+   key and by expanding and caching it otherwise; returns 1 on a hit
+   and 0 on a miss */
+int aes_cache_get (aes_cache *c, aes_ctx *aes, const void *key, u_int keylen);
+int aes_cache_eget (aes_cache *c, aes_ectx *aes, const void *key,
+		    u_int keylen);
+void aes_cache_stats (const aes_cache *c, aes_cache_stat *st);
 
 /* armor.c */
 char *armor32 (const void *dp, size_t dl);
@@ -51,7 +128,43 @@ ssize_t dearmor32 (void *out, const char *s);
 char *armor64 (const void *dp, size_t len);
 ssize_t armor64len (const char *s);
 ssize_t dearmor64len (const char *s);
+/* decodes the base64 string s into out, which must have room for
+   dearmor64len (s) bytes; returns that many, or -1 (leaving out in an
+   unknown state) if s is malformed */
 ssize_t dearmor64 (void *out, const char *s);
+/* Streaming base64, for data that comes a piece at a time.  The
+   encoder writes lines of armor64_linelen characters, each ended by a
+   newline; armor64_encupdate needs room for armor64_encmax (len)
+   characters and armor64_encfinal for 6.  The decoder skips line
+   breaks and blanks, and its functions return -1 on malformed input;
+   armor64_decupdate writes at most (len + 3) / 4 * 3 bytes. */
+enum { armor64_linelen = 64 };
+struct armor64_enc {
+  u_char carry[3];
+  int ncarry;
+  int col;
+};
+typedef struct armor64_enc armor64_enc;
+void armor64_encinit (armor64_enc *ae);
+size_t armor64_encmax (size_t len);
+size_t armor64_encupdate (armor64_enc *ae, char *out,
+			  const void *in, size_t len);
+size_t armor64_encfinal (armor64_enc *ae, char *out);
+struct armor64_dec {
+  u_char carry[4];
+  int ncarry;
+  int end;
+  int padleft;
+};
+typedef struct armor64_dec armor64_dec;
+void armor64_decinit (armor64_dec *ad);
+ssize_t armor64_decupdate (armor64_dec *ad, void *out,
+			   const char *in, size_t len);
+int armor64_decfinal (armor64_dec *ad);
+/* the base64 code in use: "avx2", "ssse3" or "portable" */
+const char *armor64_backend (void);
+/* returns 0 upon success, -1 if name is unknown or unsupported here */
+int armor64_setbackend (const char *name);
 
 /* dcmisc.c */
 void putint (void *_dp, u_int32_t val);
@@ -67,7 +180,9 @@ int read_mpz (const char **srcp, MP_INT *mp);
 /* mdblock.c */
 struct mdblock {
   u_int64_t count;
-  void (*consume) (struct mdblock *, const unsigned char block[64]);
+  /* called with a run of nblocks consecutive 64-byte blocks */
+  void (*consume) (struct mdblock *, const unsigned char *blocks,
+		   size_t nblocks);
   unsigned char buffer[64];
 };
 typedef struct mdblock mdblock;
@@ -89,9 +204,95 @@ void hmac_sha1_init (const char *key, size_t keylen, sha1_ctx *sc);
 #define hmac_sha1_update(a,b,c)    sha1_update((a),(b),(c))
 void hmac_sha1_final (const char *key, size_t keylen, sha1_ctx *sc, 
 		      u_char out[20]); 
+/* An HMAC key with the ipad and opad blocks already hashed, so that a
+   message costs no more compressions than its own blocks and one for
+   the outer hash.  hmac_sha1_start readies sc for the message and may
+   be called any number of times on one key; the key is only read, so
+   threads can share it. */
+struct hmac_sha1_key {
+  u_int32_t istate[5];
+  u_int32_t ostate[5];
+};
+typedef struct hmac_sha1_key hmac_sha1_key;
+void hmac_sha1_setkey (hmac_sha1_key *hk, const void *key, size_t keylen);
+void hmac_sha1_clrkey (hmac_sha1_key *hk);
+void hmac_sha1_start (const hmac_sha1_key *hk, sha1_ctx *sc);
+void hmac_sha1_finish (const hmac_sha1_key *hk, sha1_ctx *sc, u_char out[20]);
+void hmac_sha1_mac (const hmac_sha1_key *hk, void *out,
+		    const void *data, size_t dlen);
+/* the compression function in use: "shani" (Intel SHA extensions) when
+   the CPU has them, "portable" otherwise */
+const char *sha1_backend (void);
+/* returns 0 upon success, -1 if name is unknown or unsupported here */
+int sha1_setbackend (const char *name);
+/* hashes n independent messages at once, msgs[k] of lens[k] bytes into
+   digests + 20 * k, several to a vector register when the CPU allows */
+void sha1_hash_many (void *digests, const void *const msgs[],
+		     const size_t lens[], size_t n);
+/* the multi-buffer code sha1_hash_many and sha1oracle use: "avx2",
+   "sse2", or "none" to hash one stream at a time */
+const char *sha1_mbbackend (void);
+int sha1_mbsetbackend (const char *name);
+
+/* sha256.c */
+struct sha256_ctx {
+  mdblock mdb;
+  u_int32_t state[8];
+};
+typedef struct sha256_ctx sha256_ctx;
+enum { sha256_hashsize = 32 };
+void sha256_init (sha256_ctx *sc);
+void sha256_update (sha256_ctx *sc, const void *bytes, size_t len);
+void sha256_final (sha256_ctx *sc, u_char out[32]);
+void sha256_hash (void *digest, const void *buf, size_t len);
+void hmac_sha256 (const void *key, size_t keylen,
+		  void *out, const void *data, size_t dlen);
+void hmac_sha256_init (const void *key, size_t keylen, sha256_ctx *sc);
+#define hmac_sha256_update(a,b,c)    sha256_update((a),(b),(c))
+void hmac_sha256_final (const void *key, size_t keylen, sha256_ctx *sc,
+			u_char out[32]);
+/* precomputed keys, as for SHA-1 */
+struct hmac_sha256_key {
+  u_int32_t istate[8];
+  u_int32_t ostate[8];
+};
+typedef struct hmac_sha256_key hmac_sha256_key;
+void hmac_sha256_setkey (hmac_sha256_key *hk, const void *key, size_t keylen);
+void hmac_sha256_clrkey (hmac_sha256_key *hk);
+void hmac_sha256_start (const hmac_sha256_key *hk, sha256_ctx *sc);
+void hmac_sha256_finish (const hmac_sha256_key *hk, sha256_ctx *sc,
+			 u_char out[32]);
+void hmac_sha256_mac (const hmac_sha256_key *hk, void *out,
+		      const void *data, size_t dlen);
+/* "shani" or "portable", as for SHA-1 */
+const char *sha256_backend (void);
+int sha256_setbackend (const char *name);
 
 /* prng.c */
-/* WARNING:  The following functions are not thread-safe. */
+/* An AES-CTR generator for use by one thread at a time.  prng_ctx_init
+   seeds it from the global generator; it reseeds itself after fork. */
+enum { prng_ctx_bufsize = 512 };
+struct prng_ctx {
+  aes_ectx key;
+  u_char v[16];
+  u_int gen;
+  size_t avail;
+  u_char buf[prng_ctx_bufsize + 48];
+};
+typedef struct prng_ctx prng_ctx;
+void prng_ctx_init (prng_ctx *pc);
+void prng_ctx_seed (prng_ctx *pc, const void *buf, size_t len);
+void prng_ctx_getbytes (prng_ctx *pc, void *buf, size_t len);
+void prng_ctx_clear (prng_ctx *pc);
+
+/* The global generator.  With the "aesctr" backend (the default) each
+   thread draws from a prng_ctx of its own; the functions below are
+   thread-safe either way. */
+const char *prng_backend (void);
+/* "aesctr" or "sha1", the original generator; returns 0 upon success,
+   -1 if name is unknown.  Not to be called while other threads use the
+   generator. */
+int prng_setbackend (const char *name);
 void prng_getbytes (void *buf, size_t len);
 u_int32_t prng_getword (void);
 u_int64_t prng_gethyper (void);
@@ -113,6 +314,21 @@ char *dcdecrypt (const dckey *key, const char *msg);
 char *dcsign (const dckey *key, const char *msg);
 /* returns 0 upon success, -1 if check fails */
 int dcverify (const dckey *key, const char *msg, const char *sig);
+/* Batches of n messages under one key, cut up between nthreads threads
+   (0 for one per CPU).  dcencrypt_batch sets ctexts[i] as dcencrypt
+   would for msgs[i], NULL upon failure; dcverify_batch sets res[i] as
+   dcverify would for msgs[i] and sigs[i]; dcdecrypt_batch and
+   dcsign_batch, which need a private key, set msgs[i] and sigs[i] as
+   dcdecrypt and dcsign would, NULL upon failure.  All return the
+   number of items that failed. */
+size_t dcencrypt_batch (const dckey *key, size_t n, const char *const *msgs,
+			char **ctexts, int nthreads);
+size_t dcverify_batch (const dckey *key, size_t n, const char *const *msgs,
+		       const char *const *sigs, int *res, int nthreads);
+size_t dcdecrypt_batch (const dckey *key, size_t n,
+			const char *const *ctexts, char **msgs, int nthreads);
+size_t dcsign_batch (const dckey *key, size_t n, const char *const *msgs,
+		     char **sigs, int nthreads);
 int dcispriv (const dckey *);
 int dcareequiv (const dckey *keya, const dckey *keyb);
 
@@ -121,6 +337,18 @@ const char *eg_paramgen (size_t nbits);
 const char *eg_paramgen_new (size_t nbits);
 const char *eg_getparam_default (size_t nbits);
 extern const char *(*eg_getparam) (size_t nbits);
+/* nonzero (the default) to take powers of g and y from the tables
+   built with each key, rather than with mpz_powm */
+extern int eg_fixedbase;
+
+/* mpzpool.c: makes GMP allocate from per-thread pools, which also
+   clear every block GMP releases.  This is opt-in hardening, not a
+   speedup, and nothing in the library installs it.  It only protects
+   an application that calls it before anything is allocated with GMP,
+   as mp_set_memory_functions requires; limbs freed through GMP's
+   default functions before then are not cleared.  It cannot be
+   undone. */
+void mpzpool_install (void);
 
 #define DC_ELGAMAL "Elgamal-1"
 #define DC_RABIN "Rabin-1"
@@ -21,6 +21,7 @@
  *
  */
 
+#include <pthread.h>
 #include "dcinternal.h"
 
 pkvtbl elgamal_1;
@@ -32,6 +33,10 @@ struct egpub {
   mpz_t g;			/* Element of given order */
   mpz_t y;			/* g^x mod p */
   size_t nbits;
+  /* tables of powers of g and y, built on the second use of each */
+  int guses, yuses;
+  fbexp *gtab;
+  fbexp *ytab;
 };
 typedef struct egpub egpub;
 
@@ -41,6 +46,48 @@ struct egpriv {
 };
 typedef struct egpriv egpriv;
 
+int eg_fixedbase = 1;
+static pthread_mutex_t eg_tablock = PTHREAD_MUTEX_INITIALIZER;
+
+/* r = base^e mod p, base being g or y.  Building a table costs about
+   as much as one mpz_powm, so a key used once (as by the command-line
+   tools) does without, and one used again gets its table then. */
+static void
+eg_pow (MP_INT *r, egpub *pk, const MP_INT *base, int *uses, fbexp **tab,
+	const MP_INT *e)
+{
+  const fbexp *fb;
+
+  if (!eg_fixedbase) {
+    mpz_powm (r, base, e, pk->p);
+    return;
+  }
+  pthread_mutex_lock (&eg_tablock);
+  if (!*tab && (*uses)++)
+    *tab = fbexp_alloc (base, pk->p, mpz_sizeinbase2 (pk->p));
+  fb = *tab;
+  pthread_mutex_unlock (&eg_tablock);
+
+  if (fb)
+    fbexp_powm (r, fb, e, pk->p);
+  else
+    mpz_powm (r, base, e, pk->p);
+}
+
+static void
+eg_powg (MP_INT *r, const egpub *pk, const MP_INT *e)
+{
+  egpub *k = (egpub *) pk;
+  eg_pow (r, k, k->g, &k->guses, &k->gtab, e);
+}
+
+static void
+eg_powy (MP_INT *r, const egpub *pk, const MP_INT *e)
+{
+  egpub *k = (egpub *) pk;
+  eg_pow (r, k, k->y, &k->yuses, &k->ytab, e);
+}
+
 static int
 msg_to_sig_mpz (MP_INT *out, const char *msg, size_t nbits)
 {
@@ -52,6 +99,7 @@ msg_to_sig_mpz (MP_INT *out, const char *msg, size_t nbits)
   }
   sha1oracle_lookup (5, buf, buflen, msg, strlen (msg));
   mpz_set_rawmag_le (out, buf, buflen);
+  free (buf);
   mpz_tdiv_r_2exp (out, out, nbits);
   return 0;
 }
@@ -75,10 +123,10 @@ eg_encrypt (const dckey *key, const char *msg)
   mpz_init (t);
 
   random_zn (r, pk->q);
-  mpz_powm (t, pk->y, r, pk->p);
+  eg_powy (t, pk, r);
   mpz_mul (t, t, m);
   mpz_mod (t, t, pk->p);
-  mpz_powm (r, pk->g, r, pk->p);
+  eg_powg (r, pk, r);
 
   if (cat_str (&res, "r=")
       || cat_mpz (&res, r)
@@ -113,9 +161,9 @@ eg_verify (const dckey *key, const char *msg, const char *sig)
       || read_mpz (&sig, s))
     goto leave;
 
-  mpz_powm (m, pk->g, m, pk->p);
+  eg_powg (m, pk, m);
 
-  mpz_powm (t, pk->y, r, pk->p);
+  eg_powy (t, pk, r);
   mpz_powm (r, r, s, pk->p);
   mpz_mul (t, t, r);
   mpz_mod (t, t, pk->p);
@@ -157,8 +205,11 @@ eg_free_pub (dckey *key)
   egpub *pk = (egpub *) key;
   key->type = 0;
   mpz_clear (pk->p);
+  mpz_clear (pk->q);
   mpz_clear (pk->g);
   mpz_clear (pk->y);
+  fbexp_free (pk->gtab);
+  fbexp_free (pk->ytab);
   free (pk);
 }
 
@@ -175,6 +226,8 @@ eg_import_pub (const char *asc)
     return NULL;
   pk->key.vptr = &elgamal_1;
   pk->key.type = PUBLIC;
+  pk->guses = pk->yuses = 0;
+  pk->gtab = pk->ytab = NULL;
   mpz_init (pk->p);
   mpz_init (pk->q);
   mpz_init (pk->g);
@@ -250,7 +303,7 @@ eg_sign (const dckey *key, const char *msg)
     random_zn (k, sk->pub.q);
   } while (!mpz_invert (ki, k, sk->pub.q));
 
-  mpz_powm (r, sk->pub.g, k, sk->pub.p);
+  eg_powg (r, &sk->pub, k);
 
   mpz_mul (s, sk->x, r);
   mpz_mod (s, s, sk->pub.q);
@@ -308,6 +361,8 @@ eg_free_priv (dckey *key)
   mpz_clear (sk->pub.g);
   mpz_clear (sk->pub.y);
   mpz_clear (sk->x);
+  fbexp_free (sk->pub.gtab);
+  fbexp_free (sk->pub.ytab);
   free (sk);
 }
 
@@ -324,6 +379,8 @@ eg_import_priv (const char *asc)
     return NULL;
   sk->pub.key.vptr = &elgamal_1;
   sk->pub.key.type = PRIVATE;
+  sk->pub.guses = sk->pub.yuses = 0;
+  sk->pub.gtab = sk->pub.ytab = NULL;
   mpz_init (sk->pub.p);
   mpz_init (sk->pub.q);
   mpz_init (sk->pub.g);
@@ -358,6 +415,8 @@ eg_keygen (size_t nbits, const char *extra)
 
   sk->pub.key.vptr = &elgamal_1;
   sk->pub.key.type = PRIVATE;
+  sk->pub.guses = sk->pub.yuses = 0;
+  sk->pub.gtab = sk->pub.ytab = NULL;
   mpz_init (sk->pub.p);
   mpz_init (sk->pub.q);
   mpz_init (sk->pub.g);
@@ -392,10 +451,10 @@ eg_paramgen (size_t nbits)
   mpz_init (t);
 
  restart:
-  do {
-    random_bigint (p, nbits);
-    mpz_setbit (p, 0);
-  } while (!sprimecheck (p, q));
+  /* a safe prime is 11 mod 12 */
+  random_bigint (p, nbits);
+  prime_search (p, p, 12, 11, 1);
+  mpz_tdiv_q_2exp (q, p, 1);
 
   for (i = 0;; i++) {
     if (i == num_small_primes)
@@ -449,7 +508,7 @@ eg_getparam_default (size_t nbits)
   else if (nbits <= 1536)
     return "p=0xa7b27159e51587b4dbce4e9e12e8bc256adb08570277e153919dcea1afa6fc293fc07f1a0d552fc34c782b4ec11320f706559281a44b83ebbf92af4b51a1f8c782e9e2cccf7fbe81b42db09ef1028fe3d270b5a89c85618ef97cc6d6a7324f9d77d35d311230d3b542ddcad16be81eac369d5466c163d5c9e919635362cf5291d2c0d0d313ae5630f137bad3094d977f2d729ac7aa7bfd2c338d773d084d0b651c312778fb08a77e40eb8cdf1022e7f83de3f6ce5fbe6868de10a22713b39887,q=0xa7b27159e51587b4dbce4e9e12e8bc256adb08570277e153919dcea1afa6fc293fc07f1a0d552fc34c782b4ec11320f706559281a44b83ebbf92af4b51a1f8c782e9e2cccf7fbe81b42db09ef1028fe3d270b5a89c85618ef97cc6d6a7324f9d77d35d311230d3b542ddcad16be81eac369d5466c163d5c9e919635362cf5291d2c0d0d313ae5630f137bad3094d977f2d729ac7aa7bfd2c338d773d084d0b651c312778fb08a77e40eb8cdf1022e7f83de3f6ce5fbe6868de10a22713b39886,g=0x11";
   else if (nbits <= 2048)
-    return "p=0xb4d69648db452dd3e524a00000fa7dedc8f791decc0799335a482a296d49c21be4c63fb8c63e3025a10d3941ab64cd48b6aeceeef60d3a2dd7fb88a12364f04ef12617aac6ddac210733cff641fd595d569b1e8c62cde8d09277202e026a4aeda1d4b7b5c0ac99a1276b87b9864855ebc242015a99e79016c8bee4d65c3b30e0272e1cb8ebd12aa0ce533bbd72aafbb2fe9cd750e732e3b07d399e1f5b62a106c08bd6cf4aa99ebb4e33be9f34fd3da57d936fd31916478f5e73adc113519684ef15721b510ac0165f4d0f5e72b923223d0c39f6004780dca0c74e80cbf00ed7915e777f9a7a38bab9201b8f3318f5ab1a7c3a2993f96beb3f091670d7c20927,g=0x5";
+    return "p=0xb4d69648db452dd3e524a00000fa7dedc8f791decc0799335a482a296d49c21be4c63fb8c63e3025a10d3941ab64cd48b6aeceeef60d3a2dd7fb88a12364f04ef12617aac6ddac210733cff641fd595d569b1e8c62cde8d09277202e026a4aeda1d4b7b5c0ac99a1276b87b9864855ebc242015a99e79016c8bee4d65c3b30e0272e1cb8ebd12aa0ce533bbd72aafbb2fe9cd750e732e3b07d399e1f5b62a106c08bd6cf4aa99ebb4e33be9f34fd3da57d936fd31916478f5e73adc113519684ef15721b510ac0165f4d0f5e72b923223d0c39f6004780dca0c74e80cbf00ed7915e777f9a7a38bab9201b8f3318f5ab1a7c3a2993f96beb3f091670d7c20927,q=0xb4d69648db452dd3e524a00000fa7dedc8f791decc0799335a482a296d49c21be4c63fb8c63e3025a10d3941ab64cd48b6aeceeef60d3a2dd7fb88a12364f04ef12617aac6ddac210733cff641fd595d569b1e8c62cde8d09277202e026a4aeda1d4b7b5c0ac99a1276b87b9864855ebc242015a99e79016c8bee4d65c3b30e0272e1cb8ebd12aa0ce533bbd72aafbb2fe9cd750e732e3b07d399e1f5b62a106c08bd6cf4aa99ebb4e33be9f34fd3da57d936fd31916478f5e73adc113519684ef15721b510ac0165f4d0f5e72b923223d0c39f6004780dca0c74e80cbf00ed7915e777f9a7a38bab9201b8f3318f5ab1a7c3a2993f96beb3f091670d7c20926,g=0x5";
   else if (nbits <= 4096)
     return "p=0xd6d3bb04176bddf6c602f7501041273b2d4c9f79eb956c8f6326d37766983d06bf64b004e77b65165a34faf25bdf22f0cfaa946013c1b65b61a037b8683603ebd265d4694696f3676b966a6231374f16aa00343d2f1450b9e18c4753c8d3397cc98852e24a723f421068e1d1010ba70abf740c7e6b232778113220e06b3db5589bae66a5393acba971bbda0eefbe7708c5107eb8ae4ec4f00fb34c36db17f395c6617d20cce60558a0609f514fb9a261ddf44574321ed4364639cf0ad2e3d287a640f9ece71ddb708619ded719f950687bc6734cd5b4ac4f4942047319820b533b06b03f2ce7b62c17141354c86d873c01e5c3fd261050706bd3386bc8db96c5695713a1fa8f6676628bc31691a3b00966eaa16cb508855df9ee0f2d52c083f10c8bc3fc8eec2970ed06bfdeb9ef86371996966d556507b4823eeaee17c1f2d668e21715ee18c79ec80650f9011378c062321fb93724381fef05d61d4f118864a89c26e1217173ac9f0439b2fb9b30bc0a5294dc2f42a9daf7283e5f20039ce17c85ab127ba28bba93c6d39a8e5c57e17ff4ebf54b15370df182c035c12411e0f95c573d3ffdfde8295b5f59d4f667655d56b9d490711df779e0defd18e5ac7a230cf28beda40aef8e82f3aa2da8a4740ad98e3cd631188f921d3e5bf3d60b16cdd119052740326ab563e2743a5b43c796da779d27ea18cb3dcc160f637faa0b,q=0xd6d3bb04176bddf6c602f7501041273b2d4c9f79eb956c8f6326d37766983d06bf64b004e77b65165a34faf25bdf22f0cfaa946013c1b65b61a037b8683603ebd265d4694696f3676b966a6231374f16aa00343d2f1450b9e18c4753c8d3397cc98852e24a723f421068e1d1010ba70abf740c7e6b232778113220e06b3db5589bae66a5393acba971bbda0eefbe7708c5107eb8ae4ec4f00fb34c36db17f395c6617d20cce60558a0609f514fb9a261ddf44574321ed4364639cf0ad2e3d287a640f9ece71ddb708619ded719f950687bc6734cd5b4ac4f4942047319820b533b06b03f2ce7b62c17141354c86d873c01e5c3fd261050706bd3386bc8db96c5695713a1fa8f6676628bc31691a3b00966eaa16cb508855df9ee0f2d52c083f10c8bc3fc8eec2970ed06bfdeb9ef86371996966d556507b4823eeaee17c1f2d668e21715ee18c79ec80650f9011378c062321fb93724381fef05d61d4f118864a89c26e1217173ac9f0439b2fb9b30bc0a5294dc2f42a9daf7283e5f20039ce17c85ab127ba28bba93c6d39a8e5c57e17ff4ebf54b15370df182c035c12411e0f95c573d3ffdfde8295b5f59d4f667655d56b9d490711df779e0defd18e5ac7a230cf28beda40aef8e82f3aa2da8a4740ad98e3cd631188f921d3e5bf3d60b16cdd119052740326ab563e2743a5b43c796da779d27ea18cb3dcc160f637faa0a,g=0x2";
   else
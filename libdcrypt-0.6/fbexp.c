@@ -0,0 +1,134 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * Exponentiation of a fixed base modulo a fixed modulus, as g^r and
+ * y^r in ElGamal, after Brickell, Gordon, McCurley and Wilson.  The
+ * table holds base^(2^(w*i)) for every w-bit window i of an exponent
+ * of up to nbits bits; a power then takes one multiplication per
+ * window plus two per possible window value, and no squarings, where
+ * mpz_powm needs one squaring per bit.
+ */
+
+#include "dcinternal.h"
+
+/* multiplications per power for windows of w bits */
+static size_t
+fbexp_cost (size_t nbits, int w)
+{
+  return (nbits + w - 1) / w + ((size_t) 2 << w);
+}
+
+fbexp *
+fbexp_alloc (const MP_INT *base, const MP_INT *mod, size_t nbits)
+{
+  fbexp *fb;
+  size_t i;
+  int w, j;
+
+  if (!(fb = malloc (sizeof (*fb))))
+    return NULL;
+  for (w = 1; w < fbexp_maxwin && fbexp_cost (nbits, w + 1)
+	 < fbexp_cost (nbits, w); w++)
+    ;
+  fb->w = w;
+  fb->nbits = nbits;
+  fb->n = (nbits + w - 1) / w;
+  if (!(fb->pow = malloc (fb->n * sizeof (fb->pow[0])))) {
+    free (fb);
+    return NULL;
+  }
+
+  mpz_init (&fb->pow[0]);
+  mpz_mod (&fb->pow[0], base, mod);
+  for (i = 1; i < fb->n; i++) {
+    mpz_init (&fb->pow[i]);
+    mpz_mul (&fb->pow[i], &fb->pow[i-1], &fb->pow[i-1]);
+    mpz_mod (&fb->pow[i], &fb->pow[i], mod);
+    for (j = 1; j < w; j++) {
+      mpz_mul (&fb->pow[i], &fb->pow[i], &fb->pow[i]);
+      mpz_mod (&fb->pow[i], &fb->pow[i], mod);
+    }
+  }
+  return fb;
+}
+
+void
+fbexp_free (fbexp *fb)
+{
+  size_t i;
+
+  if (!fb)
+    return;
+  for (i = 0; i < fb->n; i++)
+    mpz_clear (&fb->pow[i]);
+  free (fb->pow);
+  free (fb);
+}
+
+void
+fbexp_powm (MP_INT *r, const fbexp *fb, const MP_INT *e, const MP_INT *mod)
+{
+  u_char *digit;
+  mpz_t a, b;
+  size_t i, bit;
+  int d, j, aset, bset;
+
+  if (mpz_sgn (e) < 0 || mpz_sizeinbase2 (e) > fb->nbits
+      || !(digit = malloc (fb->n))) {
+    mpz_powm (r, &fb->pow[0], e, mod);
+    return;
+  }
+
+  for (i = bit = 0; i < fb->n; i++)
+    for (digit[i] = j = 0; j < fb->w; j++, bit++)
+      digit[i] |= mpz_getbit (e, bit) << j;
+
+  /* a = prod over d of b_d^d, where b_d is the product of pow[i] for
+     the windows i holding d: b accumulates b_(2^w-1) ... b_d, and is
+     multiplied into a once for each d */
+  mpz_init_set_ui (a, 1);
+  mpz_init (b);
+  bset = aset = 0;
+  for (d = (1 << fb->w) - 1; d > 0; d--) {
+    for (i = 0; i < fb->n; i++)
+      if (digit[i] != d)
+	continue;
+      else if (!bset++)
+	mpz_set (b, &fb->pow[i]);
+      else {
+	mpz_mul (b, b, &fb->pow[i]);
+	mpz_mod (b, b, mod);
+      }
+    if (!bset)
+      continue;
+    else if (!aset++)
+      mpz_set (a, b);
+    else {
+      mpz_mul (a, a, b);
+      mpz_mod (a, a, mod);
+    }
+  }
+  mpz_swap (r, a);
+
+  bzero (digit, fb->n);
+  free (digit);
+  mpz_clear (a);
+  mpz_clear (b);
+}
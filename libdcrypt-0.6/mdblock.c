@@ -27,7 +27,7 @@ enum { blocksize = 64 };
 
 void
 mdblock_init (mdblock *mp,
-	      void (*consume) (mdblock *, const u_char block[blocksize]))
+	      void (*consume) (mdblock *, const u_char *blocks, size_t nblocks))
 {
   mp->count = 0;
   mp->consume = consume;
@@ -50,17 +50,18 @@ mdblock_update (mdblock *mp, const void *bytes, size_t len)
   if (bcount) {
     int j = blocksize - bcount;
     memcpy (&mp->buffer[bcount], data, j);
-    mp->consume (mp, mp->buffer);
+    mp->consume (mp, mp->buffer, 1);
     i = j;
     len -= j;
   }
   else
     i = 0;
 
-  while (len >= blocksize) {
-    mp->consume (mp, &data[i]);
-    i += blocksize;
-    len -= blocksize;
+  /* hand all the whole blocks over at once */
+  if (len >= blocksize) {
+    mp->consume (mp, &data[i], len / blocksize);
+    i += len - len % blocksize;
+    len %= blocksize;
   }
   memcpy (mp->buffer, &data[i], len);
 }
@@ -94,28 +95,12 @@ mdblock_finish (mdblock *mp, int bigendian)
 
   cnt = mp->count <<= 3;	/* make bytecount bitcount */
 
-  if (bigendian) {
-    *dp++ = (cnt >> 56) & 0xff;
-    *dp++ = (cnt >> 48) & 0xff;
-    *dp++ = (cnt >> 40) & 0xff;
-    *dp++ = (cnt >> 32) & 0xff;
-    *dp++ = (cnt >> 24) & 0xff;
-    *dp++ = (cnt >> 16) & 0xff;
-    *dp++ = (cnt >> 8) & 0xff;
-    *dp = (cnt >> 0) & 0xff;
-  }
-  else {
-    *dp++ = (cnt >> 0) & 0xff;
-    *dp++ = (cnt >> 8) & 0xff;
-    *dp++ = (cnt >> 16) & 0xff;
-    *dp++ = (cnt >> 24) & 0xff;
-    *dp++ = (cnt >> 32) & 0xff;
-    *dp++ = (cnt >> 40) & 0xff;
-    *dp++ = (cnt >> 48) & 0xff;
-    *dp = (cnt >> 56) & 0xff;
-  }
+  if (bigendian)
+    put64be (dp, cnt);
+  else
+    put64le (dp, cnt);
 
-  mp->consume (mp, mp->buffer);
+  mp->consume (mp, mp->buffer, 1);
   /* Wipe variables */
   mp->consume = NULL;
   mp->count = 0;
@@ -0,0 +1,177 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * Memory functions for GMP that keep the blocks of each thread in
+ * free lists by size, so that the temporaries of the public key
+ * operations do not go to malloc and back every time, and that clear
+ * every block as GMP releases it, so that no key material is left in
+ * freed memory.  Blocks carry a header with their size class and the
+ * size last asked for, which is what gets cleared; those above the
+ * largest class go straight to malloc and free, and are cleared all
+ * the same.  A realloc to another class copies rather than
+ * leave the old block to realloc uncleared.
+ */
+
+#include <pthread.h>
+#include "dcinternal.h"
+
+enum {
+  mpzpool_minshift = 5,		/* smallest class, 32 bytes */
+  mpzpool_nclass = 11,		/* largest class, 32 KiB */
+  mpzpool_maxfree = 32,		/* free blocks kept per class and thread */
+  mpzpool_hdr = 16,		/* keeps the limbs 16-byte aligned */
+  mpzpool_large = mpzpool_nclass,
+};
+
+struct mpzpool_hdr {
+  int c;			/* size class */
+  size_t n;			/* bytes in use */
+};
+
+struct mpzpool_block {
+  struct mpzpool_block *next;	/* while free */
+};
+
+#define mpzpool_hdrof(ptr) \
+  ((struct mpzpool_hdr *) ((char *) (ptr) - mpzpool_hdr))
+
+struct mpzpool {
+  struct mpzpool_block *free[mpzpool_nclass];
+  u_int nfree[mpzpool_nclass];
+  int registered;
+  int drained;			/* by the key destructor; keep nothing */
+};
+
+static __thread struct mpzpool mpzpool_t;
+static pthread_key_t mpzpool_key;
+static pthread_once_t mpzpool_once = PTHREAD_ONCE_INIT;
+
+/* a store the compiler cannot drop, for blocks about to go to free */
+static void *(*volatile mpzpool_memset) (void *, int, size_t) = memset;
+
+static void
+mpzpool_drain (void *_mp)
+{
+  struct mpzpool *mp = _mp;
+  struct mpzpool_block *b;
+  int c;
+
+  for (c = 0; c < mpzpool_nclass; c++)
+    while ((b = mp->free[c])) {
+      mp->free[c] = b->next;
+      xfree ((char *) b - mpzpool_hdr);
+    }
+  bzero (mp->nfree, sizeof (mp->nfree));
+  /* GMP frees that come later, from other destructors, must not fill
+     the lists again, as nothing would give them back */
+  mp->drained = 1;
+}
+
+static void
+mpzpool_keyinit (void)
+{
+  pthread_key_create (&mpzpool_key, mpzpool_drain);
+}
+
+static int
+mpzpool_class (size_t n)
+{
+  int c = 0;
+
+  while (c < mpzpool_nclass && n > (size_t) 1 << (c + mpzpool_minshift))
+    c++;
+  return c;
+}
+
+void *
+mpzpool_alloc (size_t n)
+{
+  struct mpzpool *mp = &mpzpool_t;
+  struct mpzpool_block *b;
+  int c = mpzpool_class (n);
+  char *p;
+
+  if (c < mpzpool_nclass && (b = mp->free[c])) {
+    mp->free[c] = b->next;
+    mp->nfree[c]--;
+    mpzpool_hdrof (b)->n = n;
+    return b;
+  }
+  p = xmalloc (mpzpool_hdr
+	       + (c < mpzpool_nclass ? (size_t) 1 << (c + mpzpool_minshift)
+		  : n));
+  p += mpzpool_hdr;
+  mpzpool_hdrof (p)->c = c;
+  mpzpool_hdrof (p)->n = n;
+  return p;
+}
+
+void
+mpzpool_free (void *ptr, size_t n)
+{
+  struct mpzpool *mp = &mpzpool_t;
+  struct mpzpool_block *b = ptr;
+  int c = mpzpool_hdrof (ptr)->c;
+
+  /* the size GMP passes is not relied on */
+  n = mpzpool_hdrof (ptr)->n;
+  if (c == mpzpool_large || mp->nfree[c] >= mpzpool_maxfree
+      || mp->drained) {
+    mpzpool_memset (ptr, 0, n);
+    xfree ((char *) ptr - mpzpool_hdr);
+    return;
+  }
+  bzero (ptr, n);
+  if (!mp->registered) {
+    /* so the lists are given back when the thread exits */
+    pthread_once (&mpzpool_once, mpzpool_keyinit);
+    pthread_setspecific (mpzpool_key, mp);
+    mp->registered = 1;
+  }
+  b->next = mp->free[c];
+  mp->free[c] = b;
+  mp->nfree[c]++;
+}
+
+void *
+mpzpool_realloc (void *ptr, size_t oldn, size_t n)
+{
+  int c = mpzpool_hdrof (ptr)->c;
+  void *nptr;
+
+  oldn = mpzpool_hdrof (ptr)->n;
+  if (c < mpzpool_nclass && n <= (size_t) 1 << (c + mpzpool_minshift)) {
+    if (n < oldn)
+      bzero ((char *) ptr + n, oldn - n);
+    mpzpool_hdrof (ptr)->n = n;
+    return ptr;
+  }
+  /* not realloc, which would leave the old block uncleared */
+  nptr = mpzpool_alloc (n);
+  memcpy (nptr, ptr, oldn < n ? oldn : n);
+  mpzpool_free (ptr, oldn);
+  return nptr;
+}
+
+void
+mpzpool_install (void)
+{
+  mp_set_memory_functions (mpzpool_alloc, mpzpool_realloc, mpzpool_free);
+}
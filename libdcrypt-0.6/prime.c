@@ -22,6 +22,8 @@
  */
 
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "dcinternal.h"
 #undef setbit
 
@@ -285,74 +287,340 @@ random_zn (MP_INT *r, const MP_INT *n)
   } while (mpz_cmp (r, n) >= 0);
 }
 
-int
-primecheck (const MP_INT *n)
+/* declared with the prng functions, but kept here with the other
+   samplers so that using the PRNG does not pull in GMP */
+void
+prng_getfrom_zn (mpz_t ret, const mpz_t n)
+{
+  int bits;
+  size_t len;
+  u_char *buf = NULL;
+
+  assert (mpz_sgn (n) > 0);
+  bits = mpz_sizeinbase2 (n);
+  len = (bits + 7) >> 3;
+  buf = (u_char *) xmalloc (len);
+  bzero (buf, len);
+
+  do {
+    prng_getbytes (buf, len);
+    buf[0] &= 0xff >> (-bits & 7);
+    mpz_set_rawmag_be (ret, (char *) buf, len);
+    bzero (buf, len);
+  } while (mpz_cmp (ret, n) >= 0);
+
+  xfree (buf);
+}
+
+/* the tests that follow trial division: a Fermat test to base 2, then
+   25 rounds of mpz_probab_prime_p */
+static int
+fermatcheck (const MP_INT *n)
 {
-  int i;
   mpz_t t;
   int res;
 
-  if (!(mpz_get_ui (n) & 1))
-    return !mpz_cmp_ui (n, 2);
-  for (i = 0; i < 1024; i++)
-    if (!quickmod (n, small_primes[i]))
-      return 0;
-
   mpz_init_set_ui (t, 2);
   mpz_powm (t, t, n, n);
   res = !mpz_cmp_ui (t, 2);
   mpz_clear (t);
+  return res;
+}
+
+/* numbers up to the largest small prime are tested directly, as the
+   trial division would strike out the small primes themselves */
+int
+primecheck (const MP_INT *n)
+{
+  int i;
 
-  if (res)
-    res = mpz_probab_prime_p (n, 25);
+  if (mpz_cmp_ui (n, small_primes[num_small_primes - 1]) <= 0)
+    return mpz_probab_prime_p (n, 25);
+  if (!(mpz_get_ui (n) & 1))
+    return 0;
+  for (i = 0; i < 1024; i++)
+    if (!quickmod (n, small_primes[i]))
+      return 0;
 
-  return res;
+  return fermatcheck (n) && mpz_probab_prime_p (n, 25);
 }
 
 int
 sprimecheck (const MP_INT *n, MP_INT *q)
 {
   int i;
-  mpz_t t;
-  mpz_t two;
-  int ret = 0;
 
+  mpz_tdiv_q_2exp (q, n, 1);
+  if (mpz_cmp_ui (q, small_primes[num_small_primes - 1]) <= 0)
+    return mpz_probab_prime_p (n, 25) && mpz_probab_prime_p (q, 25);
+
+  /* past 11, neither n nor q is a multiple of 2, 3 or 5 */
   switch (quickmod (n, 30)) {
-  case 11:
+  case 17:
   case 23:
   case 29:
     break;
   default:
-    if (n->_mp_size == 1 && mpz_get_ui (n) < 30)
-      switch (mpz_get_ui (n)) {
-      case 5:
-      case 7:
-      case 11:
-	return 1;
-      }
     return 0;
   }
 
-  mpz_tdiv_q_2exp (q, n, 1);
-
   for (i = 2; i < num_small_primes; i++)
     if (!quickmod (q, small_primes[i]) || !quickmod (n, small_primes[i]))
       return 0;
 
-  mpz_init (t);
-  mpz_init_set_ui (two, 2);
+  return fermatcheck (q) && fermatcheck (n)
+    && mpz_probab_prime_p (q, 25) && mpz_probab_prime_p (n, 25);
+}
+
+/*
+ * prime_search finds the least prime at or above start in an arithmetic
+ * progression, sieving the candidates a window at a time.  The residues
+ * of the first candidate of the window modulo each small prime are
+ * computed once, with quickmod, and then moved on from one window to
+ * the next by adding the window's span; each small prime then strikes
+ * out every candidate it divides with a stride through the window.  The
+ * candidates left over go to threads for the Fermat and Miller-Rabin
+ * tests.
+ *
+ * Sieving by the primes up to B leaves about 1 in ln B / 1.12 odd
+ * candidates, and the sieve costs little next to a Fermat test, so the
+ * primes go beyond small_primes, up to a bound that grows with the
+ * candidates' size.
+ */
+
+int prime_nthreads;
 
-  mpz_powm (t, two, q, q);
-  if (mpz_cmp_ui (t, 2))
-    goto leave;
-  mpz_powm (t, two, n, n);
-  if (mpz_cmp_ui (t, 2))
-    goto leave;
+enum {
+  prime_window = 4096,		/* candidates per window */
+  prime_sievemin = 1 << 14,	/* bounds on the sieving primes */
+  prime_sievemax = 1 << 18,
+};
 
-  ret = mpz_probab_prime_p (q, 25) && mpz_probab_prime_p (n, 25);
+static pthread_once_t sieve_once = PTHREAD_ONCE_INIT;
+static u_int *sieve_primes;	/* the odd primes below prime_sievemax */
+static size_t sieve_nprimes;
 
- leave:
-  mpz_clear (t);
-  mpz_clear (two);
-  return ret;
+static void
+sieve_init (void)
+{
+  u_char *comp = xmalloc (prime_sievemax);
+  size_t i, j;
+
+  bzero (comp, prime_sievemax);
+  for (i = 3; i * i < prime_sievemax; i += 2)
+    if (!comp[i])
+      for (j = i * i; j < prime_sievemax; j += 2 * i)
+	comp[j] = 1;
+  for (i = 3; i < prime_sievemax; i += 2)
+    sieve_nprimes += !comp[i];
+  sieve_primes = xmalloc (sieve_nprimes * sizeof (sieve_primes[0]));
+  for (i = 3, j = 0; i < prime_sievemax; i += 2)
+    if (!comp[i])
+      sieve_primes[j++] = i;
+  xfree (comp);
+}
+
+struct prime_sieve {
+  size_t nprimes;
+  u_long step;
+  int safe;
+  u_int *res;			/* residue of the window's base */
+  u_int *adv;			/* the window's span, modulo each prime */
+  u_int *inv;			/* step^-1, modulo each prime */
+  u_char mark[prime_window];
+};
+
+/* the test threads share the window's survivors, taking them in order;
+   best is the index of the first prime found so far, and candidates
+   after it are skipped */
+struct prime_testers {
+  const struct prime_sieve *ps;
+  const MP_INT *base;
+  pthread_mutex_t lock;
+  size_t next;
+  size_t best;
+};
+
+static u_long
+inv_ui (u_long a, u_long m)
+{
+  long t = 0, nt = 1, q, x;
+  u_long r = m, nr = a % m, y;
+
+  while (nr) {
+    q = r / nr;
+    x = t - q * nt;
+    t = nt;
+    nt = x;
+    y = r - q * nr;
+    r = nr;
+    nr = y;
+  }
+  return t < 0 ? t + m : t;
+}
+
+static void
+prime_sieve_window (struct prime_sieve *ps)
+{
+  size_t i, j;
+  u_long s, zero;
+
+  bzero (ps->mark, sizeof (ps->mark));
+  for (i = 0; i < ps->nprimes; i++) {
+    s = sieve_primes[i];
+    if (!ps->inv[i])
+      continue;
+    /* candidate j is base + j * step; it is a multiple of s where j is
+       -base / step mod s, and n - 1 is where j is (1 - base) / step */
+    zero = (u_int64_t) (s - ps->res[i]) * ps->inv[i] % s;
+    for (j = zero; j < prime_window; j += s)
+      ps->mark[j] = 1;
+    if (ps->safe)
+      for (j = (zero + ps->inv[i]) % s; j < prime_window; j += s)
+	ps->mark[j] = 1;
+    ps->res[i] = (ps->res[i] + ps->adv[i]) % s;
+  }
+}
+
+static void *
+prime_test_thread (void *_pt)
+{
+  struct prime_testers *pt = _pt;
+  const struct prime_sieve *ps = pt->ps;
+  mpz_t n, q;
+  size_t j;
+  int ok;
+
+  mpz_init (n);
+  mpz_init (q);
+  for (;;) {
+    pthread_mutex_lock (&pt->lock);
+    while (pt->next < pt->best && ps->mark[pt->next])
+      pt->next++;
+    j = pt->next++;
+    pthread_mutex_unlock (&pt->lock);
+    if (j >= pt->best)
+      break;
+
+    mpz_set (n, pt->base);
+    mpz_add_ui (n, n, j * ps->step);
+    if (ps->safe) {
+      mpz_tdiv_q_2exp (q, n, 1);
+      ok = fermatcheck (q) && fermatcheck (n)
+	&& mpz_probab_prime_p (q, 25) && mpz_probab_prime_p (n, 25);
+    }
+    else
+      ok = fermatcheck (n) && mpz_probab_prime_p (n, 25);
+
+    if (ok) {
+      pthread_mutex_lock (&pt->lock);
+      if (j < pt->best)
+	pt->best = j;
+      pthread_mutex_unlock (&pt->lock);
+    }
+  }
+  mpz_clear (n);
+  mpz_clear (q);
+  return NULL;
+}
+
+/* tests the window's survivors, returning the index of the first prime
+   or prime_window if there is none */
+static size_t
+prime_test_window (const struct prime_sieve *ps, const MP_INT *base,
+		   int nthreads, pthread_t *tids)
+{
+  struct prime_testers pt;
+  int t, started;
+
+  pt.ps = ps;
+  pt.base = base;
+  pthread_mutex_init (&pt.lock, NULL);
+  pt.next = 0;
+  pt.best = prime_window;
+
+  for (started = 1; started < nthreads; started++)
+    if (pthread_create (&tids[started], NULL, prime_test_thread, &pt))
+      break;
+  prime_test_thread (&pt);
+  for (t = 1; t < started; t++)
+    pthread_join (tids[t], NULL);
+
+  pthread_mutex_destroy (&pt.lock);
+  return pt.best;
+}
+
+/* Sets p to the least prime at or above start that is rem modulo step,
+   or if safe, the least such p for which (p - 1) / 2 is prime as well
+   (in which case step must be a multiple of 4, and rem 3 mod 4).  step
+   must be even and below 256.  Runs in prime_nthreads threads, or one
+   per CPU if that is 0. */
+void
+prime_search (MP_INT *p, const MP_INT *start, u_long step, u_long rem,
+	      int safe)
+{
+  struct prime_sieve *ps;
+  pthread_t *tids;
+  mpz_t base;
+  size_t i, j;
+  u_long s, r, bound;
+  int nthreads = prime_nthreads;
+
+  assert (!(step & 1) && step < 256 && rem < step);
+  mpz_init (base);
+  r = quickmod (start, step);
+  mpz_add_ui (base, start, (rem + step - r) % step);
+
+  bound = 64 * mpz_sizeinbase2 (base);
+  if (bound < prime_sievemin)
+    bound = prime_sievemin;
+  if (bound > prime_sievemax)
+    bound = prime_sievemax;
+
+  /* too close to the sieving primes to sieve by them */
+  if (mpz_cmp_ui (base, 2 * bound) < 0) {
+    while (safe ? !sprimecheck (base, p) : !primecheck (base))
+      mpz_add_ui (base, base, step);
+    mpz_swap (p, base);
+    mpz_clear (base);
+    return;
+  }
+
+  if (nthreads <= 0)
+    nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (nthreads < 1)
+    nthreads = 1;
+  pthread_once (&sieve_once, sieve_init);
+  ps = xmalloc (sizeof (*ps));
+  tids = xmalloc (nthreads * sizeof (*tids));
+  for (ps->nprimes = 0; ps->nprimes < sieve_nprimes
+	 && sieve_primes[ps->nprimes] < bound; ps->nprimes++)
+    ;
+  ps->step = step;
+  ps->safe = safe;
+  ps->res = xmalloc (ps->nprimes * sizeof (ps->res[0]));
+  ps->adv = xmalloc (ps->nprimes * sizeof (ps->adv[0]));
+  ps->inv = xmalloc (ps->nprimes * sizeof (ps->inv[0]));
+  for (i = 0; i < ps->nprimes; i++) {
+    s = sieve_primes[i];
+    ps->res[i] = quickmod (base, s);
+    ps->adv[i] = (u_long) prime_window * step % s;
+    /* 0 for the primes dividing step, which rem has dealt with */
+    ps->inv[i] = step % s ? inv_ui (step, s) : 0;
+  }
+
+  for (;;) {
+    prime_sieve_window (ps);
+    if ((j = prime_test_window (ps, base, nthreads, tids)) < prime_window)
+      break;
+    mpz_add_ui (base, base, (u_long) prime_window * step);
+  }
+  mpz_add_ui (p, base, j * step);
+
+  xfree (ps->res);
+  xfree (ps->adv);
+  xfree (ps->inv);
+  xfree (ps);
+  xfree (tids);
+  mpz_clear (base);
 }
@@ -23,6 +23,43 @@
 
 #include "dcinternal.h"
 
+/*
+ * Two generators are available.  The default, "aesctr", is AES-256 in
+ * counter mode after the CTR_DRBG of NIST SP 800-90A (without its
+ * derivation function): output is keystream under key K from counter
+ * V, made by the bulk AES backend, and K and V are then replaced by
+ * the next 48 bytes of keystream, so the state left behind says
+ * nothing about output already handed out.  Long requests are served
+ * directly, rekeying every prng_drbg_maxreq bytes.  Short ones come
+ * from a buffer of keystream refilled (and rekeyed past) as a whole,
+ * as in OpenBSD's arc4random, and bytes are wiped from it as they are
+ * handed out.  "sha1" is the original generator, one sha1_transform
+ * per 20 bytes, kept for callers that depend on its output; select it
+ * with prng_setbackend.
+ *
+ * An AES-CTR generator lives in a prng_ctx.  One of them, the master,
+ * takes the seeds given to prng_seed and is shared under prng_lock;
+ * the others are seeded from it.  prng_getbytes and friends use a
+ * context private to the calling thread, which is reseeded from the
+ * master when it is first used and again after every prng_seed, so
+ * they need no lock.  prng_seed also mixes the seed into the SHA-1
+ * generator, which is only used under prng_lock.
+ *
+ * After fork () the child would otherwise repeat whatever its parent
+ * generates next.  The parent advances the master just before forking
+ * and the child mixes its pid into its copy, so the two masters
+ * differ; every context notices the fork (prng_forks) and reseeds
+ * from the master before its next output.
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+
+struct prng_gen {
+  const char *name;
+  void (*getbytes) (void *buf, size_t len);
+};
+
 static u_int32_t prng_state[16];
 
 static const u_int32_t initdat[5] = {
@@ -30,7 +67,7 @@ static const u_int32_t initdat[5] = {
 };
 
 void
-prng_transform (u_int32_t state[64], u_int32_t out[5])
+prng_transform (u_int32_t state[16], u_int32_t out[5])
 {
   int c, i;
   memcpy (out, initdat, sizeof (initdat));
@@ -43,8 +80,8 @@ prng_transform (u_int32_t state[64], u_int32_t out[5])
   }
 }
 
-void
-prng_getbytes (void *buf, size_t len)
+static void
+sha1prng_getbytes (void *buf, size_t len)
 {
   char *cp = buf;
   u_int32_t out[5];
@@ -62,6 +99,247 @@ prng_getbytes (void *buf, size_t len)
   bzero (out, sizeof (out));
 }
 
+static void
+sha1prng_seed (const void *buf, size_t len)
+{
+  u_char oldstate[sizeof (prng_state)];
+  sha1oracle_ctx soc;
+
+  sha1oracle_init (&soc, sizeof (prng_state), 0);
+  sha1prng_getbytes (oldstate, sizeof (oldstate));
+  sha1oracle_update (&soc, oldstate, sizeof (oldstate));
+  bzero (oldstate, sizeof (oldstate));
+  sha1oracle_update (&soc, buf, len);
+  sha1oracle_final (&soc, (u_char *) prng_state);
+}
+
+enum {
+  prng_drbg_keylen = 32,
+  prng_drbg_kvlen = prng_drbg_keylen + 16,
+  prng_drbg_maxreq = 0x10000,
+};
+
+static pthread_mutex_t prng_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t prng_once = PTHREAD_ONCE_INIT;
+static prng_ctx prng_master;	/* under prng_lock */
+static u_int prng_forks;
+static u_int prng_seeds;
+static __thread prng_ctx prng_tctx;
+static __thread u_int prng_tseeds;
+
+static void
+drbg_update (prng_ctx *pc, const u_char kv[prng_drbg_kvlen])
+{
+  aes_esetkey (&pc->key, kv, prng_drbg_keylen);
+  memcpy (pc->v, kv + prng_drbg_keylen, sizeof (pc->v));
+}
+
+/* writes len bytes of keystream to out followed by the next K and V */
+static void
+drbg_generate (prng_ctx *pc, u_char *out, size_t len)
+{
+  u_char kv[prng_drbg_kvlen];
+
+  bzero (out, len);
+  aes_ectr_xor (&pc->key, out, out, len, pc->v);
+  bzero (kv, sizeof (kv));
+  aes_ectr_xor (&pc->key, kv, kv, sizeof (kv), pc->v);
+  drbg_update (pc, kv);
+  bzero (kv, sizeof (kv));
+}
+
+static void
+drbg_getbytes (prng_ctx *pc, void *buf, size_t len)
+{
+  u_char *cp = buf;
+  size_t n;
+
+  if (!pc->key.nrounds) {
+    bzero (pc->buf, sizeof (pc->buf));
+    drbg_update (pc, pc->buf);
+  }
+
+  if (len >= prng_ctx_bufsize) {
+    for (; len > 0; cp += n, len -= n) {
+      n = len < prng_drbg_maxreq ? len : prng_drbg_maxreq;
+      drbg_generate (pc, cp, n);
+    }
+    return;
+  }
+
+  if (len > pc->avail) {
+    /* one pass of the bulk code makes the buffer and the next K, V;
+       the last prng_drbg_kvlen bytes of pc->buf are only scratch */
+    bzero (pc->buf, sizeof (pc->buf));
+    aes_ectr_xor (&pc->key, pc->buf, pc->buf, sizeof (pc->buf), pc->v);
+    drbg_update (pc, pc->buf + prng_ctx_bufsize);
+    bzero (pc->buf + prng_ctx_bufsize, prng_drbg_kvlen);
+    pc->avail = prng_ctx_bufsize;
+  }
+  cp = pc->buf + prng_ctx_bufsize - pc->avail;
+  memcpy (buf, cp, len);
+  bzero (cp, len);
+  pc->avail -= len;
+}
+
+static void
+drbg_seed (prng_ctx *pc, const void *buf, size_t len)
+{
+  u_char kv[prng_drbg_kvlen];
+  sha1oracle_ctx soc;
+
+  sha1oracle_init (&soc, sizeof (kv), 1);
+  drbg_getbytes (pc, kv, sizeof (kv));
+  sha1oracle_update (&soc, kv, sizeof (kv));
+  sha1oracle_update (&soc, buf, len);
+  sha1oracle_final (&soc, kv);
+  drbg_update (pc, kv);
+  bzero (kv, sizeof (kv));
+  /* nothing made under the old key is handed out after seeding */
+  bzero (pc->buf, sizeof (pc->buf));
+  pc->avail = 0;
+}
+
+static void
+prng_prefork (void)
+{
+  u_char kv[prng_drbg_kvlen];
+
+  pthread_mutex_lock (&prng_lock);
+  /* so that two children with the same pid still differ */
+  drbg_getbytes (&prng_master, kv, sizeof (kv));
+  bzero (kv, sizeof (kv));
+}
+
+static void
+prng_postfork_parent (void)
+{
+  pthread_mutex_unlock (&prng_lock);
+}
+
+static void
+prng_postfork_child (void)
+{
+  pid_t pid = getpid ();
+
+  drbg_seed (&prng_master, &pid, sizeof (pid));
+  __atomic_add_fetch (&prng_forks, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&prng_lock);
+}
+
+static void
+prng_atfork (void)
+{
+  pthread_atfork (prng_prefork, prng_postfork_parent, prng_postfork_child);
+}
+
+/* replaces pc's state with fresh output of the master */
+static void
+prng_ctx_draw (prng_ctx *pc)
+{
+  u_char kv[prng_drbg_kvlen];
+
+  pthread_once (&prng_once, prng_atfork);
+  pthread_mutex_lock (&prng_lock);
+  drbg_getbytes (&prng_master, kv, sizeof (kv));
+  pc->gen = prng_forks;
+  pthread_mutex_unlock (&prng_lock);
+  drbg_update (pc, kv);
+  bzero (kv, sizeof (kv));
+  bzero (pc->buf, sizeof (pc->buf));
+  pc->avail = 0;
+}
+
+void
+prng_ctx_init (prng_ctx *pc)
+{
+  bzero (pc, sizeof (*pc));
+  prng_ctx_draw (pc);
+}
+
+void
+prng_ctx_seed (prng_ctx *pc, const void *buf, size_t len)
+{
+  drbg_seed (pc, buf, len);
+}
+
+void
+prng_ctx_getbytes (prng_ctx *pc, void *buf, size_t len)
+{
+  if (pc->gen != __atomic_load_n (&prng_forks, __ATOMIC_ACQUIRE)) {
+    /* keep what the caller seeded, but make it differ from the copy
+       in the other process */
+    u_char kv[prng_drbg_kvlen];
+    prng_ctx fresh;
+    prng_ctx_draw (&fresh);
+    drbg_getbytes (&fresh, kv, sizeof (kv));
+    drbg_seed (pc, kv, sizeof (kv));
+    pc->gen = fresh.gen;
+    prng_ctx_clear (&fresh);
+    bzero (kv, sizeof (kv));
+  }
+  drbg_getbytes (pc, buf, len);
+}
+
+void
+prng_ctx_clear (prng_ctx *pc)
+{
+  aes_eclrkey (&pc->key);
+  bzero (pc, sizeof (*pc));
+}
+
+static void
+tctx_getbytes (void *buf, size_t len)
+{
+  u_int seeds = __atomic_load_n (&prng_seeds, __ATOMIC_ACQUIRE);
+
+  if (!prng_tctx.key.nrounds || prng_tseeds != seeds) {
+    prng_ctx_draw (&prng_tctx);
+    prng_tseeds = seeds;
+  }
+  prng_ctx_getbytes (&prng_tctx, buf, len);
+}
+
+static void
+sha1prng_getbytes_locked (void *buf, size_t len)
+{
+  pthread_mutex_lock (&prng_lock);
+  sha1prng_getbytes (buf, len);
+  pthread_mutex_unlock (&prng_lock);
+}
+
+static const struct prng_gen prng_gens[] = {
+  { "aesctr", tctx_getbytes },
+  { "sha1", sha1prng_getbytes_locked },
+  { NULL, NULL }
+};
+static const struct prng_gen *prng_cur = prng_gens;
+
+const char *
+prng_backend (void)
+{
+  return prng_cur->name;
+}
+
+int
+prng_setbackend (const char *name)
+{
+  const struct prng_gen *g;
+
+  for (g = prng_gens; g->name; g++)
+    if (!strcmp (g->name, name)) {
+      prng_cur = g;
+      return 0;
+    }
+  return -1;
+}
+
+void
+prng_getbytes (void *buf, size_t len)
+{
+  prng_cur->getbytes (buf, len);
+}
+
 u_int32_t
 prng_getword (void)
 {
@@ -78,40 +356,13 @@ prng_gethyper (void)
   return ret;
 }
 
-void
-prng_getfrom_zn (mpz_t ret, const mpz_t n)
-{
-
-  int bits;
-  size_t len;
-  u_char *buf = NULL;
-
-  assert (mpz_sgn (n) > 0);
-  bits = mpz_sizeinbase2 (n);
-  len = (bits + 7) >> 3;
-  buf = (u_char *) xmalloc (len);
-  bzero (buf, len);
-
-  do {
-    prng_getbytes (buf, len);
-    buf[0] &= 0xff >> (-bits & 7);
-    mpz_set_rawmag_be (ret, (char *) buf, len);
-    bzero (buf, len);
-  } while (mpz_cmp (ret, n) >= 0);
-
-  xfree (buf);
-}
-
 void
 prng_seed (void *buf, size_t len)
 {
-  u_char oldstate[sizeof (prng_state)];
-  sha1oracle_ctx soc;
-
-  sha1oracle_init (&soc, sizeof (prng_state), 0);
-  prng_getbytes (oldstate, sizeof (oldstate));
-  sha1oracle_update (&soc, oldstate, sizeof (oldstate));
-  bzero (oldstate, sizeof (oldstate));
-  sha1oracle_update (&soc, buf, len);
-  sha1oracle_final (&soc, (u_char *) prng_state);
+  pthread_once (&prng_once, prng_atfork);
+  pthread_mutex_lock (&prng_lock);
+  drbg_seed (&prng_master, buf, len);
+  sha1prng_seed (buf, len);
+  __atomic_add_fetch (&prng_seeds, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&prng_lock);
 }
@@ -121,15 +121,13 @@ E2 (MP_INT *out, const MP_INT *in, const MP_INT *n)
   mpz_mod (out, out, n);
 }
 
-/* Calculate out = in^k % n.  Use Chinese remainder theorem for speed. */
+/* Calculate out = in^k % n.  Use Chinese remainder theorem for speed.
+ * op and oq are temporaries, which batches keep from one call to the
+ * next. */
 static void
-D2 (MP_INT *out, const MP_INT *in, const rw_priv *sk, int rsel)
+D2t (MP_INT *out, const MP_INT *in, const rw_priv *sk, int rsel,
+     MP_INT *op, MP_INT *oq)
 {
-  mpz_t op, oq;
-
-  mpz_init (op);
-  mpz_init (oq);
-
   /* find op, oq such that out % p = op, out % q = oq */
   mpz_powm (op, in, sk->kp, sk->p);
   mpz_powm (oq, in, sk->kq, sk->q);
@@ -146,7 +144,16 @@ D2 (MP_INT *out, const MP_INT *in, const rw_priv *sk, int rsel)
   mpz_mod (out, out, sk->p);
   mpz_mul (out, out, sk->q);
   mpz_add (out, out, oq);
+}
 
+static void
+D2 (MP_INT *out, const MP_INT *in, const rw_priv *sk, int rsel)
+{
+  mpz_t op, oq;
+
+  mpz_init (op);
+  mpz_init (oq);
+  D2t (out, in, sk, rsel, op, oq);
   mpz_clear (op);
   mpz_clear (oq);
 }
@@ -207,7 +214,8 @@ rw_verify (const dckey *key, const char *msg, const char *sig)
   mpz_init (m);
   if (read_mpz (&sig, s)) {
     mpz_clear (s);
-    return 0;
+    mpz_clear (m);
+    return -1;
   }
   E2 (m, s, pk->n);
   D1 (m, m, pk->n);
@@ -220,6 +228,56 @@ rw_verify (const dckey *key, const char *msg, const char *sig)
   return ret;
 }
 
+/* rw_encrypt and rw_verify for many messages, sharing the temporaries,
+   which are sized once for the products mod n */
+static void
+rw_encrypt_batch (const dckey *key, size_t n, const char *const *msgs,
+		  char **ctexts)
+{
+  const rw_pub *pk = (const rw_pub *) key;
+  mpz_t m;
+  size_t i;
+
+  mpz_init2 (m, 2 * mpz_sizeinbase2 (pk->n));
+  for (i = 0; i < n; i++) {
+    ctexts[i] = NULL;
+    if (pre_encrypt (m, msgs[i], pk->nbits))
+      continue;
+    E1 (m, m, pk->n);
+    E2 (m, m, pk->n);
+    cat_mpz (&ctexts[i], m);
+  }
+  mpz_clear (m);
+}
+
+static void
+rw_verify_batch (const dckey *key, size_t n, const char *const *msgs,
+		 const char *const *sigs, int *res)
+{
+  const rw_pub *pk = (const rw_pub *) key;
+  const char *sig;
+  sha1_ctx sc;
+  mpz_t m, s;
+  size_t i;
+
+  mpz_init2 (s, mpz_sizeinbase2 (pk->n));
+  mpz_init2 (m, 2 * mpz_sizeinbase2 (pk->n));
+  for (i = 0; i < n; i++) {
+    sig = sigs[i];
+    if (read_mpz (&sig, s)) {
+      res[i] = -1;
+      continue;
+    }
+    E2 (m, s, pk->n);
+    D1 (m, m, pk->n);
+    sha1_init (&sc);
+    sha1_update (&sc, msgs[i], strlen (msgs[i]));
+    res[i] = post_verify (&sc, m, pk->nbits);
+  }
+  mpz_clear (s);
+  mpz_clear (m);
+}
+
 static void
 rw_free_pub (dckey *key)
 {
@@ -314,6 +372,64 @@ rw_sign (const dckey *key, const char *msg)
   return res;
 }
 
+/* rw_decrypt and rw_sign for many messages.  Each message still takes
+   its own two exponentiations, as the only moduli are p and q and the
+   exponents kp and kq are the same for all; what is shared is the
+   temporaries. */
+static void
+rw_decrypt_batch (const dckey *key, size_t n, const char *const *ctexts,
+		  char **msgs)
+{
+  const rw_priv *sk = k2priv (key);
+  const char *ctext;
+  mpz_t m, op, oq;
+  size_t i;
+
+  mpz_init2 (m, 2 * mpz_sizeinbase2 (sk->n));
+  mpz_init2 (op, mpz_sizeinbase2 (sk->n));
+  mpz_init2 (oq, mpz_sizeinbase2 (sk->n));
+  for (i = 0; i < n; i++) {
+    ctext = ctexts[i];
+    if (read_mpz (&ctext, m)) {
+      msgs[i] = NULL;
+      continue;
+    }
+    D2t (m, m, sk, 0, op, oq);
+    D1 (m, m, sk->n);
+    msgs[i] = post_decrypt (m, sk->nbits);
+  }
+  mpz_clear (m);
+  mpz_clear (op);
+  mpz_clear (oq);
+}
+
+static void
+rw_sign_batch (const dckey *key, size_t n, const char *const *msgs,
+	       char **sigs)
+{
+  const rw_priv *sk = k2priv (key);
+  sha1_ctx sc;
+  mpz_t m, op, oq;
+  size_t i;
+
+  mpz_init2 (m, 2 * mpz_sizeinbase2 (sk->n));
+  mpz_init2 (op, mpz_sizeinbase2 (sk->n));
+  mpz_init2 (oq, mpz_sizeinbase2 (sk->n));
+  for (i = 0; i < n; i++) {
+    sigs[i] = NULL;
+    sha1_init (&sc);
+    sha1_update (&sc, msgs[i], strlen (msgs[i]));
+    if (pre_sign (m, &sc, sk->nbits))
+      continue;
+    E1 (m, m, sk->n);
+    D2t (m, m, sk, prng_getword (), op, oq);
+    cat_mpz (&sigs[i], m);
+  }
+  mpz_clear (m);
+  mpz_clear (op);
+  mpz_clear (oq);
+}
+
 static void
 rw_free_priv (dckey *key)
 {
@@ -452,22 +568,13 @@ rw_keygen (size_t nbits, const char *extra)
   mpz_init (sk->kp);
   mpz_init (sk->kq);
 
-  do {
-    random_bigint (sk->p, (nbits+1)/2);
-    mpz_setbit (sk->p, 0);
-    mpz_setbit (sk->p, 1);
-  } while (!primecheck (sk->p));
+  /* p = 3 mod 4 and q = 7 mod 8, or p = 7 mod 8 and q = 3 mod 8 */
+  random_bigint (sk->p, (nbits+1)/2);
+  prime_search (sk->p, sk->p, 4, 3, 0);
 
   bit2 = ~mpz_get_ui (sk->p) & 4;
-  do {
-    random_bigint (sk->q, nbits/2);
-    mpz_setbit (sk->q, 0);
-    mpz_setbit (sk->q, 1);
-    if (bit2)
-      mpz_setbit (sk->q, 2);
-    else
-      mpz_clrbit (sk->q, 2);
-  } while (!primecheck (sk->q));
+  random_bigint (sk->q, nbits/2);
+  prime_search (sk->q, sk->q, 8, bit2 | 3, 0);
 
   rw_precompute (sk);
   return &sk->key;
@@ -488,5 +595,10 @@ pkvtbl rabin_1 = {
   rw_free_priv,
   rw_import_priv,
 
-  rw_keygen
+  rw_keygen,
+
+  rw_encrypt_batch,
+  rw_verify_batch,
+  rw_decrypt_batch,
+  rw_sign_batch
 };
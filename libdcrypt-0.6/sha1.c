@@ -42,7 +42,7 @@
 
 /* blk0() and blk() perform the initial expand. */
 /* I got the idea of expanding during the round function from SSLeay */
-#define blk0(i) (tmp[i] = getint (&block[4*i]))
+#define blk0(i) (tmp[i] = get32be (&block[4*i]))
 #define blk(i) (tmp[i&15] = rol(tmp[(i+13)&15]^tmp[(i+8)&15] \
     ^tmp[(i+2)&15]^tmp[i&15],1))
 
@@ -73,9 +73,9 @@ sha1_newstate (u_int32_t state[5])
 }
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
-void
-sha1_transform (u_int32_t state[5],
-		const u_char block[64])
+static void
+portable_transform (u_int32_t state[5],
+		    const u_char block[64])
 {
   register u_int32_t a, b, c, d, e;
   u_int32_t tmp[16];
@@ -123,26 +123,253 @@ sha1_transform (u_int32_t state[5],
   state[4] += e;
 }
 
+static void
+portable_blocks (u_int32_t state[5], const u_char *blocks, size_t nblocks)
+{
+  for (; nblocks--; blocks += blocksize)
+    portable_transform (state, blocks);
+}
+
+const sha1_ops sha1_portable = { "portable", NULL, 400, portable_blocks };
+
+/* compression functions, fastest first; the first one whose probe
+   succeeds on this CPU is used unless sha1_setbackend says otherwise */
+const sha1_ops *sha1conf[] = {
+#ifdef DC_HAVE_SHANI
+  &sha1_shani,
+#endif /* DC_HAVE_SHANI */
+  &sha1_portable,
+  NULL
+};
+
+static const sha1_ops *sha1_impl;
+
+static const sha1_ops *
+sha1_implinit (void)
+{
+  const sha1_ops **sp;
+
+  for (sp = sha1conf; *sp; sp++)
+    if (!(*sp)->probe || (*sp)->probe ())
+      return sha1_impl = *sp;
+  return sha1_impl = &sha1_portable;
+}
+
+#define SHA1_IMPL (sha1_impl ? sha1_impl : sha1_implinit ())
+
+const char *
+sha1_backend (void)
+{
+  return SHA1_IMPL->name;
+}
+
+int
+sha1_setbackend (const char *name)
+{
+  const sha1_ops **sp;
+
+  for (sp = sha1conf; *sp; sp++)
+    if (!strcmp ((*sp)->name, name)) {
+      if ((*sp)->probe && !(*sp)->probe ())
+	return -1;
+      sha1_impl = *sp;
+      return 0;
+    }
+  return -1;
+}
+
+void
+sha1_blocks (u_int32_t state[5], const u_char *blocks, size_t nblocks)
+{
+  SHA1_IMPL->blocks (state, blocks, nblocks);
+}
+
+void
+sha1_transform (u_int32_t state[5], const u_char block[64])
+{
+  SHA1_IMPL->blocks (state, block, 1);
+}
+
+/* "none" hands each stream to the compression function in turn */
+static void
+none_mblock (u_int32_t *const states[], const u_char *const blocks[],
+	     size_t nblocks)
+{
+  SHA1_IMPL->blocks (states[0], blocks[0], nblocks);
+}
+
+static const sha1_mbops sha1_mbnone = { "none", NULL, 1, 0, none_mblock };
+
+const sha1_mbops *sha1mbconf[] = {
+#ifdef DC_HAVE_SHA1MB
+  &sha1_avx2,
+  &sha1_sse2,
+#endif /* DC_HAVE_SHA1MB */
+  &sha1_mbnone,
+  NULL
+};
+
+static const sha1_mbops *sha1_mbimpl;
+
+static const sha1_mbops *
+sha1_mbimplinit (void)
+{
+  const sha1_mbops **sp;
+
+  for (sp = sha1mbconf; *sp; sp++)
+    if (!(*sp)->probe || (*sp)->probe ())
+      return sha1_mbimpl = *sp;
+  return sha1_mbimpl = &sha1_mbnone;
+}
+
+#define SHA1_MBIMPL (sha1_mbimpl ? sha1_mbimpl : sha1_mbimplinit ())
+
+const char *
+sha1_mbbackend (void)
+{
+  return SHA1_MBIMPL->name;
+}
+
+int
+sha1_mbsetbackend (const char *name)
+{
+  const sha1_mbops **sp;
+
+  for (sp = sha1mbconf; *sp; sp++)
+    if (!strcmp ((*sp)->name, name)) {
+      if ((*sp)->probe && !(*sp)->probe ())
+	return -1;
+      sha1_mbimpl = *sp;
+      return 0;
+    }
+  return -1;
+}
+
+void
+sha1_mblocks (u_int32_t *const states[], const u_char *const blocks[],
+	      size_t n, size_t nblocks)
+{
+  const sha1_mbops *mb = SHA1_MBIMPL;
+  const sha1_ops *impl = SHA1_IMPL;
+  u_int32_t *st[sha1_mb_maxlanes], spare[5];
+  const u_char *blk[sha1_mb_maxlanes];
+  size_t i;
+  int k;
+
+  /* a kernel call costs the same however many of its lanes are live,
+     so it is only used where it beats that many single-stream calls
+     (with SHA-NI, a half-empty one never does) */
+  for (; n >= (size_t) mb->lanes && mb->cost < mb->lanes * impl->cost;
+       n -= mb->lanes, states += mb->lanes, blocks += mb->lanes)
+    mb->mblock (states, blocks, nblocks);
+  if (n && n < (size_t) mb->lanes && (size_t) mb->cost < n * impl->cost) {
+    for (k = 0; k < mb->lanes; k++) {
+      st[k] = (size_t) k < n ? states[k] : spare;
+      blk[k] = blocks[(size_t) k < n ? k : 0];
+    }
+    mb->mblock (st, blk, nblocks);
+    return;
+  }
+  for (i = 0; i < n; i++)
+    impl->blocks (states[i], blocks[i], nblocks);
+}
+
+/* one message being hashed by sha1_hash_many: whole blocks are taken
+   from the message itself, and the padded end from tail */
+struct sha1_lane {
+  size_t msg;
+  const u_char *p;
+  size_t nfull;
+  int ntail;
+  int tailpos;
+  u_char tail[2 * blocksize];
+  u_int32_t state[5];
+};
+
+static void
+sha1_lane_start (struct sha1_lane *l, size_t msg, const u_char *p,
+		 size_t len)
+{
+  size_t rest = len % blocksize;
+
+  l->msg = msg;
+  l->p = p;
+  l->nfull = len / blocksize;
+  l->ntail = rest + 9 > blocksize ? 2 : 1;
+  l->tailpos = 0;
+  bzero (l->tail, sizeof (l->tail));
+  if (rest)
+    memcpy (l->tail, p + len - rest, rest);
+  l->tail[rest] = 0x80;
+  put64be (l->tail + l->ntail * blocksize - 8, (u_int64_t) len << 3);
+  sha1_newstate (l->state);
+}
+
+void
+sha1_hash_many (void *digests, const void *const msgs[],
+		const size_t lens[], size_t n)
+{
+  struct sha1_lane lanes[sha1_mb_maxlanes];
+  u_int32_t *states[sha1_mb_maxlanes];
+  const u_char *blocks[sha1_mb_maxlanes];
+  size_t next = 0, k, run;
+  int nl = 0, maxl = SHA1_MBIMPL->lanes, i;
+
+  /* each lane takes the next message as soon as its own is done, so
+     long and short messages can be mixed without idling the kernel */
+  for (;;) {
+    for (; nl < maxl && next < n; nl++, next++)
+      sha1_lane_start (&lanes[nl], next, msgs[next], lens[next]);
+    if (!nl)
+      break;
+
+    /* as many blocks as every lane can take without switching between
+       its message and its tail */
+    run = (size_t) -1;
+    for (i = 0; i < nl; i++) {
+      k = lanes[i].nfull ? lanes[i].nfull : (size_t) lanes[i].ntail;
+      if (k < run)
+	run = k;
+    }
+    for (i = 0; i < nl; i++) {
+      states[i] = lanes[i].state;
+      if (lanes[i].nfull) {
+	blocks[i] = lanes[i].p;
+	lanes[i].p += run * blocksize;
+	lanes[i].nfull -= run;
+      }
+      else {
+	blocks[i] = lanes[i].tail + lanes[i].tailpos;
+	lanes[i].tailpos += run * blocksize;
+	lanes[i].ntail -= run;
+      }
+    }
+    sha1_mblocks (states, blocks, nl, run);
+
+    for (i = 0; i < nl; i++)
+      if (!lanes[i].nfull && !lanes[i].ntail) {
+	k = lanes[i].msg;
+	sha1_state2bytes ((u_char *) digests + 20 * k, lanes[i].state);
+	lanes[i--] = lanes[--nl];
+      }
+  }
+  bzero (lanes, sizeof (lanes));
+}
+
 void
 sha1_state2bytes (void *_cp, const u_int32_t state[5])
 {
   u_char *cp = (u_char *) (_cp);
   size_t i;
-  for (i = 0; i < 5; i++) {
-    u_int32_t v = *state++;
-    cp[0] = v >> 24;
-    cp[1] = v >> 16;
-    cp[2] = v >> 8;
-    cp[3] = v;
-    cp += 4;
-  }
+  for (i = 0; i < 5; i++, cp += 4)
+    put32be (cp, state[i]);
 }
 
 static void
-sha1_consume (mdblock *_mdb, const u_char block[64])
+sha1_consume (mdblock *_mdb, const u_char *blocks, size_t nblocks)
 {
   sha1_ctx *sc = (sha1_ctx *) _mdb;
-  sha1_transform (sc->state, block);
+  sha1_blocks (sc->state, blocks, nblocks);
 }
 
 void
@@ -176,57 +403,111 @@ sha1_hash (void *digest, const void *buf, size_t len)
   sha1_final (&sc, digest);
 }
 
+/* RFC 2104's pads, and the outer pad hmac_sha1_final has always used
+   in place of HMAC_OPAD; changing it would break existing tags */
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
+#define HMAC_SHA1_FINAL_OPAD 0x45
+
+/* keys longer than a block are cut to one block, as this code always
+   has, rather than hashed as RFC 2104 says */
+static void
+hmac_sha1_setpads (hmac_sha1_key *hk, const void *key, size_t keylen,
+		   u_char opad)
+{
+  u_char block[64];
+  unsigned i;
+
+  memset (block, HMAC_IPAD, sizeof (block));
+  for (i = 0; i < sizeof (block) && i < keylen; i++)
+    block[i] ^= ((const u_char *) key)[i];
+  sha1_newstate (hk->istate);
+  sha1_blocks (hk->istate, block, 1);
+  for (i = 0; i < sizeof (block); i++)
+    block[i] ^= HMAC_IPAD ^ opad;
+  sha1_newstate (hk->ostate);
+  sha1_blocks (hk->ostate, block, 1);
+  bzero (block, sizeof (block));
+}
+
 void
-hmac_sha1 (const char *key, size_t keylen, 
-	   void *out, const void *data, size_t dlen)
+hmac_sha1_setkey (hmac_sha1_key *hk, const void *key, size_t keylen)
+{
+  hmac_sha1_setpads (hk, key, keylen, HMAC_OPAD);
+}
+
+void
+hmac_sha1_clrkey (hmac_sha1_key *hk)
+{
+  bzero (hk, sizeof (*hk));
+}
+
+void
+hmac_sha1_start (const hmac_sha1_key *hk, sha1_ctx *sc)
+{
+  mdblock_init (&sc->mdb, sha1_consume);
+  sc->mdb.count = 64;
+  memcpy (sc->state, hk->istate, sizeof (sc->state));
+}
+
+void
+hmac_sha1_finish (const hmac_sha1_key *hk, sha1_ctx *sc, u_char out[20])
+{
+  u_char block[64];
+
+  /* the outer hash covers the opad block and the inner digest, so all
+     of it past ostate is one block: digest, padding, and a length of
+     84 bytes */
+  sha1_final (sc, block);
+  block[20] = 0x80;
+  bzero (block + 21, 56 - 21);
+  put64be (block + 56, (64 + 20) * 8);
+  memcpy (sc->state, hk->ostate, sizeof (sc->state));
+  sha1_blocks (sc->state, block, 1);
+  sha1_state2bytes (out, sc->state);
+  bzero (sc->state, sizeof (sc->state));
+  bzero (block, sizeof (block));
+}
+
+void
+hmac_sha1_mac (const hmac_sha1_key *hk, void *out,
+	       const void *data, size_t dlen)
 {
-  char block[64];
   sha1_ctx sc;
-  unsigned i;
 
-  sha1_init (&sc);
-  memset (block, 0x36, sizeof (block));
-  for (i = 0; i < sizeof (block) && (i < keylen); i++)
-    block[i] ^= key[i];
-  sha1_update (&sc, block, sizeof (block));
+  hmac_sha1_start (hk, &sc);
   sha1_update (&sc, data, dlen);
-  sha1_final (&sc, out);
+  hmac_sha1_finish (hk, &sc, out);
+}
 
-  sha1_init (&sc);
-  for (i = 0; i < sizeof (block); i++)
-    block[i] ^= 0x36 ^ 0x5c;
-  sha1_update (&sc, block, sizeof (block));
-  sha1_update (&sc, out, 20);
-  sha1_final (&sc, out);
+void
+hmac_sha1 (const char *key, size_t keylen, 
+	   void *out, const void *data, size_t dlen)
+{
+  hmac_sha1_key hk;
+
+  hmac_sha1_setkey (&hk, key, keylen);
+  hmac_sha1_mac (&hk, out, data, dlen);
+  hmac_sha1_clrkey (&hk);
 }
 
 void
 hmac_sha1_init (const char *key, size_t keylen, sha1_ctx *sc)
 {
-  char block[64];
-  unsigned i;
+  hmac_sha1_key hk;
 
-  sha1_init (sc);
-  memset (block, 0x36, sizeof (block));
-  for (i = 0; (i < sizeof (block)) && (i < keylen); i++)
-    block[i] ^= key[i];
-  sha1_update (sc, block, sizeof (block));
+  hmac_sha1_setkey (&hk, key, keylen);
+  hmac_sha1_start (&hk, sc);
+  hmac_sha1_clrkey (&hk);
 }
 
 void
 hmac_sha1_final (const char *key, size_t keylen, sha1_ctx *scp, u_char out[20])
 { 
-  char block[64];
-  unsigned i;
+  hmac_sha1_key hk;
 
   assert (scp);
-  sha1_final (scp, out);
-
-  sha1_init (scp);
-  memset (block, 0x45, sizeof (block));
-  for (i = 0; (i < sizeof (block)) && (i < keylen); i++)
-    block[i] ^= key[i];
-  sha1_update (scp, block, sizeof (block));
-  sha1_update (scp, out, 20);
-  sha1_final (scp, out);
+  hmac_sha1_setpads (&hk, key, keylen, HMAC_SHA1_FINAL_OPAD);
+  hmac_sha1_finish (&hk, scp, out);
+  hmac_sha1_clrkey (&hk);
 }
@@ -0,0 +1,150 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * Multi-buffer SHA-1: a run of 64-byte blocks of each of several
+ * independent streams per call, with lane k of every vector register belonging to
+ * stream k.  The rounds are those of sha1_transform with each 32-bit
+ * operation widened to a vector, so there are no cross-lane steps
+ * except loading the message words, which is done through a small
+ * transposed copy.  The kernels are written with GCC vector types;
+ * the SSE2 one needs nothing beyond x86-64, and the AVX2 one is
+ * compiled for AVX2 only and probed for at run time.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_SHA1MB
+
+#define VROL(x, n) ((x) << (n) | (x) >> (32 - (n)))
+#define VBLK(i) (W[(i) & 15] = VROL (W[((i) + 13) & 15] ^ W[((i) + 8) & 15] \
+				     ^ W[((i) + 2) & 15] ^ W[(i) & 15], 1))
+
+/* as R0-R4 in sha1.c; the message words are already in W[0..15] */
+#define VR0(v,w,x,y,z,i) z += ((w & (x ^ y)) ^ y) + W[i] + 0x5a827999 \
+     + VROL (v, 5); w = VROL (w, 30);
+#define VR1(v,w,x,y,z,i) z += ((w & (x ^ y)) ^ y) + VBLK (i) + 0x5a827999 \
+     + VROL (v, 5); w = VROL (w, 30);
+#define VR2(v,w,x,y,z,i) z += (w ^ x ^ y) + VBLK (i) + 0x6ed9eba1 \
+     + VROL (v, 5); w = VROL (w, 30);
+#define VR3(v,w,x,y,z,i) z += (((w | x) & y) | (w & x)) + VBLK (i) \
+     + 0x8f1bbcdc + VROL (v, 5); w = VROL (w, 30);
+#define VR4(v,w,x,y,z,i) z += (w ^ x ^ y) + VBLK (i) + 0xca62c1d6 \
+     + VROL (v, 5); w = VROL (w, 30);
+
+#define VROUNDS(a, b, c, d, e)						\
+  VR0 (a, b, c, d, e, 0); VR0 (e, a, b, c, d, 1); VR0 (d, e, a, b, c, 2); \
+  VR0 (c, d, e, a, b, 3); VR0 (b, c, d, e, a, 4); VR0 (a, b, c, d, e, 5); \
+  VR0 (e, a, b, c, d, 6); VR0 (d, e, a, b, c, 7); VR0 (c, d, e, a, b, 8); \
+  VR0 (b, c, d, e, a, 9); VR0 (a, b, c, d, e, 10); VR0 (e, a, b, c, d, 11); \
+  VR0 (d, e, a, b, c, 12); VR0 (c, d, e, a, b, 13); VR0 (b, c, d, e, a, 14); \
+  VR0 (a, b, c, d, e, 15); VR1 (e, a, b, c, d, 16); VR1 (d, e, a, b, c, 17); \
+  VR1 (c, d, e, a, b, 18); VR1 (b, c, d, e, a, 19); VR2 (a, b, c, d, e, 20); \
+  VR2 (e, a, b, c, d, 21); VR2 (d, e, a, b, c, 22); VR2 (c, d, e, a, b, 23); \
+  VR2 (b, c, d, e, a, 24); VR2 (a, b, c, d, e, 25); VR2 (e, a, b, c, d, 26); \
+  VR2 (d, e, a, b, c, 27); VR2 (c, d, e, a, b, 28); VR2 (b, c, d, e, a, 29); \
+  VR2 (a, b, c, d, e, 30); VR2 (e, a, b, c, d, 31); VR2 (d, e, a, b, c, 32); \
+  VR2 (c, d, e, a, b, 33); VR2 (b, c, d, e, a, 34); VR2 (a, b, c, d, e, 35); \
+  VR2 (e, a, b, c, d, 36); VR2 (d, e, a, b, c, 37); VR2 (c, d, e, a, b, 38); \
+  VR2 (b, c, d, e, a, 39); VR3 (a, b, c, d, e, 40); VR3 (e, a, b, c, d, 41); \
+  VR3 (d, e, a, b, c, 42); VR3 (c, d, e, a, b, 43); VR3 (b, c, d, e, a, 44); \
+  VR3 (a, b, c, d, e, 45); VR3 (e, a, b, c, d, 46); VR3 (d, e, a, b, c, 47); \
+  VR3 (c, d, e, a, b, 48); VR3 (b, c, d, e, a, 49); VR3 (a, b, c, d, e, 50); \
+  VR3 (e, a, b, c, d, 51); VR3 (d, e, a, b, c, 52); VR3 (c, d, e, a, b, 53); \
+  VR3 (b, c, d, e, a, 54); VR3 (a, b, c, d, e, 55); VR3 (e, a, b, c, d, 56); \
+  VR3 (d, e, a, b, c, 57); VR3 (c, d, e, a, b, 58); VR3 (b, c, d, e, a, 59); \
+  VR4 (a, b, c, d, e, 60); VR4 (e, a, b, c, d, 61); VR4 (d, e, a, b, c, 62); \
+  VR4 (c, d, e, a, b, 63); VR4 (b, c, d, e, a, 64); VR4 (a, b, c, d, e, 65); \
+  VR4 (e, a, b, c, d, 66); VR4 (d, e, a, b, c, 67); VR4 (c, d, e, a, b, 68); \
+  VR4 (b, c, d, e, a, 69); VR4 (a, b, c, d, e, 70); VR4 (e, a, b, c, d, 71); \
+  VR4 (d, e, a, b, c, 72); VR4 (c, d, e, a, b, 73); VR4 (b, c, d, e, a, 74); \
+  VR4 (a, b, c, d, e, 75); VR4 (e, a, b, c, d, 76); VR4 (d, e, a, b, c, 77); \
+  VR4 (c, d, e, a, b, 78); VR4 (b, c, d, e, a, 79);
+
+/* nblocks blocks for each of the L streams in states[], blocks[]: load
+   the states once, then for each block load the message words
+   lane-wise, run the rounds and add back */
+#define VKERNEL(V, L)							\
+  u_int32_t tmp[16][L] __attribute__ ((aligned (sizeof (V))));		\
+  V a, b, c, d, e, a0, b0, c0, d0, e0, W[16];				\
+  size_t off;								\
+  int i, j;								\
+									\
+  for (j = 0; j < L; j++) {						\
+    a[j] = states[j][0];						\
+    b[j] = states[j][1];						\
+    c[j] = states[j][2];						\
+    d[j] = states[j][3];						\
+    e[j] = states[j][4];						\
+  }									\
+  for (off = 0; nblocks--; off += 64) {					\
+    for (j = 0; j < L; j++)						\
+      for (i = 0; i < 16; i++)						\
+	tmp[i][j] = get32be (blocks[j] + off + 4 * i);			\
+    for (i = 0; i < 16; i++)						\
+      memcpy (&W[i], tmp[i], sizeof (V));				\
+    a0 = a; b0 = b; c0 = c; d0 = d; e0 = e;				\
+    VROUNDS (a, b, c, d, e)						\
+    a += a0; b += b0; c += c0; d += d0; e += e0;			\
+  }									\
+  for (j = 0; j < L; j++) {						\
+    states[j][0] = a[j];						\
+    states[j][1] = b[j];						\
+    states[j][2] = c[j];						\
+    states[j][3] = d[j];						\
+    states[j][4] = e[j];						\
+  }									\
+  bzero (tmp, sizeof (tmp));						\
+  bzero (W, sizeof (W))
+
+typedef u_int32_t sha1_v4 __attribute__ ((vector_size (16)));
+
+static void
+sse2_mblock (u_int32_t *const states[], const u_char *const blocks[],
+	     size_t nblocks)
+{
+  VKERNEL (sha1_v4, 4);
+}
+
+const sha1_mbops sha1_sse2 = { "sse2", NULL, 4, 500, sse2_mblock };
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+
+typedef u_int32_t sha1_v8 __attribute__ ((vector_size (32)));
+
+static void
+avx2_mblock (u_int32_t *const states[], const u_char *const blocks[],
+	     size_t nblocks)
+{
+  VKERNEL (sha1_v8, 8);
+}
+
+#pragma GCC pop_options
+
+static int
+avx2_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+}
+
+const sha1_mbops sha1_avx2 = { "avx2", avx2_probe, 8, 700, avx2_mblock };
+
+#endif /* DC_HAVE_SHA1MB */
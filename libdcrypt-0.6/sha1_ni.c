@@ -0,0 +1,114 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * SHA-1 compression with the Intel SHA extensions.  sha1rnds4 does
+ * four rounds at a time, and sha1msg1/sha1msg2 extend the message
+ * schedule, so one 64-byte block is twenty QR steps below.  The state
+ * stays in registers across all the blocks handed over in one call.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_SHANI
+
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target ("sha,sse4.1")
+
+/* four rounds with round function f: ein picks up the message words
+   m (and, through sha1nexte, the rotated a of four rounds back), and
+   eout saves abcd for the next step */
+#define QR(ein, eout, m, f)				\
+  ein = _mm_sha1nexte_epu32 (ein, m);			\
+  eout = abcd;						\
+  abcd = _mm_sha1rnds4_epu32 (abcd, ein, f)
+#define M1(a, b) a = _mm_sha1msg1_epu32 (a, b)
+#define M2(a, b) a = _mm_sha1msg2_epu32 (a, b)
+#define MX(a, b) a = _mm_xor_si128 (a, b)
+
+static void
+shani_blocks (u_int32_t state[5], const u_char *blocks, size_t nblocks)
+{
+  const __m128i bswap = _mm_set_epi64x (0x0001020304050607ULL,
+					0x08090a0b0c0d0e0fULL);
+  __m128i abcd, abcd0, e0, e1, e00, m0, m1, m2, m3;
+
+  abcd = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) state), 0x1b);
+  e0 = _mm_set_epi32 (state[4], 0, 0, 0);
+
+  for (; nblocks--; blocks += 64) {
+    abcd0 = abcd;
+    e00 = e0;
+
+    m0 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) blocks), bswap);
+    m1 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 16)),
+			   bswap);
+    m2 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 32)),
+			   bswap);
+    m3 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 48)),
+			   bswap);
+
+    /* rounds 0-3 take e from the state rather than from sha1nexte */
+    e0 = _mm_add_epi32 (e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32 (abcd, e0, 0);
+
+    QR (e1, e0, m1, 0); M1 (m0, m1);
+    QR (e0, e1, m2, 0); M1 (m1, m2); MX (m0, m2);
+    QR (e1, e0, m3, 0); M2 (m0, m3); M1 (m2, m3); MX (m1, m3);
+    QR (e0, e1, m0, 0); M2 (m1, m0); M1 (m3, m0); MX (m2, m0);
+    QR (e1, e0, m1, 1); M2 (m2, m1); M1 (m0, m1); MX (m3, m1);
+    QR (e0, e1, m2, 1); M2 (m3, m2); M1 (m1, m2); MX (m0, m2);
+    QR (e1, e0, m3, 1); M2 (m0, m3); M1 (m2, m3); MX (m1, m3);
+    QR (e0, e1, m0, 1); M2 (m1, m0); M1 (m3, m0); MX (m2, m0);
+    QR (e1, e0, m1, 1); M2 (m2, m1); M1 (m0, m1); MX (m3, m1);
+    QR (e0, e1, m2, 2); M2 (m3, m2); M1 (m1, m2); MX (m0, m2);
+    QR (e1, e0, m3, 2); M2 (m0, m3); M1 (m2, m3); MX (m1, m3);
+    QR (e0, e1, m0, 2); M2 (m1, m0); M1 (m3, m0); MX (m2, m0);
+    QR (e1, e0, m1, 2); M2 (m2, m1); M1 (m0, m1); MX (m3, m1);
+    QR (e0, e1, m2, 2); M2 (m3, m2); M1 (m1, m2); MX (m0, m2);
+    QR (e1, e0, m3, 3); M2 (m0, m3); M1 (m2, m3); MX (m1, m3);
+    QR (e0, e1, m0, 3); M2 (m1, m0); M1 (m3, m0); MX (m2, m0);
+    QR (e1, e0, m1, 3); M2 (m2, m1); MX (m3, m1);
+    QR (e0, e1, m2, 3); M2 (m3, m2);
+    QR (e1, e0, m3, 3);
+
+    e0 = _mm_sha1nexte_epu32 (e0, e00);
+    abcd = _mm_add_epi32 (abcd, abcd0);
+  }
+
+  _mm_storeu_si128 ((__m128i *) state, _mm_shuffle_epi32 (abcd, 0x1b));
+  state[4] = _mm_extract_epi32 (e0, 3);
+}
+
+#pragma GCC pop_options
+
+static int
+shani_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("sha")
+    && __builtin_cpu_supports ("sse4.1");
+}
+
+const sha1_ops sha1_shani = { "shani", shani_probe, 120, shani_blocks };
+
+#endif /* DC_HAVE_SHANI */
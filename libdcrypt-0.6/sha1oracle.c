@@ -40,25 +40,43 @@
 
 #include "dcinternal.h"
 
+/* all the states see the same blocks, except that the first one starts
+   with each state's own index; they are advanced together through
+   sha1_mblocks, sha1_mb_maxlanes at a time */
 static void
-sha1oracle_consume (struct mdblock *mp, const u_char block[64])
+sha1oracle_consume (struct mdblock *mp, const u_char *blocks, size_t nblocks)
 {
   sha1oracle_ctx *soc = (sha1oracle_ctx *) mp;
-  size_t i;
+  u_int32_t *states[sha1_mb_maxlanes];
+  const u_char *bp[sha1_mb_maxlanes];
+  u_char wblock[sha1_mb_maxlanes][64];
+  size_t i, j, n;
+  int first = soc->firstblock;
 
-  if (soc->firstblock) {
-    u_char wblock[64];
-    memcpy (wblock, block, sizeof (wblock));
-    for (i = 0; i < soc->nstate; i++) {
-      puthyper (wblock, i);
-      sha1_transform (soc->state[i], wblock);
+  for (i = 0; i < soc->nstate; i += n) {
+    n = soc->nstate - i;
+    if (n > sha1_mb_maxlanes)
+      n = sha1_mb_maxlanes;
+    for (j = 0; j < n; j++) {
+      states[j] = soc->state[i + j];
+      if (first) {
+	memcpy (wblock[j], blocks, 64);
+	put64be (wblock[j], i + j);
+	bp[j] = wblock[j];
+      }
+    }
+    if (first)
+      sha1_mblocks (states, bp, n, 1);
+    if (nblocks > (size_t) first) {
+      for (j = 0; j < n; j++)
+	bp[j] = blocks + 64 * first;
+      sha1_mblocks (states, bp, n, nblocks - first);
     }
+  }
+  if (first) {
+    bzero (wblock, sizeof (wblock));
     soc->firstblock = 0;
-    return;
   }
-
-  for (i = 0; i < soc->nstate; i++)
-    sha1_transform (soc->state[i], block);
 }
 
 void
@@ -68,12 +86,15 @@ sha1oracle_init (sha1oracle_ctx *soc, size_t nbytes, u_int64_t idx)
   size_t i;
 
   mdblock_init (&soc->mdb, sha1oracle_consume);
-  puthyper (prefix + 8, idx);
+  put64be (prefix + 8, idx);
   mdblock_update (&soc->mdb, prefix, sizeof (prefix));
   soc->firstblock = 1;
   soc->nbytes = nbytes;
   soc->nstate = (nbytes + 19) / 20;
-  soc->state = malloc (20 * soc->nstate);
+  if (soc->nstate <= sha1oracle_inline)
+    soc->state = soc->istate;
+  else
+    soc->state = malloc (20 * soc->nstate);
   for (i = 0; i < soc->nstate; i++)
     sha1_newstate (soc->state[i]);
 } 
@@ -100,6 +121,7 @@ sha1oracle_final (sha1oracle_ctx *soc, u_char *out)
   }
 
   bzero (soc->state, soc->nstate * 20);
-  free (soc->state);
+  if (soc->state != soc->istate)
+    free (soc->state);
   soc->state = NULL;
 }
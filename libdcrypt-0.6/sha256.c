@@ -0,0 +1,324 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * SHA-256 (FIPS 180-2) and HMAC-SHA-256 (RFC 2104), on the same
+ * mdblock framework as sha1.c.  The portable compression function
+ * keeps only a 16-word window of the message schedule, extending it as
+ * the rounds go, and is unrolled eight rounds at a time so that the
+ * working variables rotate back into place at the end of each pass.
+ * sha256_ni.c has the Intel SHA extensions version.
+ */
+
+#include "dcinternal.h"
+
+enum { blocksize = 64 };
+
+static const u_int32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+const u_int32_t *const sha256_roundconst = sha256_k;
+
+#define ror(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x) (ror (x, 2) ^ ror (x, 13) ^ ror (x, 22))
+#define S1(x) (ror (x, 6) ^ ror (x, 11) ^ ror (x, 25))
+#define s0(x) (ror (x, 7) ^ ror (x, 18) ^ ((x) >> 3))
+#define s1(x) (ror (x, 17) ^ ror (x, 19) ^ ((x) >> 10))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* W0 loads message word i; W1 extends the schedule in place */
+#define W0(i) (tmp[i] = get32be (&block[4 * (i)]))
+#define W1(i) (tmp[(i) & 15] += s1 (tmp[((i) - 2) & 15])		\
+	       + tmp[((i) - 7) & 15] + s0 (tmp[((i) - 15) & 15]))
+
+#define R(a, b, c, d, e, f, g, h, i, w)					\
+  t = h + S1 (e) + CH (e, f, g) + sha256_k[i] + (w);			\
+  d += t;								\
+  h = t + S0 (a) + MAJ (a, b, c);
+
+#define R8(i, W)							\
+  R (a, b, c, d, e, f, g, h, (i) + 0, W ((i) + 0));			\
+  R (h, a, b, c, d, e, f, g, (i) + 1, W ((i) + 1));			\
+  R (g, h, a, b, c, d, e, f, (i) + 2, W ((i) + 2));			\
+  R (f, g, h, a, b, c, d, e, (i) + 3, W ((i) + 3));			\
+  R (e, f, g, h, a, b, c, d, (i) + 4, W ((i) + 4));			\
+  R (d, e, f, g, h, a, b, c, (i) + 5, W ((i) + 5));			\
+  R (c, d, e, f, g, h, a, b, (i) + 6, W ((i) + 6));			\
+  R (b, c, d, e, f, g, h, a, (i) + 7, W ((i) + 7));
+
+void
+sha256_newstate (u_int32_t state[8])
+{
+  state[0] = 0x6a09e667;
+  state[1] = 0xbb67ae85;
+  state[2] = 0x3c6ef372;
+  state[3] = 0xa54ff53a;
+  state[4] = 0x510e527f;
+  state[5] = 0x9b05688c;
+  state[6] = 0x1f83d9ab;
+  state[7] = 0x5be0cd19;
+}
+
+static void
+portable_blocks (u_int32_t state[8], const u_char *block, size_t nblocks)
+{
+  u_int32_t a, b, c, d, e, f, g, h, t;
+  u_int32_t tmp[16];
+  int i;
+
+  for (; nblocks--; block += blocksize) {
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    R8 (0, W0);
+    R8 (8, W0);
+    for (i = 16; i < 64; i += 8) {
+      R8 (i, W1);
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+  bzero (tmp, sizeof (tmp));
+}
+
+const sha256_ops sha256_portable = { "portable", NULL, portable_blocks };
+
+/* compression functions, fastest first; the first one whose probe
+   succeeds on this CPU is used unless sha256_setbackend says otherwise */
+const sha256_ops *sha256conf[] = {
+#ifdef DC_HAVE_SHANI
+  &sha256_shani,
+#endif /* DC_HAVE_SHANI */
+  &sha256_portable,
+  NULL
+};
+
+static const sha256_ops *sha256_impl;
+
+static const sha256_ops *
+sha256_implinit (void)
+{
+  const sha256_ops **sp;
+
+  for (sp = sha256conf; *sp; sp++)
+    if (!(*sp)->probe || (*sp)->probe ())
+      return sha256_impl = *sp;
+  return sha256_impl = &sha256_portable;
+}
+
+#define SHA256_IMPL (sha256_impl ? sha256_impl : sha256_implinit ())
+
+const char *
+sha256_backend (void)
+{
+  return SHA256_IMPL->name;
+}
+
+int
+sha256_setbackend (const char *name)
+{
+  const sha256_ops **sp;
+
+  for (sp = sha256conf; *sp; sp++)
+    if (!strcmp ((*sp)->name, name)) {
+      if ((*sp)->probe && !(*sp)->probe ())
+	return -1;
+      sha256_impl = *sp;
+      return 0;
+    }
+  return -1;
+}
+
+static void
+sha256_consume (mdblock *_mdb, const u_char *blocks, size_t nblocks)
+{
+  sha256_ctx *sc = (sha256_ctx *) _mdb;
+  SHA256_IMPL->blocks (sc->state, blocks, nblocks);
+}
+
+void
+sha256_init (sha256_ctx *sc)
+{
+  mdblock_init (&sc->mdb, sha256_consume);
+  sha256_newstate (sc->state);
+}
+
+void
+sha256_update (sha256_ctx *sc, const void *bytes, size_t len)
+{
+  mdblock_update (&sc->mdb, bytes, len);
+}
+
+void
+sha256_final (sha256_ctx *sc, u_char out[32])
+{
+  size_t i;
+
+  mdblock_finish (&sc->mdb, 1);
+  for (i = 0; i < 8; i++)
+    put32be (out + 4 * i, sc->state[i]);
+  bzero (sc->state, sizeof (sc->state));
+}
+
+void
+sha256_hash (void *digest, const void *buf, size_t len)
+{
+  sha256_ctx sc;
+
+  sha256_init (&sc);
+  sha256_update (&sc, buf, len);
+  sha256_final (&sc, digest);
+}
+
+/* keys longer than a block are hashed first, as RFC 2104 says */
+static void
+hmac_sha256_pad (u_char block[blocksize], const void *key, size_t keylen,
+		 int pad)
+{
+  u_char kh[sha256_hashsize];
+  size_t i;
+
+  if (keylen > blocksize) {
+    sha256_hash (kh, key, keylen);
+    key = kh;
+    keylen = sizeof (kh);
+  }
+  memset (block, pad, blocksize);
+  for (i = 0; i < keylen; i++)
+    block[i] ^= ((const u_char *) key)[i];
+  bzero (kh, sizeof (kh));
+}
+
+void
+hmac_sha256_setkey (hmac_sha256_key *hk, const void *key, size_t keylen)
+{
+  u_char block[blocksize];
+
+  hmac_sha256_pad (block, key, keylen, 0x36);
+  sha256_newstate (hk->istate);
+  SHA256_IMPL->blocks (hk->istate, block, 1);
+  hmac_sha256_pad (block, key, keylen, 0x5c);
+  sha256_newstate (hk->ostate);
+  SHA256_IMPL->blocks (hk->ostate, block, 1);
+  bzero (block, sizeof (block));
+}
+
+void
+hmac_sha256_clrkey (hmac_sha256_key *hk)
+{
+  bzero (hk, sizeof (*hk));
+}
+
+void
+hmac_sha256_start (const hmac_sha256_key *hk, sha256_ctx *sc)
+{
+  mdblock_init (&sc->mdb, sha256_consume);
+  sc->mdb.count = blocksize;
+  memcpy (sc->state, hk->istate, sizeof (sc->state));
+}
+
+void
+hmac_sha256_finish (const hmac_sha256_key *hk, sha256_ctx *sc,
+		    u_char out[32])
+{
+  u_char block[blocksize];
+  size_t i;
+
+  /* as for SHA-1, the outer hash past ostate is a single block */
+  sha256_final (sc, block);
+  block[sha256_hashsize] = 0x80;
+  bzero (block + sha256_hashsize + 1, blocksize - 8 - sha256_hashsize - 1);
+  put64be (block + blocksize - 8, (blocksize + sha256_hashsize) * 8);
+  memcpy (sc->state, hk->ostate, sizeof (sc->state));
+  SHA256_IMPL->blocks (sc->state, block, 1);
+  for (i = 0; i < 8; i++)
+    put32be (out + 4 * i, sc->state[i]);
+  bzero (sc->state, sizeof (sc->state));
+  bzero (block, sizeof (block));
+}
+
+void
+hmac_sha256_mac (const hmac_sha256_key *hk, void *out,
+		 const void *data, size_t dlen)
+{
+  sha256_ctx sc;
+
+  hmac_sha256_start (hk, &sc);
+  sha256_update (&sc, data, dlen);
+  hmac_sha256_finish (hk, &sc, out);
+}
+
+void
+hmac_sha256_init (const void *key, size_t keylen, sha256_ctx *sc)
+{
+  hmac_sha256_key hk;
+
+  hmac_sha256_setkey (&hk, key, keylen);
+  hmac_sha256_start (&hk, sc);
+  hmac_sha256_clrkey (&hk);
+}
+
+void
+hmac_sha256_final (const void *key, size_t keylen, sha256_ctx *sc,
+		   u_char out[32])
+{
+  hmac_sha256_key hk;
+
+  hmac_sha256_setkey (&hk, key, keylen);
+  hmac_sha256_finish (&hk, sc, out);
+  hmac_sha256_clrkey (&hk);
+}
+
+void
+hmac_sha256 (const void *key, size_t keylen,
+	     void *out, const void *data, size_t dlen)
+{
+  hmac_sha256_key hk;
+
+  hmac_sha256_setkey (&hk, key, keylen);
+  hmac_sha256_mac (&hk, out, data, dlen);
+  hmac_sha256_clrkey (&hk);
+}
@@ -0,0 +1,116 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ */
+
+/*
+ * SHA-256 compression with the Intel SHA extensions.  The state is
+ * kept as the ABEF and CDGH halves sha256rnds2 works on; each QR step
+ * below is four rounds (two sha256rnds2), and extends the message
+ * schedule with sha256msg1/sha256msg2 four words ahead.
+ */
+
+#include "dcinternal.h"
+
+#ifdef DC_HAVE_SHANI
+
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target ("sha,sse4.1")
+
+/* four rounds on message words mc; mn gets mc's contribution to its
+   extension (W[t] += W[t-7], then sha256msg2), and mp the sha256msg1
+   half of its own */
+#define QR(i, mc)							\
+  msg = _mm_add_epi32 (mc, _mm_loadu_si128 ((const __m128i *)		\
+					    (sha256_roundconst + (i))));	\
+  cdgh = _mm_sha256rnds2_epu32 (cdgh, abef, msg);			\
+  msg = _mm_shuffle_epi32 (msg, 0x0e);					\
+  abef = _mm_sha256rnds2_epu32 (abef, cdgh, msg)
+#define M2(mn, mc, mp)							\
+  mn = _mm_add_epi32 (mn, _mm_alignr_epi8 (mc, mp, 4));			\
+  mn = _mm_sha256msg2_epu32 (mn, mc)
+#define M1(mp, mc) mp = _mm_sha256msg1_epu32 (mp, mc)
+
+static void
+shani_blocks (u_int32_t state[8], const u_char *blocks, size_t nblocks)
+{
+  const __m128i bswap = _mm_set_epi64x (0x0c0d0e0f08090a0bULL,
+					0x0405060700010203ULL);
+  __m128i abef, cdgh, abef0, cdgh0, msg, t, m0, m1, m2, m3;
+
+  /* state[] is ABCD EFGH; sha256rnds2 wants ABEF and CDGH */
+  t = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) state), 0xb1);
+  cdgh = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) (state + 4)),
+			    0x1b);
+  abef = _mm_alignr_epi8 (t, cdgh, 8);
+  cdgh = _mm_blend_epi16 (cdgh, t, 0xf0);
+
+  for (; nblocks--; blocks += 64) {
+    abef0 = abef;
+    cdgh0 = cdgh;
+
+    m0 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) blocks), bswap);
+    m1 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 16)),
+			   bswap);
+    m2 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 32)),
+			   bswap);
+    m3 = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + 48)),
+			   bswap);
+
+    QR (0, m0);
+    QR (4, m1); M1 (m0, m1);
+    QR (8, m2); M1 (m1, m2);
+    QR (12, m3); M2 (m0, m3, m2); M1 (m2, m3);
+    QR (16, m0); M2 (m1, m0, m3); M1 (m3, m0);
+    QR (20, m1); M2 (m2, m1, m0); M1 (m0, m1);
+    QR (24, m2); M2 (m3, m2, m1); M1 (m1, m2);
+    QR (28, m3); M2 (m0, m3, m2); M1 (m2, m3);
+    QR (32, m0); M2 (m1, m0, m3); M1 (m3, m0);
+    QR (36, m1); M2 (m2, m1, m0); M1 (m0, m1);
+    QR (40, m2); M2 (m3, m2, m1); M1 (m1, m2);
+    QR (44, m3); M2 (m0, m3, m2); M1 (m2, m3);
+    QR (48, m0); M2 (m1, m0, m3); M1 (m3, m0);
+    QR (52, m1); M2 (m2, m1, m0);
+    QR (56, m2); M2 (m3, m2, m1);
+    QR (60, m3);
+
+    abef = _mm_add_epi32 (abef, abef0);
+    cdgh = _mm_add_epi32 (cdgh, cdgh0);
+  }
+
+  /* back to ABCD EFGH */
+  t = _mm_shuffle_epi32 (abef, 0x1b);
+  cdgh = _mm_shuffle_epi32 (cdgh, 0xb1);
+  _mm_storeu_si128 ((__m128i *) state, _mm_blend_epi16 (t, cdgh, 0xf0));
+  _mm_storeu_si128 ((__m128i *) (state + 4), _mm_alignr_epi8 (cdgh, t, 8));
+}
+
+#pragma GCC pop_options
+
+static int
+shani_probe (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("sha")
+    && __builtin_cpu_supports ("sse4.1");
+}
+
+const sha256_ops sha256_shani = { "shani", shani_probe, shani_blocks };
+
+#endif /* DC_HAVE_SHANI */
@@ -25,10 +25,12 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <assert.h>
+#include <string.h>
 
 #include <stdio.h>
-#include "dcrypt.h"
+#include "dcinternal.h"
 
 /* this was needed for MP_INT (in mpz_dump, see below), so now
  * we can do without it
@@ -55,11 +57,261 @@ ri (void)
   prng_seed (&rid, sizeof (rid));
 }
 
+/* the streaming coder on len bytes of data, fed in pieces of every
+   size from 1 to 70: the text must be the armor64 of data broken into
+   lines, and must decode to data again, with CRLF line ends too */
+static void
+check_armor64_stream (const u_char *data, size_t len)
+{
+  armor64_enc ae;
+  armor64_dec ad;
+  char text[2 * 1024], crlf[3 * 1024], *s;
+  u_char out[1024];
+  size_t i, j, k, piece, tl, cl;
+  ssize_t n;
+
+  assert (len <= sizeof (out) && armor64_encmax (len) + 6 <= sizeof (text));
+  s = armor64 (data, len);
+  for (piece = 1; piece <= 70; piece++) {
+    armor64_encinit (&ae);
+    for (i = tl = 0; i < len; i += piece)
+      tl += armor64_encupdate (&ae, text + tl, data + i,
+			       len - i < piece ? len - i : piece);
+    tl += armor64_encfinal (&ae, text + tl);
+    for (i = j = 0; s[i]; i++) {
+      assert (text[j++] == s[i]);
+      if (i % armor64_linelen == armor64_linelen - 1 || !s[i + 1])
+	assert (text[j++] == '\n');
+    }
+    assert (j == tl);
+
+    for (i = cl = 0; i < tl; i++) {
+      if (text[i] == '\n')
+	crlf[cl++] = '\r';
+      crlf[cl++] = text[i];
+    }
+    armor64_decinit (&ad);
+    for (i = k = 0; i < cl; i += piece) {
+      n = armor64_decupdate (&ad, out + k, crlf + i,
+			     cl - i < piece ? cl - i : piece);
+      assert (n >= 0);
+      k += n;
+    }
+    assert (!armor64_decfinal (&ad) && k == len && !memcmp (out, data, len));
+  }
+  free (s);
+
+  /* truncated, overpadded, and with data after the padding */
+  armor64_decinit (&ad);
+  assert (armor64_decupdate (&ad, out, "QUJD\nQQ", 7) == 3);
+  assert (armor64_decfinal (&ad) == -1);
+  armor64_decinit (&ad);
+  assert (armor64_decupdate (&ad, out, "QUI==", 5) == -1);
+  armor64_decinit (&ad);
+  assert (armor64_decupdate (&ad, out, "QQ==QUJD", 8) == -1);
+  armor64_decinit (&ad);
+  assert (armor64_decupdate (&ad, out, "QQ=\n=\n", 6) == 1);
+  assert (!armor64_decfinal (&ad) && out[0] == 'A');
+}
+
+/* base64 through one backend against the portable code: every length
+   up to a few vectors, every byte value in every place of a string,
+   and strings that end on a page boundary, with nothing mapped after */
+static void
+check_armor64 (const char *name)
+{
+  enum { maxlen = 200 };
+  u_char data[maxlen], out[maxlen], ref[maxlen];
+  char *s, *r, *page;
+  ssize_t n, rn, rl;
+  size_t len, i;
+  int c, pg = getpagesize ();
+
+  if (armor64_setbackend (name) == -1) {
+    printf ("  %-10s not supported on this CPU, skipped\n", name);
+    return;
+  }
+  for (i = 0; i < maxlen; i++)
+    data[i] = i * 37 + (i >> 3);
+
+  for (len = 0; len < maxlen; len++) {
+    armor64_setbackend ("portable");
+    r = armor64 (data, len);
+    armor64_setbackend (name);
+    s = armor64 (data, len);
+    assert (!strcmp (s, r));
+    assert (armor64len (s) == (ssize_t) strlen (s));
+    assert (dearmor64len (s) == (ssize_t) len);
+    assert (dearmor64 (out, s) == (ssize_t) len);
+    assert (!memcmp (out, data, len));
+    free (r);
+    free (s);
+  }
+
+  s = armor64 (data, 120);
+  for (i = 0; i < strlen (s); i++)
+    for (c = 1; c < 256; c++) {
+      r = strdup (s);
+      r[i] = c;
+      armor64_setbackend ("portable");
+      rn = dearmor64len (r);
+      rl = armor64len (r);
+      if (rn >= 0)
+	assert (dearmor64 (ref, r) == rn);
+      armor64_setbackend (name);
+      assert (dearmor64len (r) == rn);
+      assert (armor64len (r) == rl);
+      n = dearmor64 (out, r);
+      assert (n == rn || rn < 0);
+      assert (rn < 0 || !memcmp (out, ref, n));
+      free (r);
+    }
+  free (s);
+
+  page = mmap (NULL, 2 * pg, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert (page != MAP_FAILED);
+  assert (!mprotect (page + pg, pg, PROT_NONE));
+  for (len = 0; len < 64; len++) {
+    s = armor64 (data, len);
+    r = page + pg - strlen (s) - 1;
+    strcpy (r, s);
+    assert (dearmor64len (r) == (ssize_t) len);
+    assert (dearmor64 (out, r) == (ssize_t) len);
+    assert (!memcmp (out, data, len));
+    free (s);
+  }
+  munmap (page, 2 * pg);
+
+  check_armor64_stream (data, maxlen);
+  printf ("  %-10s OK\n", name);
+}
+
 int
 main (int argc, char **argv)
 {
+  /* before GMP allocates anything, so the tests below run on it */
+  mpzpool_install ();
   ri ();
 
+  {
+    const char *backend = armor64_backend ();
+
+    printf ("base64 implementations (default %s):\n", backend);
+    check_armor64 ("avx2");
+    check_armor64 ("ssse3");
+    check_armor64 ("portable");
+    armor64_setbackend (backend);
+  }
+
+  {
+    const char msg[] = "attack at dawn";
+    char *c, *p, *s;
+    dckey *pk, *pk2;
+    int i;
+
+    /* ElGamal with and without the fixed-base tables, each way round */
+    pk = dckeygen (DC_ELGAMAL, 1024, NULL);
+    assert (pk);
+    p = dcexport_pub (pk);
+    pk2 = dcimport_pub (p);
+    assert (pk2);
+    xfree (p);
+    for (i = 0; i < 4; i++) {
+      eg_fixedbase = i & 1;
+      c = dcencrypt (pk2, msg);
+      p = dcsign (pk, msg);
+      assert (c && p);
+      eg_fixedbase = !(i & 1);
+      s = dcdecrypt (pk, c);
+      assert (s && !strcmp (s, msg));
+      assert (!dcverify (pk2, msg, p));
+      assert (dcverify (pk2, "attack at dusk", p));
+      xfree (c);
+      xfree (p);
+      xfree (s);
+    }
+    eg_fixedbase = 1;
+    dcfree (pk);
+    dcfree (pk2);
+    printf ("ElGamal fixed-base tables: OK\n");
+
+    /* parameters from a fresh safe prime */
+    p = (char *) eg_paramgen (512);
+    assert (p);
+    pk = dckeygen (DC_ELGAMAL, 512, p);
+    assert (pk);
+    xfree (p);
+    c = dcencrypt (pk, msg);
+    s = dcdecrypt (pk, c);
+    assert (s && !strcmp (s, msg));
+    xfree (c);
+    xfree (s);
+    dcfree (pk);
+    printf ("ElGamal parameter generation: OK\n");
+  }
+
+  {
+    /* prime_search finds what a walk along the progression finds,
+       whatever the number of threads; the small starts take the path
+       that does not sieve, and their answers are known; the last is
+       found past the first sieve window */
+    static const struct {
+      const char *start;
+      u_long step, rem;
+      int safe;
+      const char *least;
+    } ps[] = {
+      { "2", 4, 3, 0, "3" },
+      { "3e8", 4, 3, 0, "3fb" },
+      { "c6a32f42bc66323ac2232d710b7880d7ae0b65170cb76f5acec8129282e394bd"
+	"8dea3aa4c08a607352d095151c4a09caeeee318369ca47e7582600e9111f4efd",
+	4, 3, 0, NULL },
+      { "87cca836666b98e85f0635a092c780ae49346aab9a4130c7e437eaf0db15976c"
+	"381b78fe811870038bcd1acba164c2670b9f15ecbbd6b49e746f25d427837704",
+	8, 7, 0, NULL },
+      { "5", 12, 11, 1, "b" },
+      { "3e8", 12, 11, 1, "3fb" },
+      { "f0014aa37cd08f3022b82eb75185875c88639bac9882bfe9", 12, 11, 1,
+	NULL },
+      { "fd5db41d9cae9bebf5ccb6e36fea062b95228ccf415353fd5380b6cc38e29ed0",
+	12, 11, 1, NULL },
+    };
+    mpz_t start, p1, p4, q, w;
+    size_t i;
+
+    mpz_init (start);
+    mpz_init (p1);
+    mpz_init (p4);
+    mpz_init (q);
+    mpz_init (w);
+    for (i = 0; i < sizeof (ps) / sizeof (ps[0]); i++) {
+      mpz_set_str (start, ps[i].start, 16);
+      prime_nthreads = 1;
+      prime_search (p1, start, ps[i].step, ps[i].rem, ps[i].safe);
+      prime_nthreads = 4;
+      prime_search (p4, start, ps[i].step, ps[i].rem, ps[i].safe);
+      assert (!mpz_cmp (p1, p4));
+
+      mpz_add_ui (w, start, (ps[i].rem + ps[i].step
+			     - mpz_fdiv_ui (start, ps[i].step)) % ps[i].step);
+      while (ps[i].safe ? !sprimecheck (w, q) : !primecheck (w))
+	mpz_add_ui (w, w, ps[i].step);
+      assert (!mpz_cmp (p1, w));
+      if (ps[i].least) {
+	mpz_set_str (w, ps[i].least, 16);
+	assert (!mpz_cmp (p1, w));
+      }
+    }
+    prime_nthreads = 0;
+    mpz_clear (start);
+    mpz_clear (p1);
+    mpz_clear (p4);
+    mpz_clear (q);
+    mpz_clear (w);
+    printf ("Prime search, 1 and 4 threads: OK\n");
+  }
+
   {
     const char msg[] = "attack at dawn";
     char *s, *p;
@@ -113,5 +365,65 @@ main (int argc, char **argv)
     dcfree (pk2);
   }
 
+  {
+    enum { nbatch = 100 };
+    const char *msgs[nbatch], *sigs[nbatch];
+    char *ctexts[nbatch], *ptexts[nbatch], buf[nbatch][32];
+    int res[nbatch];
+    dckey *pk, *sk;
+    char *p, *s;
+    int i, t;
+
+    sk = dckeygen (DC_RABIN, 1024, NULL);
+    p = dcexport_pub (sk);
+    pk = dcimport_pub (p);
+    assert (sk && pk);
+    xfree (p);
+    for (i = 0; i < nbatch; i++) {
+      sprintf (buf[i], "manifest entry %d", i);
+      msgs[i] = buf[i];
+      sigs[i] = dcsign (sk, msgs[i]);
+      assert (sigs[i]);
+    }
+    /* a signature on another message, and one that is not a number */
+    s = (char *) sigs[7];
+    sigs[7] = sigs[8];
+    sigs[nbatch - 1] = "signature";
+
+    for (t = 1; t <= 4; t++) {
+      assert (dcverify_batch (pk, nbatch, msgs, sigs, res, t) == 2);
+      for (i = 0; i < nbatch; i++)
+	assert (res[i] == dcverify (pk, msgs[i], sigs[i]));
+      assert (res[7] && res[nbatch - 1] && !res[8]);
+
+      assert (!dcencrypt_batch (pk, nbatch, msgs, ctexts, t));
+      assert (!dcdecrypt_batch (sk, nbatch, (const char *const *) ctexts,
+				ptexts, t));
+      for (i = 0; i < nbatch; i++) {
+	assert (!strcmp (ptexts[i], msgs[i]));
+	xfree (ptexts[i]);
+	xfree (ctexts[i]);
+      }
+
+      assert (!dcsign_batch (sk, nbatch, msgs, ctexts, t));
+      for (i = 0; i < nbatch; i++) {
+	assert (!dcverify (pk, msgs[i], ctexts[i]));
+	xfree (ctexts[i]);
+      }
+    }
+    ctexts[0] = "0x1234";
+    ctexts[1] = "plaintext";
+    assert (dcdecrypt_batch (sk, 2, (const char *const *) ctexts,
+			     ptexts, 1) == 2);
+    assert (!ptexts[0] && !ptexts[1]);
+
+    sigs[7] = s;
+    for (i = 0; i < nbatch - 1; i++)
+      xfree ((char *) sigs[i]);
+    dcfree (sk);
+    dcfree (pk);
+    printf ("Rabin batches: OK\n");
+  }
+
   return 0;
 }
@@ -0,0 +1,418 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "dcinternal.h"
+
+/* FIPS-197, Appendix C */
+static const u_char kat_pt[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+static const u_char kat_ct[3][16] = {
+  { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+  { 0xdd, 0xa9, 0x7c, 0xa4, 0x86, 0x4c, 0xdf, 0xe0,
+    0x6e, 0xaf, 0x70, 0xa0, 0xec, 0x0d, 0x71, 0x91 },
+  { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+    0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 }
+};
+
+#define MAXLEN 1200
+
+static void
+kat (void)
+{
+  u_char key[32], buf[16];
+  aes_ctx aes;
+  aes_ectx eaes;
+  int i, k;
+
+  for (i = 0; i < 32; i++)
+    key[i] = i;
+  for (k = 0; k < 3; k++) {
+    aes_setkey (&aes, key, 16 + 8 * k);
+    aes_encrypt (&aes, buf, kat_pt);
+    assert (!memcmp (buf, kat_ct[k], 16));
+    assert (!aes.d_ready);
+    aes_decrypt (&aes, buf, buf);
+    assert (aes.d_ready);
+    assert (!memcmp (buf, kat_pt, 16));
+
+    aes_esetkey (&eaes, key, 16 + 8 * k);
+    aes_eencrypt (&eaes, buf, kat_pt);
+    assert (!memcmp (buf, kat_ct[k], 16));
+  }
+  aes_clrkey (&aes);
+  aes_eclrkey (&eaes);
+  printf ("FIPS-197 known answers: OK\n");
+}
+
+/* check one bulk backend against block-at-a-time aes_encrypt */
+static void
+check_backend (const char *name, const aes_ctx *aes, const u_char *pt)
+{
+  static u_char ref[MAXLEN], out[MAXLEN];
+  u_char ctr0[16], ctr[16], c[16], ks[16];
+  size_t len, i;
+
+  if (aes_setbackend (name) == -1) {
+    printf ("  %-10s not supported on this CPU, skipped\n", name);
+    return;
+  }
+
+  /* ECB, all block counts up to MAXLEN / 16 */
+  for (len = 0; len <= MAXLEN / 16; len++) {
+    for (i = 0; i < len; i++)
+      aes_encrypt (aes, ref + 16 * i, pt + 16 * i);
+    aes_ecb_encrypt (aes, out, pt, len);
+    assert (!memcmp (out, ref, 16 * len));
+    aes_ecb_decrypt (aes, out, out, len);
+    assert (!memcmp (out, pt, 16 * len));
+  }
+
+  /* CTR, every byte length (odd tails included), with a counter
+     whose low 64 bits are about to wrap */
+  for (i = 0; i < 16; i++)
+    ctr0[i] = i < 8 ? i : 0xff;
+  ctr0[15] = 0xf0;
+  for (len = 0; len <= MAXLEN; len++) {
+    memcpy (c, ctr0, 16);
+    for (i = 0; i < len; i++) {
+      if (!(i % 16)) {
+	aes_encrypt (aes, ks, c);
+	aes_ctr_add (c, 1);
+      }
+      ref[i] = pt[i] ^ ks[i % 16];
+    }
+    memcpy (ctr, ctr0, 16);
+    aes_ctr_xor (aes, out, pt, len, ctr);
+    assert (!memcmp (out, ref, len));
+    assert (!memcmp (ctr, c, 16));
+
+    /* the same stream, split at an odd offset */
+    memcpy (ctr, ctr0, 16);
+    aes_ctr_xor (aes, out, pt, len & ~(size_t) 15, ctr);
+    aes_ctr_xor (aes, out + (len & ~(size_t) 15),
+		 pt + (len & ~(size_t) 15), len & 15, ctr);
+    assert (!memcmp (out, ref, len));
+  }
+  printf ("  %-10s OK\n", name);
+}
+
+/* check multi-key CBC-MAC and encryption against one chain at a time */
+static void
+check_multikey (const char *name, u_int keylen, const u_char *pt)
+{
+  static const size_t lens[] = { 0, 1, 2, 5, MAXLEN / 16 - aes_mkeys_max };
+  aes_ectx keys[aes_mkeys_max];
+  const aes_ectx *kp[aes_mkeys_max];
+  const void *msgs[aes_mkeys_max];
+  u_char key[32], macs[aes_mkeys_max][16], ref[aes_mkeys_max][16];
+  aes_mkey mk;
+  size_t b, l;
+  int i, k, n;
+
+  if (aes_setbackend (name) == -1)
+    return;
+
+  for (k = 0; k < aes_mkeys_max; k++) {
+    for (i = 0; i < 32; i++)
+      key[i] = k * 31 + i;
+    aes_esetkey (&keys[k], key, keylen);
+    kp[k] = &keys[k];
+    msgs[k] = pt + 16 * k;
+  }
+
+  for (n = 1; n <= aes_mkeys_max; n++) {
+    assert (!aes_msetkey (&mk, kp, n));
+    for (l = 0; l < sizeof (lens) / sizeof (lens[0]); l++) {
+      for (k = 0; k < n; k++) {
+	memset (macs[k], k, 16);
+	memset (ref[k], k, 16);
+	for (b = 0; b < lens[l]; b++) {
+	  for (i = 0; i < 16; i++)
+	    ref[k][i] ^= pt[16 * (k + b) + i];
+	  aes_eencrypt (&keys[k], ref[k], ref[k]);
+	}
+      }
+      aes_mcbcmac (&mk, macs, msgs, lens[l]);
+      assert (!memcmp (macs, ref, 16 * n));
+    }
+
+    for (k = 0; k < n; k++) {
+      memcpy (macs[k], pt + 16 * k, 16);
+      aes_eencrypt (&keys[k], ref[k], pt + 16 * k);
+    }
+    aes_mencrypt (&mk, macs);
+    assert (!memcmp (macs, ref, 16 * n));
+  }
+
+  assert (aes_msetkey (&mk, kp, 0) == -1);
+  assert (aes_msetkey (&mk, kp, aes_mkeys_max + 1) == -1);
+  aes_mclrkey (&mk);
+  for (k = 0; k < aes_mkeys_max; k++)
+    aes_eclrkey (&keys[k]);
+  printf ("  %-10s multi-key OK\n", name);
+}
+
+/* cached schedules work like fresh ones, and CLOCK evicts the slot
+   the hand reaches first once every slot has been used again */
+static void
+check_cache (void)
+{
+  u_char key[64][32], buf[16], ref[16];
+  aes_cache_stat st;
+  aes_cache *c;
+  aes_ctx aes, fresh;
+  size_t n, i;
+  int j;
+
+  assert (!aes_cache_alloc (16));
+  c = aes_cache_alloc (4096);
+  assert (c);
+  aes_cache_stats (c, &st);
+  n = st.capacity;
+  assert (n > 1 && n < 64);
+  for (i = 0; i <= n; i++)
+    for (j = 0; j < 32; j++)
+      key[i][j] = i * 37 + j;
+
+  for (i = 0; i < n; i++)
+    assert (!aes_cache_get (c, &aes, key[i], 16 + 8 * (i % 3)));
+  for (i = 0; i < n; i++) {
+    assert (aes_cache_get (c, &aes, key[i], 16 + 8 * (i % 3)));
+    assert (!aes.d_ready);
+    aes_setkey (&fresh, key[i], 16 + 8 * (i % 3));
+    aes_encrypt (&fresh, ref, kat_pt);
+    aes_encrypt (&aes, buf, kat_pt);
+    assert (!memcmp (buf, ref, 16));
+    aes_decrypt (&aes, buf, buf);
+    assert (!memcmp (buf, kat_pt, 16));
+  }
+  /* the same leading bytes at another length are another key */
+  assert (!aes_cache_get (c, &aes, key[1], 32));
+  aes_cache_stats (c, &st);
+  assert (st.hits == n && st.misses == n + 1 && st.evictions == 1);
+  assert (st.entries == n);
+
+  /* every reference bit was set, so the hand went round once and the
+     32-byte key took key 0's slot; key 0 now takes key 1's */
+  assert (!aes_cache_get (c, &aes, key[0], 16));
+  assert (aes_cache_get (c, &aes, key[1], 32));
+  for (i = 2; i < n; i++)
+    assert (aes_cache_get (c, &aes, key[i], 16 + 8 * (i % 3)));
+  aes_cache_stats (c, &st);
+  assert (st.evictions == 2);
+
+  aes_cache_free (c);
+  aes_clrkey (&aes);
+  aes_clrkey (&fresh);
+  printf ("key schedule cache: OK\n");
+}
+
+static int
+cmpblock (const void *a, const void *b)
+{
+  return memcmp (a, b, 16);
+}
+
+/* both generators give distinct blocks across request sizes, short
+   requests included, and are left seeded when switched to */
+static void
+check_prng (void)
+{
+  static const char *const gens[] = { "aesctr", "sha1", NULL };
+  static const size_t lens[] = { 1, 7, 16, 100, 511, 512, 70000 };
+  enum { nblocks = 8192 };
+  static u_char out[16 * nblocks];
+  const char *const *g;
+  size_t off, i;
+
+  assert (!strcmp (prng_backend (), "aesctr"));
+  assert (prng_setbackend ("no-such-prng") == -1);
+  prng_seed ("check_prng", 10);
+  for (g = gens; *g; g++) {
+    assert (!prng_setbackend (*g));
+    bzero (out, sizeof (out));
+    for (off = i = 0; off < sizeof (out); i++) {
+      size_t n = lens[i % (sizeof (lens) / sizeof (lens[0]))];
+      if (n > sizeof (out) - off)
+	n = sizeof (out) - off;
+      prng_getbytes (out + off, n);
+      off += n;
+    }
+    qsort (out, nblocks, 16, cmpblock);
+    for (i = 1; i < nblocks; i++)
+      assert (memcmp (out + 16 * (i - 1), out + 16 * i, 16));
+  }
+  assert (!prng_setbackend ("aesctr"));
+  printf ("prng generators: OK\n");
+}
+
+enum { dkeythr_n = 4, dkeythr_keys = 64, dkeythr_blocks = 64 };
+static aes_ctx dkeythr_aes;
+static pthread_barrier_t dkeythr_bar;
+static u_char dkeythr_ct[dkeythr_blocks][16];
+static u_char dkeythr_out[dkeythr_n][dkeythr_blocks][16];
+
+static void *
+dkeythr_run (void *arg)
+{
+  u_char (*out)[16] = arg;
+  const aes_ctx *aes = &dkeythr_aes;
+  int i;
+
+  pthread_barrier_wait (&dkeythr_bar);
+  if ((out - dkeythr_out[0]) / dkeythr_blocks & 1)
+    for (i = 0; i < dkeythr_blocks; i++)
+      aes_decrypt (aes, out[i], dkeythr_ct[i]);
+  else
+    aes_ecb_decrypt (aes, out, dkeythr_ct, dkeythr_blocks);
+  return NULL;
+}
+
+/* threads racing to build the decryption schedule of a shared key all
+   decrypt with a whole one */
+static void
+check_dkey_threads (void)
+{
+  pthread_t tids[dkeythr_n];
+  u_char key[32], pt[dkeythr_blocks][16];
+  int i, k;
+
+  for (i = 0; i < dkeythr_blocks; i++)
+    memset (pt[i], i, 16);
+  pthread_barrier_init (&dkeythr_bar, NULL, dkeythr_n);
+  for (k = 0; k < dkeythr_keys; k++) {
+    for (i = 0; i < 32; i++)
+      key[i] = k * 31 + i;
+    aes_setkey (&dkeythr_aes, key, 16 + 8 * (k % 3));
+    aes_ecb_encrypt (&dkeythr_aes, dkeythr_ct, pt, dkeythr_blocks);
+    for (i = 0; i < dkeythr_n; i++)
+      assert (!pthread_create (&tids[i], NULL, dkeythr_run,
+			       dkeythr_out[i]));
+    for (i = 0; i < dkeythr_n; i++) {
+      pthread_join (tids[i], NULL);
+      assert (!memcmp (dkeythr_out[i], pt, sizeof (pt)));
+    }
+  }
+  pthread_barrier_destroy (&dkeythr_bar);
+  aes_clrkey (&dkeythr_aes);
+  printf ("decryption schedule, threads: OK\n");
+}
+
+enum { prngthr_n = 4, prngthr_ivs = 1024 };
+static u_char prngthr_out[prngthr_n][prngthr_ivs][16];
+
+static void *
+prngthr_run (void *arg)
+{
+  u_char (*out)[16] = arg;
+  int i;
+
+  for (i = 0; i < prngthr_ivs; i++)
+    prng_getbytes (out[i], 16);
+  return NULL;
+}
+
+/* threads and forked children never see each other's output */
+static void
+check_prng_ctx (void)
+{
+  pthread_t tids[prngthr_n];
+  u_char a[32], b[32], c[32];
+  prng_ctx pc, pc2;
+  int i, fds[2], status;
+  pid_t pid;
+
+  prng_ctx_init (&pc);
+  prng_ctx_init (&pc2);
+  prng_ctx_getbytes (&pc, a, sizeof (a));
+  prng_ctx_getbytes (&pc2, b, sizeof (b));
+  assert (memcmp (a, b, sizeof (a)));
+  prng_ctx_clear (&pc2);
+
+  for (i = 0; i < prngthr_n; i++)
+    assert (!pthread_create (&tids[i], NULL, prngthr_run, prngthr_out[i]));
+  for (i = 0; i < prngthr_n; i++)
+    pthread_join (tids[i], NULL);
+  qsort (prngthr_out, prngthr_n * prngthr_ivs, 16, cmpblock);
+  for (i = 1; i < prngthr_n * prngthr_ivs; i++)
+    assert (memcmp (prngthr_out[0][i - 1], prngthr_out[0][i], 16));
+
+  /* the child's next output, from both the thread's context and an
+     explicit one, against the parent's */
+  assert (!pipe (fds));
+  if (!(pid = fork ())) {
+    prng_getbytes (a, 16);
+    prng_ctx_getbytes (&pc, a + 16, 16);
+    _exit (write (fds[1], a, sizeof (a)) != sizeof (a));
+  }
+  assert (pid > 0);
+  prng_getbytes (b, 16);
+  prng_ctx_getbytes (&pc, b + 16, 16);
+  assert (read (fds[0], c, sizeof (c)) == sizeof (c));
+  assert (waitpid (pid, &status, 0) == pid && !status);
+  assert (memcmp (b, c, 16) && memcmp (b + 16, c + 16, 16));
+  close (fds[0]);
+  close (fds[1]);
+  prng_ctx_clear (&pc);
+  printf ("prng contexts, threads and fork: OK\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  static u_char pt[MAXLEN];
+  u_char key[32];
+  aes_ctx aes;
+  const aes_bulkops **bp;
+  const char *dflt;
+  size_t i;
+  int k;
+
+  kat ();
+  check_dkey_threads ();
+  check_cache ();
+  check_prng ();
+  check_prng_ctx ();
+
+  dflt = aes_backend ();
+  printf ("default bulk backend: %s\n", dflt);
+  for (i = 0; i < sizeof (pt); i++)
+    pt[i] = i * 7 + 3;
+  for (i = 0; i < sizeof (key); i++)
+    key[i] = 0xa5 ^ i;
+
+  for (k = 16; k <= 32; k += 8) {
+    printf ("AES-%d bulk ECB/CTR:\n", 8 * k);
+    aes_setkey (&aes, key, k);
+    for (bp = aes_bulkconf; *bp; bp++) {
+      check_backend ((*bp)->name, &aes, pt);
+      check_multikey ((*bp)->name, k, pt);
+    }
+  }
+  aes_clrkey (&aes);
+
+  {
+    /* keys of different sizes cannot share an aes_mkey */
+    aes_ectx e1, e2;
+    const aes_ectx *kp[2] = { &e1, &e2 };
+    aes_mkey mk;
+    aes_esetkey (&e1, key, 16);
+    aes_esetkey (&e2, key, 32);
+    assert (aes_msetkey (&mk, kp, 2) == -1);
+    aes_eclrkey (&e1);
+    aes_eclrkey (&e2);
+  }
+
+  assert (aes_setbackend ("no-such-backend") == -1);
+  assert (!aes_setbackend (dflt));
+
+  return 0;
+}
@@ -1,10 +1,14 @@
 #include <assert.h>
 
 #include <stdio.h>
-#include "dcrypt.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "dcinternal.h"
 
-/* try to read file block by block */ 
-#define BUFSIZE 512 
+/* try to read file block by block; large reads keep the system call
+   cost well below the hashing cost on big files */ 
+#define BUFSIZE (64 * 1024)
 
 /* try to read len bytes from fd into buf 
    returns -1 on error; otherwise, the number of bytes actually read into 
@@ -32,14 +36,27 @@ hex_nibble (u_char _nib)
   return ((nib < 10) ? ('0' + nib) : ('a' + nib - 10));
 }
 
+static char *
+hex_digest (const u_char *dig)
+{
+  char *res = (char *) malloc (2 * sha1_hashsize + 1);
+  u_int i, j;
+
+  for (i = j = 0; i < sha1_hashsize; i++) {
+    res[j++] = hex_nibble ((dig[i] & 0xf0) >> 4);
+    res[j++] = hex_nibble (dig[i] & 0x0f);
+  }
+  res[j] = '\0';
+  return res;
+}
+
 char *
 sha1_digest (int fin, const char *pname, const char *fname)
 {
   int bytes_read;
-  u_int i, j; 
   char *buf = (char *) malloc (BUFSIZE * sizeof (char));
   char *dig = (char *) malloc (sha1_hashsize * sizeof (char));
-  char *res = (char *) malloc ((2 * sha1_hashsize + 1) * sizeof (char));
+  char *res;
   sha1_ctx sc;  /* will hold the incremental hash */
 
   sha1_init (&sc);
@@ -50,48 +67,543 @@ sha1_digest (int fin, const char *pname, const char *fname)
       printf ("%s: trouble reading from %s\n", pname, fname);
       
       exit (-1);
-    case 0:
-      break;
-    case BUFSIZE:
-      sha1_update (&sc, buf, BUFSIZE);
-      continue;
     default:
       sha1_update (&sc, buf, bytes_read);
-      sha1_final (&sc, (u_char *) dig);
       break;
     } 
   while (bytes_read == BUFSIZE);
+  sha1_final (&sc, (u_char *) dig);
 
-  for (i = j = 0; i < sha1_hashsize; i++) {
-    res[j++] = hex_nibble ((dig[i] & 0xf0) >> 4);
-    res[j++] = hex_nibble (dig[i] & 0x0f);
-  }
-  res[j] = '\0';
+  res = hex_digest ((u_char *) dig);
   free (buf);
   free (dig);
 
   return res;
 }
 
+/* The tree hash (-t): the input is cut into leaves of leafsize bytes,
+   the last one possibly shorter, and an empty input is a single empty
+   leaf.  A leaf hashes to SHA1 (0x00 || leaf) and a pair of nodes to
+   SHA1 (0x01 || left || right); a node left without a sibling moves
+   up a level as it is.  The prefixes keep a leaf from passing for an
+   interior node.  Leaves are hashed by nthreads threads, each taking
+   every nthreads-th leaf, and the levels above are hashed serially:
+   there are only size / leafsize digests to combine. */
+#define TREE_LEAFSIZE (1024 * 1024)
+
+struct tree_job {
+  const u_char *data;
+  size_t len;
+  size_t leafsize;
+  size_t nleaves;
+  size_t first, stride;
+  u_char (*digs)[sha1_hashsize];
+};
+
+static void *
+tree_leaves (void *_job)
+{
+  struct tree_job *job = _job;
+  static const u_char leaftag = 0x00;
+  sha1_ctx sc;
+  size_t i, off, n;
+
+  for (i = job->first; i < job->nleaves; i += job->stride) {
+    off = i * job->leafsize;
+    n = job->len - off < job->leafsize ? job->len - off : job->leafsize;
+    sha1_init (&sc);
+    sha1_update (&sc, &leaftag, 1);
+    sha1_update (&sc, job->data + off, n);
+    sha1_final (&sc, job->digs[i]);
+  }
+  return NULL;
+}
+
+static void
+tree_hash (u_char out[sha1_hashsize], const void *data, size_t len,
+	   size_t leafsize, int nthreads)
+{
+  static const u_char nodetag = 0x01;
+  struct tree_job *jobs;
+  pthread_t *tids;
+  u_char (*digs)[sha1_hashsize];
+  size_t nleaves = len ? (len + leafsize - 1) / leafsize : 1;
+  size_t i, n;
+  sha1_ctx sc;
+  int t;
+
+  if ((size_t) nthreads > nleaves)
+    nthreads = nleaves;
+  digs = malloc (nleaves * sizeof (*digs));
+  jobs = malloc (nthreads * sizeof (*jobs));
+  tids = malloc (nthreads * sizeof (*tids));
+  for (t = 0; t < nthreads; t++) {
+    jobs[t].data = data;
+    jobs[t].len = len;
+    jobs[t].leafsize = leafsize;
+    jobs[t].nleaves = nleaves;
+    jobs[t].first = t;
+    jobs[t].stride = nthreads;
+    jobs[t].digs = digs;
+  }
+  /* the calling thread takes the first share itself */
+  for (t = 1; t < nthreads; t++)
+    if (pthread_create (&tids[t], NULL, tree_leaves, &jobs[t])) {
+      perror ("pthread_create");
+      exit (-1);
+    }
+  tree_leaves (&jobs[0]);
+  for (t = 1; t < nthreads; t++)
+    pthread_join (tids[t], NULL);
+
+  for (n = nleaves; n > 1; n = (n + 1) / 2)
+    for (i = 0; i < n; i += 2) {
+      if (i + 1 == n) {
+	memmove (digs[i / 2], digs[i], sha1_hashsize);
+	break;
+      }
+      sha1_init (&sc);
+      sha1_update (&sc, &nodetag, 1);
+      sha1_update (&sc, digs[i], 2 * sha1_hashsize);
+      sha1_final (&sc, digs[i / 2]);
+    }
+  memcpy (out, digs[0], sha1_hashsize);
+  free (digs);
+  free (jobs);
+  free (tids);
+}
+
+/* tree-hashes the whole of file fin, mapped into memory, and reports
+   the throughput on standard error */
+static char *
+sha1_treedigest (int fin, const char *pname, const char *fname,
+		 size_t leafsize, int nthreads)
+{
+  struct stat sb;
+  struct timeval start, end;
+  u_char dig[sha1_hashsize];
+  void *map = NULL;
+  double secs;
+
+  if (fstat (fin, &sb) == -1) {
+    perror (pname);
+    exit (-1);
+  }
+  if (sb.st_size
+      && (map = mmap (NULL, sb.st_size, PROT_READ, MAP_SHARED,
+		      fin, 0)) == MAP_FAILED) {
+    printf ("%s: cannot map %s\n", pname, fname);
+    exit (-1);
+  }
+  gettimeofday (&start, NULL);
+  tree_hash (dig, map, sb.st_size, leafsize, nthreads);
+  gettimeofday (&end, NULL);
+  if (map)
+    munmap (map, sb.st_size);
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  fprintf (stderr, "%s: %lld bytes, %d threads, %.3f s, %.1f MB/s\n",
+	   pname, (long long) sb.st_size, nthreads, secs,
+	   secs > 0 ? sb.st_size / secs / 1e6 : 0.0);
+  return hex_digest (dig);
+}
+
+/* FIPS PUB 180-1 test vectors, and every length up to a few blocks
+   against the portable code, for one compression function */
+static void
+check_backend (const char *name)
+{
+  static const char *const msgs[] = {
+    "abc",
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+  };
+  static const u_char digests[3][20] = {
+    { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+      0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d },
+    { 0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+      0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1 },
+    { 0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+      0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f },
+  };
+  static char data[1000];
+  u_char dig[20], ref[20];
+  sha1_ctx sc;
+  size_t i, len;
+
+  if (sha1_setbackend (name) == -1) {
+    printf ("  %-10s not supported on this CPU, skipped\n", name);
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    sha1_hash (dig, msgs[i], strlen (msgs[i]));
+    assert (!memcmp (dig, digests[i], 20));
+  }
+  memset (data, 'a', sizeof (data));
+  sha1_init (&sc);
+  for (i = 0; i < 1000; i++)
+    sha1_update (&sc, data, sizeof (data));
+  sha1_final (&sc, dig);
+  assert (!memcmp (dig, digests[2], 20));
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 7 + (i >> 8);
+  for (len = 0; len <= 5 * 64; len++) {
+    sha1_setbackend ("portable");
+    sha1_hash (ref, data, len);
+    sha1_setbackend (name);
+    sha1_hash (dig, data, len);
+    assert (!memcmp (dig, ref, 20));
+  }
+  printf ("  %-10s OK\n", name);
+}
+
+/* sha1_hash_many and sha1oracle against sha1_hash, with one multi-buffer
+   backend and each compression function behind it */
+static void
+check_mbackend (const char *name)
+{
+  static const char *const single[] = { "shani", "portable" };
+  enum { nmsgs = 41, maxlen = 300 };
+  static u_char data[maxlen + 16], digs[nmsgs][20];
+  const void *msgs[nmsgs];
+  size_t lens[nmsgs];
+  u_char ref[20], out[20 * 17], buf[16 + maxlen];
+  sha1oracle_ctx soc;
+  size_t i, k, s, nb;
+
+  if (sha1_mbsetbackend (name) == -1) {
+    printf ("  %-10s not supported on this CPU, skipped\n", name);
+    return;
+  }
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 13 + (i >> 7);
+
+  for (s = 0; s < 2; s++) {
+    if (sha1_setbackend (single[s]) == -1)
+      continue;
+
+    /* lengths around every padding boundary, so lanes finish at
+       different times; then fewer messages than lanes */
+    for (k = 0; k < nmsgs; k++) {
+      lens[k] = (k * 37) % maxlen;
+      msgs[k] = data + k % 16;
+    }
+    sha1_hash_many (digs, msgs, lens, nmsgs);
+    for (k = 0; k < nmsgs; k++) {
+      sha1_hash (ref, msgs[k], lens[k]);
+      assert (!memcmp (digs[k], ref, 20));
+    }
+    for (k = 0; k < 10; k++) {
+      bzero (digs, sizeof (digs));
+      sha1_hash_many (digs, msgs + 1, lens + 1, k);
+      for (i = 0; i < k; i++) {
+	sha1_hash (ref, msgs[i + 1], lens[i + 1]);
+	assert (!memcmp (digs[i], ref, 20));
+      }
+    }
+
+    /* SHA1 (<k> || <idx> || M) for each 20 bytes of output */
+    for (nb = 1; nb <= sizeof (out); nb += 19) {
+      sha1oracle_init (&soc, nb, 7);
+      sha1oracle_update (&soc, data, maxlen);
+      sha1oracle_final (&soc, out);
+      memcpy (buf + 16, data, maxlen);
+      for (k = 0; 20 * k < nb; k++) {
+	puthyper (buf, k);
+	puthyper (buf + 8, 7);
+	sha1_hash (ref, buf, sizeof (buf));
+	assert (!memcmp (out + 20 * k, ref, nb - 20 * k < 20 ? nb - 20 * k : 20));
+      }
+    }
+  }
+  printf ("  %-10s OK\n", name);
+}
+
+/* FIPS 180-2 and RFC 4231 test vectors, and every length up to a few
+   blocks against the portable code, for one SHA-256 compression
+   function */
+static void
+check_sha256 (const char *name)
+{
+  static const char *const msgs[] = {
+    "abc",
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+  };
+  static const u_char digests[3][32] = {
+    { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+      0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+      0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+      0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad },
+    { 0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+      0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+      0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+      0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 },
+    { 0xcd, 0xc7, 0x6e, 0x5c, 0x99, 0x14, 0xfb, 0x92,
+      0x81, 0xa1, 0xc7, 0xe2, 0x84, 0xd7, 0x3e, 0x67,
+      0xf1, 0x80, 0x9a, 0x48, 0xa4, 0x97, 0x20, 0x0e,
+      0x04, 0x6d, 0x39, 0xcc, 0xc7, 0x11, 0x2c, 0xd0 },
+  };
+  /* RFC 4231 test cases 2 and 6 */
+  static const char hmsg6[] =
+    "Test Using Larger Than Block-Size Key - Hash Key First";
+  static const u_char hmacs[2][32] = {
+    { 0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e,
+      0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+      0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83,
+      0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43 },
+    { 0x60, 0xe4, 0x31, 0x59, 0x1e, 0xe0, 0xb6, 0x7f,
+      0x0d, 0x8a, 0x26, 0xaa, 0xcb, 0xf5, 0xb7, 0x7f,
+      0x8e, 0x0b, 0xc6, 0x21, 0x37, 0x28, 0xc5, 0x14,
+      0x05, 0x46, 0x04, 0x0f, 0x0e, 0xe3, 0x7f, 0x54 },
+  };
+  static char data[1000];
+  u_char dig[32], ref[32], key[131];
+  sha256_ctx sc;
+  size_t i, len;
+
+  if (sha256_setbackend (name) == -1) {
+    printf ("  %-10s not supported on this CPU, skipped\n", name);
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    sha256_hash (dig, msgs[i], strlen (msgs[i]));
+    assert (!memcmp (dig, digests[i], 32));
+  }
+  memset (data, 'a', sizeof (data));
+  sha256_init (&sc);
+  for (i = 0; i < 1000; i++)
+    sha256_update (&sc, data, sizeof (data));
+  sha256_final (&sc, dig);
+  assert (!memcmp (dig, digests[2], 32));
+
+  hmac_sha256 ("Jefe", 4, dig, "what do ya want for nothing?", 28);
+  assert (!memcmp (dig, hmacs[0], 32));
+  memset (key, 0xaa, sizeof (key));
+  hmac_sha256 (key, sizeof (key), dig, hmsg6, strlen (hmsg6));
+  assert (!memcmp (dig, hmacs[1], 32));
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 7 + (i >> 8);
+  for (len = 0; len <= 5 * 64; len++) {
+    sha256_setbackend ("portable");
+    sha256_hash (ref, data, len);
+    sha256_setbackend (name);
+    sha256_hash (dig, data, len);
+    assert (!memcmp (dig, ref, 32));
+  }
+  printf ("  %-10s OK\n", name);
+}
+
+/* hmac_sha1_init/update/final as they have always been computed,
+   with 0x45 rather than 0x5c for the outer pad */
+static void
+hmac_sha1_old (const char *key, size_t keylen, u_char out[20],
+	       const void *data, size_t dlen)
+{
+  char block[64];
+  sha1_ctx sc;
+  unsigned i;
+
+  sha1_init (&sc);
+  memset (block, 0x36, sizeof (block));
+  for (i = 0; i < sizeof (block) && i < keylen; i++)
+    block[i] ^= key[i];
+  sha1_update (&sc, block, sizeof (block));
+  sha1_update (&sc, data, dlen);
+  sha1_final (&sc, out);
+  sha1_init (&sc);
+  memset (block, 0x45, sizeof (block));
+  for (i = 0; i < sizeof (block) && i < keylen; i++)
+    block[i] ^= key[i];
+  sha1_update (&sc, block, sizeof (block));
+  sha1_update (&sc, out, 20);
+  sha1_final (&sc, out);
+}
+
+/* RFC 2202 test cases 1 and 2, and the precomputed keys against the
+   one-shot and streaming HMAC functions over a range of lengths */
+static void
+check_hmac (void)
+{
+  static const u_char hmacs[2][20] = {
+    { 0xb6, 0x17, 0x31, 0x86, 0x55, 0x05, 0x72, 0x64, 0xe2, 0x8b,
+      0xc0, 0xb6, 0xfb, 0x37, 0x8c, 0x8e, 0xf1, 0x46, 0xbe, 0x00 },
+    { 0xef, 0xfc, 0xdf, 0x6a, 0xe5, 0xeb, 0x2f, 0xa2, 0xd2, 0x74,
+      0x16, 0xd5, 0xf1, 0x84, 0xdf, 0x9c, 0x25, 0x9a, 0x7c, 0x79 },
+  };
+  static char data[300];
+  char key[20];
+  u_char dig[32], ref[32];
+  hmac_sha1_key hk;
+  hmac_sha256_key hk256;
+  sha1_ctx sc;
+  sha256_ctx sc256;
+  size_t i, len;
+
+  memset (key, 0x0b, sizeof (key));
+  hmac_sha1_setkey (&hk, key, sizeof (key));
+  hmac_sha1_mac (&hk, dig, "Hi There", 8);
+  assert (!memcmp (dig, hmacs[0], 20));
+  hmac_sha1_setkey (&hk, "Jefe", 4);
+  hmac_sha1_mac (&hk, dig, "what do ya want for nothing?", 28);
+  assert (!memcmp (dig, hmacs[1], 20));
+
+  for (i = 0; i < sizeof (data); i++)
+    data[i] = i * 13 + (i >> 8);
+  hmac_sha1_setkey (&hk, key, sizeof (key));
+  hmac_sha256_setkey (&hk256, key, sizeof (key));
+  for (len = 0; len <= sizeof (data); len++) {
+    hmac_sha1 (key, sizeof (key), ref, data, len);
+    hmac_sha1_mac (&hk, dig, data, len);
+    assert (!memcmp (dig, ref, 20));
+    hmac_sha1_init (key, sizeof (key), &sc);
+    hmac_sha1_update (&sc, data, len / 3);
+    hmac_sha1_update (&sc, data + len / 3, len - len / 3);
+    hmac_sha1_final (key, sizeof (key), &sc, dig);
+    hmac_sha1_old (key, sizeof (key), ref, data, len);
+    assert (!memcmp (dig, ref, 20));
+
+    hmac_sha256 (key, sizeof (key), ref, data, len);
+    hmac_sha256_start (&hk256, &sc256);
+    hmac_sha256_update (&sc256, data, len / 3);
+    hmac_sha256_update (&sc256, data + len / 3, len - len / 3);
+    hmac_sha256_finish (&hk256, &sc256, dig);
+    assert (!memcmp (dig, ref, 32));
+  }
+  hmac_sha1_clrkey (&hk);
+  hmac_sha256_clrkey (&hk256);
+  printf ("  precomputed keys OK\n");
+}
+
+/* the tree hash of five 64-byte leaves, built by hand, for one and
+   for several threads; and inputs of a single leaf */
+static void
+check_tree (void)
+{
+  static u_char data[300];
+  u_char leaves[5][65], nodes[4][41], dig[20], ref[20];
+  int i;
+
+  for (i = 0; i < (int) sizeof (data); i++)
+    data[i] = i * 11 + 3;
+  for (i = 0; i < 5; i++) {
+    leaves[i][0] = 0x00;
+    memcpy (leaves[i] + 1, data + 64 * i, i < 4 ? 64 : 44);
+    sha1_hash (i < 4 ? nodes[i / 2] + 1 + 20 * (i % 2) : ref, leaves[i],
+	       i < 4 ? 65 : 45);
+  }
+  /* nodes[0] = (0, 1), nodes[1] = (2, 3), nodes[2] = (01, 23),
+     nodes[3] = (0123, 4) */
+  nodes[0][0] = nodes[1][0] = nodes[2][0] = nodes[3][0] = 0x01;
+  sha1_hash (nodes[2] + 1, nodes[0], 41);
+  sha1_hash (nodes[2] + 21, nodes[1], 41);
+  sha1_hash (nodes[3] + 1, nodes[2], 41);
+  memcpy (nodes[3] + 21, ref, 20);
+  sha1_hash (ref, nodes[3], 41);
+  for (i = 1; i <= 8; i++) {
+    tree_hash (dig, data, sizeof (data), 64, i);
+    assert (!memcmp (dig, ref, 20));
+  }
+
+  leaves[0][0] = 0x00;
+  sha1_hash (ref, leaves[0], 1);
+  tree_hash (dig, NULL, 0, 64, 4);
+  assert (!memcmp (dig, ref, 20));
+  memcpy (leaves[0] + 1, data, 64);
+  sha1_hash (ref, leaves[0], 65);
+  tree_hash (dig, data, 64, 64, 4);
+  assert (!memcmp (dig, ref, 20));
+  printf ("  tree hash  OK\n");
+}
+
 void 
 usage (const char *pname)
 {
   printf ("Simple SHA1 Hash Oracle\n");
-  printf ("Usage: %s [FILE]\n", pname);
-  printf ("       Without arguments, prints to standard output the SHA1 hash of its own binaries.\n");
+  printf ("Usage: %s [-b BACKEND] [-t [-j THREADS] [-l LEAFSIZE]] [FILE]\n",
+	  pname);
+  printf ("       Without arguments, checks the SHA1 implementations and prints to standard\n");
+  printf ("       output the SHA1 hash of its own binaries.\n");
   printf ("       With an argument, checks if FILE exists: if so hashes the content of FILE and\n");
   printf("        writes the resulting digest to standard output.\n");
+  printf ("       -b selects the SHA1 compression function (shani or portable).\n");
+  printf ("       -t prints a SHA1 tree hash of FILE instead, hashing LEAFSIZE-byte\n");
+  printf ("       leaves (default 1m) on THREADS threads (default one per CPU), and\n");
+  printf ("       reports the throughput on standard error.\n");
   exit (1);
 }
 
 int 
 main (int argc, char **argv)
 {
-  int fd;
-  char *digest;
+  int fd, ch, tree = 0;
+  int nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t leafsize = TREE_LEAFSIZE;
+  char *digest, *end;
+  const char *pname = argv[0], *backend = NULL, *mbackend;
+
+  while ((ch = getopt (argc, argv, "b:j:l:t")) != -1)
+    switch (ch) {
+    case 'b':
+      backend = optarg;
+      break;
+    case 'j':
+      nthreads = atoi (optarg);
+      break;
+    case 'l':
+      leafsize = strtoul (optarg, &end, 0);
+      if (*end == 'k' || *end == 'K')
+	leafsize <<= 10;
+      else if (*end == 'm' || *end == 'M')
+	leafsize <<= 20;
+      else if (*end)
+	usage (pname);
+      break;
+    case 't':
+      tree = 1;
+      break;
+    default:
+      usage (pname);
+    }
+  argc -= optind - 1;
+  argv += optind - 1;
+  argv[0] = (char *) pname;
+
+  if (nthreads < 1)
+    nthreads = 1;
+  if (!leafsize)
+    usage (pname);
+  if (backend && sha1_setbackend (backend) == -1) {
+    printf ("%s: unknown or unsupported SHA1 backend %s\n", pname, backend);
+    exit (1);
+  }
 
   switch (argc) {
   case 1:
+    if (!backend) {
+      backend = sha1_backend ();
+      mbackend = sha1_mbbackend ();
+      printf ("SHA1 implementations (default %s):\n", backend);
+      check_backend ("shani");
+      check_backend ("portable");
+      printf ("SHA1 multi-buffer code (default %s):\n", mbackend);
+      check_mbackend ("avx2");
+      check_mbackend ("sse2");
+      check_mbackend ("none");
+      sha1_setbackend (backend);
+      sha1_mbsetbackend (mbackend);
+      printf ("SHA256 implementations (default %s):\n", sha256_backend ());
+      backend = sha256_backend ();
+      check_sha256 ("shani");
+      check_sha256 ("portable");
+      sha256_setbackend (backend);
+      printf ("HMAC:\n");
+      check_hmac ();
+      printf ("SHA1 tree hash:\n");
+      check_tree ();
+    }
     /* if called without arguments, hashes its own binaries */ 
     argv[1] = argv[0];
     /* purposedly fall over to next case... */
@@ -108,10 +620,17 @@ main (int argc, char **argv)
       }
     }
 
-    digest = sha1_digest (fd, argv[0], argv[1]);
+    if (tree) {
+      digest = sha1_treedigest (fd, argv[0], argv[1], leafsize, nthreads);
+      printf ("SHA1-TREE/%lu (%s) = %s\n", (unsigned long) leafsize,
+	      argv[1], digest);
+    }
+    else {
+      digest = sha1_digest (fd, argv[0], argv[1]);
+      printf ("SHA1 (%s) = %s\n", argv[1], digest);
+    }
     close (fd);
-    
-    printf ("SHA1 (%s) = %s\n", argv[1], digest);
+
     free (digest); /* allocated in sha1_digest */
 
     break;
@@ -8,6 +8,10 @@ void ri (void);
 char *import_from_file (int fd);
 char *import_sk_from_file (char **raw_sk_p, size_t *raw_len_p, int fdsk);
 int write_chunk (int fd, const char *buf, u_int len);
+int read_chunk (int fd, char *buf, u_int len);
+void setup_sk (aes_ctx keys[2], const char *raw_sk);
+int mac_from_args (int *argcp, char ***argvp);
+int armor_from_args (int *argcp, char ***argvp);
 
 #ifndef HAVE_GETPROGNAME
 # define MY_MAXNAME 80
@@ -18,4 +22,38 @@ void setprogname(const char *n);
 
 #define CCA_STRENGTH 16 /* must be one of 16, 24 or 32; used to set AES keys */
 
+/* bytes handed to the bulk AES routines at a time; a multiple of
+   CCA_STRENGTH */
+#define CHUNK_SIZE (256 * CCA_STRENGTH)
+
+/* the MAC the ctr tools append, under the second half of the key:
+   AES-CBC-MAC, or HMAC-SHA-256 truncated to CCA_STRENGTH bytes.  The
+   file does not record which, so both ends must be given the same. */
+enum { MAC_CBC, MAC_HMAC_SHA256 };
+
+/* With --armor, the encrypt tools write the ciphertext as base64
+   lines between these two, encoding each chunk as it is produced; the
+   decrypt tools recognize such files by the first line. */
+#define ARMOR_BEGIN "-----BEGIN VAULT CIPHERTEXT-----"
+#define ARMOR_END "-----END VAULT CIPHERTEXT-----"
+
+/* a ciphertext file, raw or armored, read or written through the ct_
+   functions in misc.c */
+#define ARMOR_TEXT_SIZE (2 * CHUNK_SIZE)
+typedef struct ctfile {
+  int fd;
+  int armor;
+  armor64_enc enc;
+  armor64_dec dec;
+  off_t left;           /* armored text not yet read, up to ARMOR_END */
+  size_t have, pos;     /* decoded bytes in plain, and those handed out */
+  char text[ARMOR_TEXT_SIZE];
+  char plain[ARMOR_TEXT_SIZE / 4 * 3 + 3];
+} ctfile;
+void ct_create (ctfile *ct, int fd, int armor);
+int ct_write (ctfile *ct, const void *buf, u_int len);
+int ct_finish (ctfile *ct);
+off_t ct_open (ctfile *ct, int fd);
+int ct_read (ctfile *ct, void *buf, u_int len);
+
 #endif /* _PV_H_ */
@@ -12,7 +12,8 @@ inc_counter(char* ctr)
 }
 
 void
-decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int file_size)
+decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len,
+              ctfile *fin, int file_size, int mac)
 {
   /***************************************************************************
    * Use AES in CTR mode for decryption and AES as a CBC-MAC to verify the tag
@@ -23,20 +24,28 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
    *
    * where Y = AES-CTR (K_CTR, plaintext)
    *       W = AES-CBC-MAC (K_MAC, Y)
+   *
+   * or, with -m hmac-sha256, W = HMAC-SHA-256 (K_MAC, Y) truncated to
+   * CCA_STRENGTH bytes; file_size and the reads are of the dearmored
+   * ciphertext if CTEXT-FILE is armored
    */
 
   int ptxt = 0;
   int bytes_read = 0;
   int bytes_total_read = 0;
   int num_blocks = 0;
+  int n = 0;
 
-  aes_ctx aesEnc, aesMac;
+  aes_ctx keys[2];
+  aes_ectx aesEnc, aesMac;
+  sha256_ctx hmac;
+  u_char tag[sha256_hashsize];
+  const char *mac_key = (const char *)raw_sk + CCA_STRENGTH;
 
-  char ptxt_buf[CCA_STRENGTH], buf[CCA_STRENGTH], mac_buf[CCA_STRENGTH];
+  char ptxt_buf[CHUNK_SIZE], buf[CHUNK_SIZE], mac_buf[CCA_STRENGTH];
   char ctr[CCA_STRENGTH], mac_buf_temp[CCA_STRENGTH];
 
-  char *sk_enc, *sk_mac;
-  int i = 0, j = 0;
+  int i = 0, j = 0, k = 0;
 
   /* use the first part of the symmetric key for the AES-CTR decryption ...*/
   /* ... and the second for the AES-CBC-MAC */
@@ -54,83 +63,99 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
   /* get file size in bytes:*/
   printf("File size: %i\n", file_size);
 
-  /* First part for the AES-CTR */
-  sk_enc = raw_sk;
-  aes_setkey(&aesEnc, sk_enc, CCA_STRENGTH);
-
-  /* ... and the second part for the AES-CBC-MAC */
-  sk_mac = raw_sk+CCA_STRENGTH;
-  aes_setkey(&aesMac, sk_mac, CCA_STRENGTH);
+  /* First part for the AES-CTR, second part for the AES-CBC-MAC */
+  setup_sk(keys, raw_sk);
+  aesEnc = keys[0].e;
+  aesMac = keys[1].e;
 
   /* First, read the IV (Initialization Vector) */
-  read(fin, ctr, CCA_STRENGTH);
+  ct_read(fin, ctr, CCA_STRENGTH);
 
   num_blocks = file_size / CCA_STRENGTH-2;
   bytes_total_read = CCA_STRENGTH;
 
-  /* SETUP CBC-MAC */
-  aes_encrypt(&aesMac, mac_buf, ctr);
+  /* SETUP MAC */
+  if (mac == MAC_HMAC_SHA256) {
+    hmac_sha256_init(mac_key, CCA_STRENGTH, &hmac);
+    hmac_sha256_update(&hmac, ctr, CCA_STRENGTH);
+  }
+  else
+    aes_eencrypt(&aesMac, mac_buf, ctr);
+
+  /* the first block is decrypted under IV + 1 */
+  inc_counter(ctr);
 
-  for (j=0; j<num_blocks; ++j) {
-    inc_counter(ctr);
-    bytes_read = read(fin, buf, CCA_STRENGTH);
-    if(bytes_read != CCA_STRENGTH) {
+  for (j=0; j<num_blocks; j+=n) {
+    n = num_blocks - j;
+    if (n > CHUNK_SIZE / CCA_STRENGTH)
+      n = CHUNK_SIZE / CCA_STRENGTH;
+    bytes_read = ct_read(fin, buf, n * CCA_STRENGTH);
+    if(bytes_read != n * CCA_STRENGTH) {
       /* Error: shut down everything - scrub buffers*/
       char* raw_sk_char = (char*)raw_sk;
       for (size_t i = 0; i < raw_len; ++i)
         raw_sk_char[i] = 0;
-      for (int i = 0; i < CCA_STRENGTH; ++i)
-        ptxt_buf[i] = 0;
-        buf[i] = 0;
-        ctr[i] = 0;
+      bzero(ptxt_buf, sizeof(ptxt_buf));
+      bzero(buf, sizeof(buf));
+      bzero(ctr, sizeof(ctr));
+      bzero(&hmac, sizeof(hmac));
+      bzero(keys, sizeof(keys));
+      bzero(&aesEnc, sizeof(aesEnc));
+      bzero(&aesMac, sizeof(aesMac));
       exit(-1);
     }
 
-    aes_encrypt(&aesEnc, ptxt_buf, ctr);
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      ptxt_buf[i] = ptxt_buf[i] ^ buf[i];
-    }
-    write(ptxt, ptxt_buf, CCA_STRENGTH);
-    bytes_total_read += CCA_STRENGTH;
+    aes_ectr_xor(&aesEnc, ptxt_buf, buf, bytes_read, ctr);
+    write_chunk(ptxt, ptxt_buf, bytes_read);
+    bytes_total_read += bytes_read;
 
-    /* COMPUTE CBC-MAC AS YOU GO */
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf[i] ^ buf[i];
+    /* COMPUTE MAC AS YOU GO */
+    if (mac == MAC_HMAC_SHA256) {
+      hmac_sha256_update(&hmac, buf, bytes_read);
+      continue;
     }
-    aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf_temp[i];
+    for (k=0; k<bytes_read; k+=CCA_STRENGTH) {
+      for (i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf[i] ^ buf[k+i];
+      }
+      aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
+      for (i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf_temp[i];
+      }
     }
   }
 
-  inc_counter(ctr);
-
   /* now read the last block of size (file_size-CCA_STR-bytes_total_read)*/
-  read(fin, buf, file_size-CCA_STRENGTH-bytes_total_read);
+  ct_read(fin, buf, file_size-CCA_STRENGTH-bytes_total_read);
+  if (mac == MAC_HMAC_SHA256)
+    hmac_sha256_update(&hmac, buf, file_size-CCA_STRENGTH-bytes_total_read);
   /* pad rest with zeros:*/
   for (i=file_size-CCA_STRENGTH-bytes_total_read; i<CCA_STRENGTH; ++i)
     buf[i] = 0;
 
   /* and decrypt:*/
-  aes_encrypt(&aesEnc, ptxt_buf, ctr);
-  for (i=0; i<CCA_STRENGTH; ++i) {
-    ptxt_buf[i] = ptxt_buf[i] ^ buf[i];
-  }
+  aes_ectr_xor(&aesEnc, ptxt_buf, buf, CCA_STRENGTH, ctr);
 
   write(ptxt, ptxt_buf, file_size-CCA_STRENGTH-bytes_total_read);
   close(ptxt);
 
-  /* COMPUTE LAST BLOCK OF CBC-MAC */
-  /* XOR padding with calculated extra ptxt*/
-  for (i=file_size-CCA_STRENGTH-bytes_total_read; i<CCA_STRENGTH; ++i) {
-    buf[i] = ptxt_buf[i] ^ buf[i];
-  }
-  for (i=0; i<CCA_STRENGTH; ++i) {
-    mac_buf[i] = mac_buf[i] ^ buf[i];
+  if (mac == MAC_HMAC_SHA256) {
+    hmac_sha256_final(mac_key, CCA_STRENGTH, &hmac, tag);
+    memcpy(mac_buf, tag, CCA_STRENGTH);
   }
-  aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
-  for (i=0; i<CCA_STRENGTH; ++i) {
-    mac_buf[i] = mac_buf_temp[i];
+  else {
+    /* COMPUTE LAST BLOCK OF CBC-MAC */
+    /* XOR padding with calculated extra ptxt*/
+    for (i=file_size-CCA_STRENGTH-bytes_total_read; i<CCA_STRENGTH; ++i) {
+      buf[i] = ptxt_buf[i] ^ buf[i];
+    }
+    for (i=0; i<CCA_STRENGTH; ++i) {
+      mac_buf[i] = mac_buf[i] ^ buf[i];
+    }
+    aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
+    for (i=0; i<CCA_STRENGTH; ++i) {
+      mac_buf[i] = mac_buf_temp[i];
+    }
   }
 
   /* CHECK CBC-MAC IS CORRECT BY COMPARING YOUR RESULT COMPUTED HERE */
@@ -138,9 +163,10 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
   /* IF IT DOESN'T MATCH, DELETE THE P-TEXT FILE! */
 
   /* YOUR CODE HERE */
-  read(fin, buf, CCA_STRENGTH);
+  ct_read(fin, buf, CCA_STRENGTH);
 
-  if (strncmp(mac_buf, buf, CCA_STRENGTH)) {
+  /* the tags are binary, so compare all CCA_STRENGTH bytes */
+  if (memcmp(mac_buf, buf, CCA_STRENGTH)) {
     if (remove(ptxt_fname)) {
       printf("Error: Plaintext deletion failed.\n");
     } else {
@@ -148,14 +174,13 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
     }
   }
   close(ptxt);
-  close(fin);
 }
 
 void
 usage (const char *pname)
 {
   printf("Simple File Decryption Utility\n");
-  printf("Usage: %s SK-FILE CTEXT-FILE PTEXT-FILE\n", pname);
+  printf("Usage: %s [-m MAC] SK-FILE CTEXT-FILE PTEXT-FILE\n", pname);
   printf("       Exits if either SK-FILE or CTEXT-FILE don't exist, or\n");
   printf("       if a symmetric key sk cannot be found in SK-FILE.\n");
   printf("       Otherwise, tries to use sk to decrypt the content of\n");
@@ -163,6 +188,9 @@ usage (const char *pname)
   printf("       in PTEXT-FILE; if a decryption problem is encountered\n");
   printf("       after the processing started, PTEXT-FILE is truncated\n");
   printf("       to zero-length and its previous content is lost.\n");
+  printf("       MAC is cbcmac (the default) or hmac-sha256, as given\n");
+  printf("       to ctr_encrypt.  CTEXT-FILE may be armored (see\n");
+  printf("       ctr_encrypt --armor).\n");
   exit(1);
 }
 
@@ -172,19 +200,11 @@ main (int argc, char **argv)
   int fdsk, fdctxt;
   char *sk = NULL;
   size_t sk_len = 0;
-  int file_size=0;
-
-  FILE* f = 0;
-  if (argc != 4) {
-    usage(argv[0]);
-  }
-  /* get file size of ctxt */
-  f = fopen(argv[2], "r");
-  fseek(f, 0, SEEK_END);
-  file_size = ftell(f);
-  fclose(f);
+  off_t file_size;
+  ctfile ct;
+  int mac = mac_from_args(&argc, &argv);
 
-  if (argc != 4) {
+  if (argc != 4 || mac == -1) {
     usage(argv[0]);
   }   /* Check if argv[1] and argv[2] are existing files */
   else if (((fdsk = open(argv[1], O_RDONLY)) == -1)
@@ -200,6 +220,12 @@ main (int argc, char **argv)
   else {
     setprogname(argv[0]);
 
+    /* get file size of ctxt, dearmored if need be */
+    if ((file_size = ct_open(&ct, fdctxt)) == -1) {
+      printf("%s: cannot read %s, or it is badly armored\n", argv[0], argv[2]);
+      exit(-1);
+    }
+
     /* Import symmetric key from argv[1] */
     if (!(sk = import_sk_from_file (&sk, &sk_len, fdsk))) {
       printf ("%s: no symmetric key found in %s\n", argv[0], argv[1]);
@@ -210,7 +236,7 @@ main (int argc, char **argv)
     close(fdsk);
 
     /* Perform decryption */
-    decrypt_file (argv[3], sk, sk_len, fdctxt, file_size);
+    decrypt_file (argv[3], sk, sk_len, &ct, file_size, mac);
 
     /* scrub the buffer that's holding the key before exiting */
     for (size_t i = 0; i < sk_len; ++i)
@@ -12,7 +12,8 @@ inc_counter(char* ctr)
 }
 
 void
-encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
+encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin,
+              int mac, int armor)
 {
   /***************************************************************************
    * Use AES in CTR mode for encryption and AES as a CBC-MAC for auth
@@ -24,18 +25,29 @@ encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
    *
    * where Y = AES-CTR (K_CTR, plaintext)
    *       W = AES-CBC-MAC (K_MAC, Y)
+   *
+   * With -m hmac-sha256, W is instead the first CCA_STRENGTH bytes of
+   * HMAC-SHA-256 (K_MAC, Y), Y being the IV and the ciphertext proper.
+   *
+   * With --armor, the whole of it is written as base64 lines between
+   * ARMOR_BEGIN and ARMOR_END.
    ***************************************************************************/
 
   int ctxt = 0;
+  ctfile ct;
   int bytes_read = 0;
-  int i = 0;
+  int full = 0;
+  int i = 0, j = 0;
 
-  aes_ctx aesEnc, aesMac;
+  aes_ctx keys[2];
+  aes_ectx aesEnc, aesMac;
+  sha256_ctx hmac;
+  u_char tag[sha256_hashsize];
+  const char *mac_key = (const char *)raw_sk + CCA_STRENGTH;
 
-  char ctxt_buf[CCA_STRENGTH], buf[CCA_STRENGTH], mac_buf[CCA_STRENGTH];
+  char ctxt_buf[CHUNK_SIZE], buf[CHUNK_SIZE], mac_buf[CCA_STRENGTH];
   char ctr[CCA_STRENGTH], mac_buf_temp[CCA_STRENGTH];
 
-  char *sk_enc, *sk_mac;
   /* Create the ciphertext file---the content will be encrypted */
 
   if ((ctxt = open(ctxt_fname, O_WRONLY|O_TRUNC|O_CREAT, 0600)) == -1) {
@@ -48,73 +60,93 @@ encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
     exit(-1);
   }
 
+  ct_create(&ct, ctxt, armor);
+
   /* initialize the pseudorandom generator (for the IV) */
   ri();
 
   /* The buffer for the symmetric key actually holds two keys: */
-  /* use the first key for the AES-CTR encryption ...*/
-  sk_enc = raw_sk;
-  aes_setkey(&aesEnc, sk_enc, CCA_STRENGTH);
-
-  /* ... and the second part for the AES-CBC-MAC */
-  sk_mac = raw_sk+CCA_STRENGTH;
-  aes_setkey(&aesMac, sk_mac, CCA_STRENGTH);
+  /* use the first key for the AES-CTR encryption and the second */
+  /* for the AES-CBC-MAC */
+  setup_sk(keys, raw_sk);
+  aesEnc = keys[0].e;
+  aesMac = keys[1].e;
 
   /* Now start processing the actual file content using symmetric encryption */
   /* Generate IV (Initialization Vector) for CTR-mode */
 
   prng_getbytes(ctr, CCA_STRENGTH);
-  write(ctxt, ctr, CCA_STRENGTH);
+  ct_write(&ct, ctr, CCA_STRENGTH);
 
-  /* start CBC-MAC */
-  aes_encrypt(&aesMac, mac_buf, ctr);
-  while ((bytes_read = read(fin, buf, CCA_STRENGTH)) == CCA_STRENGTH) {
-    inc_counter(ctr);
-    aes_encrypt(&aesEnc, ctxt_buf, ctr);
+  /* start the MAC */
+  if (mac == MAC_HMAC_SHA256) {
+    hmac_sha256_init(mac_key, CCA_STRENGTH, &hmac);
+    hmac_sha256_update(&hmac, ctr, CCA_STRENGTH);
+  }
+  else
+    aes_eencrypt(&aesMac, mac_buf, ctr);
+
+  /* the first block is encrypted under IV + 1 */
+  inc_counter(ctr);
 
-    /* XOR with ptxt */
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      ctxt_buf[i] = ctxt_buf[i] ^ buf[i];
+  /* encrypt all the whole blocks a chunk at a time; aes_ctr_xor
+   * advances ctr past every block it uses */
+  do {
+    if ((bytes_read = read_chunk(fin, buf, CHUNK_SIZE)) == -1) {
+      perror(getprogname());
+      exit(-1);
     }
-    write(ctxt, ctxt_buf, CCA_STRENGTH);
+    full = bytes_read - bytes_read % CCA_STRENGTH;
+    aes_ectr_xor(&aesEnc, ctxt_buf, buf, full, ctr);
+    ct_write(&ct, ctxt_buf, full);
 
     /* add to MAC */
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf[i] ^ ctxt_buf[i];
+    if (mac == MAC_HMAC_SHA256) {
+      hmac_sha256_update(&hmac, ctxt_buf, full);
+      continue;
     }
-    aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
-    for (i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf_temp[i];
+    for (j=0; j<full; j+=CCA_STRENGTH) {
+      for (i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf[i] ^ ctxt_buf[j+i];
+      }
+      aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
+      for (i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf_temp[i];
+      }
     }
-  }
-
-  inc_counter(ctr);
+  } while (bytes_read == CHUNK_SIZE);
+  bytes_read -= full;
 
   /* Pad the last block with trailing zeroes */
   for (i=bytes_read; i<CCA_STRENGTH; ++i) {
-    buf[i] = 0;
+    buf[full+i] = 0;
   }
 
   /* write the last chunk */
-  aes_encrypt(&aesEnc, ctxt_buf, ctr);
+  aes_ectr_xor(&aesEnc, ctxt_buf, buf+full, CCA_STRENGTH, ctr);
 
-  /* XOR with plaintext */
-  for(i=0; i<CCA_STRENGTH; ++i) {
-    ctxt_buf[i] = ctxt_buf[i] ^ buf[i];
-  }
+  ct_write(&ct, ctxt_buf, bytes_read);
 
-  write(ctxt, ctxt_buf, bytes_read);
+  if (mac == MAC_HMAC_SHA256) {
+    hmac_sha256_update(&hmac, ctxt_buf, bytes_read);
+    hmac_sha256_final(mac_key, CCA_STRENGTH, &hmac, tag);
+    ct_write(&ct, tag, CCA_STRENGTH);
+    ct_finish(&ct);
+    close(ctxt);
+    return;
+  }
 
   /* Finish up computing the AES-CBC-MAC and write the resulting
    * 16-byte MAC after the last chunk of the AES-CTR ciphertext */
   for(i=0; i<CCA_STRENGTH; ++i) {
     mac_buf[i] = mac_buf[i] ^ ctxt_buf[i];
   }
-  aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
+  aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
   for(i=0; i<CCA_STRENGTH; ++i) {
     mac_buf[i] = mac_buf_temp[i];
   }
-  write(ctxt, mac_buf, CCA_STRENGTH);
+  ct_write(&ct, mac_buf, CCA_STRENGTH);
+  ct_finish(&ct);
   close(ctxt);
 }
 
@@ -122,11 +154,15 @@ void
 usage (const char *pname)
 {
   printf("Personal Vault: Encryption \n");
-  printf("Usage: %s SK-FILE PTEXT-FILE CTEXT-FILE\n", pname);
+  printf("Usage: %s [-m MAC] [--armor] SK-FILE PTEXT-FILE CTEXT-FILE\n",
+         pname);
   printf("       Exits if either SK-FILE or PTEXT-FILE don't exist.\n");
   printf("       Otherwise, encrpyts the content of PTEXT-FILE under\n");
   printf("       sk, and place the resulting ciphertext in CTEXT-FILE.\n");
   printf("       If CTEXT-FILE existed, any previous content is lost.\n");
+  printf("       MAC is cbcmac (the default) or hmac-sha256; the same\n");
+  printf("       must be given to ctr_decrypt.  --armor writes CTEXT-FILE\n");
+  printf("       as base64 text, which ctr_decrypt recognizes.\n");
   exit(1);
 }
 
@@ -136,8 +172,10 @@ main (int argc, char **argv)
   int fdsk, fdptxt;
   char *raw_sk;
   size_t raw_len;
+  int armor = armor_from_args(&argc, &argv);
+  int mac = mac_from_args(&argc, &argv);
 
-  if (argc != 4) {
+  if (argc != 4 || mac == -1) {
     usage(argv[0]);
   }   /* Check if argv[1] and argv[2] are existing files */
   else if (((fdsk = open(argv[1], O_RDONLY)) == -1)
@@ -162,7 +200,7 @@ main (int argc, char **argv)
     close (fdsk);
 
     /* Perform Encryption */
-    encrypt_file (argv[3], raw_sk, raw_len, fdptxt);
+    encrypt_file (argv[3], raw_sk, raw_len, fdptxt, mac, armor);
 
     /* scrub the buffer that's holding the key before exiting */
     for (size_t i = 0; i < raw_len; ++i)
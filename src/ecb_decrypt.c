@@ -1,7 +1,8 @@
 #include "block.h"
 
 void
-decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int file_size)
+decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len,
+              ctfile *fin, int file_size)
 {
   /***************************************************************************
    * Use AES in ECB mode for decryption and AES as a CBC-MAC to verify the tag
@@ -12,20 +13,25 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
    *
    * where Y = AES-CTR (plaintext)
    *       W = AES-CBC-MAC (K_MAC, Y)
+   *
+   * file_size and the reads are of the dearmored ciphertext if
+   * CTEXT-FILE is armored
    */
 
   int ptxt = 0;
   int bytes_read = 0;
   int bytes_total_read = 0;
   int num_blocks = 0;
+  int n = 0;
 
-  aes_ctx aesEnc, aesMac;
+  aes_ctx keys[2];
+  aes_ctx aesEnc;
+  aes_ectx aesMac;
 
-  char ptxt_buf[CCA_STRENGTH], buf[CCA_STRENGTH], mac_buf[CCA_STRENGTH];
+  char ptxt_buf[CHUNK_SIZE], buf[CHUNK_SIZE], mac_buf[CCA_STRENGTH];
   char mac_buf_temp[CCA_STRENGTH];
 
-  char *sk_enc, *sk_mac;
-  int i = 0, j = 0;
+  int i = 0, j = 0, k = 0;
 
   /* use the first part of the symmetric key for the AES-CTR decryption ...*/
   /* ... and the second for the AES-CBC-MAC */
@@ -42,13 +48,10 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
   /* get file size in bytes:*/
   printf("File size: %i\n", file_size);
 
-  /* First part for the AES-CTR */
-  sk_enc = raw_sk;
-  aes_setkey(&aesEnc, sk_enc, CCA_STRENGTH);
-
-  /* ... and the second part for the AES-CBC-MAC */
-  sk_mac = raw_sk+CCA_STRENGTH;
-  aes_setkey(&aesMac, sk_mac, CCA_STRENGTH);
+  /* First part for the AES-ECB, second part for the AES-CBC-MAC */
+  setup_sk(keys, raw_sk);
+  aesEnc = keys[0];
+  aesMac = keys[1].e;
 
   num_blocks = file_size / CCA_STRENGTH-2;
   bytes_total_read = CCA_STRENGTH;
@@ -58,35 +61,41 @@ decrypt_file (const char *ptxt_fname, void *raw_sk, size_t raw_len, int fin, int
     mac_buf[i] = 0;
   }
 
-  for (j=0; j<num_blocks; ++j) {
-    bytes_read = read(fin, buf, CCA_STRENGTH);
-    if (bytes_read != CCA_STRENGTH) {
+  for (j=0; j<num_blocks; j+=n) {
+    n = num_blocks - j;
+    if (n > CHUNK_SIZE / CCA_STRENGTH)
+      n = CHUNK_SIZE / CCA_STRENGTH;
+    bytes_read = ct_read(fin, buf, n * CCA_STRENGTH);
+    if (bytes_read != n * CCA_STRENGTH) {
       /* Error: shut down everything - scrub buffers*/
       char* raw_sk_char = (char*)raw_sk;
       for (size_t i = 0; i < raw_len; ++i)
         raw_sk_char[i] = 0;
-      for (int i = 0; i < CCA_STRENGTH; ++i)
-        ptxt_buf[i] = 0;
-        buf[i] = 0;
+      bzero(ptxt_buf, sizeof(ptxt_buf));
+      bzero(buf, sizeof(buf));
+      bzero(keys, sizeof(keys));
+      bzero(&aesEnc, sizeof(aesEnc));
+      bzero(&aesMac, sizeof(aesMac));
       exit(-1);
     }
 
-    aes_decrypt(&aesEnc, ptxt_buf, buf);
-    write(ptxt, ptxt_buf, CCA_STRENGTH);
-    bytes_total_read += CCA_STRENGTH;
+    aes_ecb_decrypt(&aesEnc, ptxt_buf, buf, n);
+    write_chunk(ptxt, ptxt_buf, bytes_read);
+    bytes_total_read += bytes_read;
 
     /* COMPUTE CBC-MAC AS YOU GO */
-    for(i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf[i] ^ buf[i];
-    }
-    aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
-    for(i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf_temp[i];
+    for(k=0; k<bytes_read; k+=CCA_STRENGTH) {
+      for(i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf[i] ^ buf[k+i];
+      }
+      aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
+      for(i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf_temp[i];
+      }
     }
   }
 
   close(ptxt);
-  close(fin);
 }
 
 void
@@ -101,6 +110,7 @@ usage (const char *pname)
   printf("       in PTEXT-FILE; if a decryption problem is encountered\n");
   printf("       after the processing started, PTEXT-FILE is truncated\n");
   printf("       to zero-length and its previous content is lost.\n");
+  printf("       CTEXT-FILE may be armored (see ecb_encrypt --armor).\n");
   exit(1);
 }
 
@@ -110,17 +120,8 @@ main (int argc, char **argv)
   int fdsk, fdctxt;
   char *sk = NULL;
   size_t sk_len = 0;
-  int file_size=0;
-
-  FILE* f = 0;
-  if(argc != 4) {
-    usage(argv[0]);
-  }
-  /* get file size of ctxt */
-  f = fopen(argv[2], "r");
-  fseek(f, 0, SEEK_END);
-  file_size = ftell(f);
-  fclose(f);
+  off_t file_size;
+  ctfile ct;
 
   if (argc != 4) {
     usage(argv[0]);
@@ -138,6 +139,12 @@ main (int argc, char **argv)
   else {
     setprogname(argv[0]);
 
+    /* get file size of ctxt, dearmored if need be */
+    if ((file_size = ct_open(&ct, fdctxt)) == -1) {
+      printf("%s: cannot read %s, or it is badly armored\n", argv[0], argv[2]);
+      exit(-1);
+    }
+
     /* Import symmetric key from argv[1] */
     if (!(sk = import_sk_from_file(&sk, &sk_len, fdsk))) {
       printf("%s: no symmetric key found in %s\n", argv[0], argv[1]);
@@ -147,7 +154,7 @@ main (int argc, char **argv)
     close(fdsk);
 
     /* Perform Decryption */
-    decrypt_file(argv[3], sk, sk_len, fdctxt, file_size);
+    decrypt_file(argv[3], sk, sk_len, &ct, file_size);
 
     /* scrub the buffer that's holding the key before exiting */
     for (size_t i = 0; i < sk_len; ++i)
@@ -1,7 +1,8 @@
 #include "block.h"
 
 void
-encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
+encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin,
+              int armor)
 {
   /***************************************************************************
   * Use AES in ECB mode for encryption and AES as a CBC-MAC for auth
@@ -13,18 +14,24 @@ encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
    *
    * where Y = AES-ECB (plaintext)
    *       W = AES-CBC-MAC (K_MAC, Y)
+   *
+   * With --armor, the whole of it is written as base64 lines between
+   * ARMOR_BEGIN and ARMOR_END.
    ***************************************************************************/
 
   int ctxt = 0;
+  ctfile ct;
   int bytes_read=0;
-  int i=0;
+  int full=0;
+  int i=0, j=0;
 
-  aes_ctx aesEnc, aesMac;
+  aes_ctx keys[2];
+  aes_ctx aesEnc;
+  aes_ectx aesMac;
 
-  char ctxt_buf[CCA_STRENGTH], buf[CCA_STRENGTH], mac_buf[CCA_STRENGTH];
+  char ctxt_buf[CHUNK_SIZE], buf[CHUNK_SIZE], mac_buf[CCA_STRENGTH];
   char mac_buf_temp[CCA_STRENGTH];
 
-  char *sk_enc, *sk_mac;
   /* Create the ciphertext file---the content will be encrypted */
 
   if ((ctxt = open(ctxt_fname, O_WRONLY|O_TRUNC|O_CREAT, 0600)) == -1) {
@@ -38,42 +45,51 @@ encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
     exit (-1);
   }
 
-  /* The buffer for the symmetric key actually holds two keys: */
-  /* use the first key for the AES-CTR encryption ...*/
-  sk_enc = raw_sk;
-  aes_setkey(&aesEnc, sk_enc, CCA_STRENGTH);
+  ct_create(&ct, ctxt, armor);
 
-  /* ... and the second part for the AES-CBC-MAC */
-  sk_mac = raw_sk+CCA_STRENGTH;
-  aes_setkey(&aesMac, sk_mac, CCA_STRENGTH);
+  /* The buffer for the symmetric key actually holds two keys: */
+  /* use the first key for the AES-ECB encryption and the second */
+  /* for the AES-CBC-MAC */
+  setup_sk(keys, raw_sk);
+  aesEnc = keys[0];
+  aesMac = keys[1].e;
 
   /* start CBC-MAC with "IV" of all 0s */
   for(i=0; i<CCA_STRENGTH; ++i) {
     mac_buf[i] = 0;
   }
 
-  while((bytes_read = read(fin, buf, CCA_STRENGTH)) == CCA_STRENGTH) {
-    aes_encrypt(&aesEnc, ctxt_buf, buf);
-    write(ctxt, ctxt_buf, CCA_STRENGTH);
+  /* encrypt all the whole blocks a chunk at a time */
+  do {
+    if ((bytes_read = read_chunk(fin, buf, CHUNK_SIZE)) == -1) {
+      perror(getprogname());
+      exit(-1);
+    }
+    full = bytes_read - bytes_read % CCA_STRENGTH;
+    aes_ecb_encrypt(&aesEnc, ctxt_buf, buf, full / CCA_STRENGTH);
+    ct_write(&ct, ctxt_buf, full);
 
     /* add to MAC */
-    for(i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf[i] ^ ctxt_buf[i];
-    }
-    aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
-    for(i=0; i<CCA_STRENGTH; ++i) {
-      mac_buf[i] = mac_buf_temp[i];
+    for(j=0; j<full; j+=CCA_STRENGTH) {
+      for(i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf[i] ^ ctxt_buf[j+i];
+      }
+      aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
+      for(i=0; i<CCA_STRENGTH; ++i) {
+        mac_buf[i] = mac_buf_temp[i];
+      }
     }
-  }
+  } while (bytes_read == CHUNK_SIZE);
+  bytes_read -= full;
 
   /* Don't forget to pad the last block with trailing zeroes */
   for(i=bytes_read; i<CCA_STRENGTH; ++i) {
-    buf[i] = 0;
+    buf[full+i] = 0;
   }
 
   /* write the last chunk */
-  aes_encrypt(&aesEnc, ctxt_buf, buf);
-  write(ctxt, ctxt_buf, CCA_STRENGTH);
+  aes_encrypt(&aesEnc, ctxt_buf, buf+full);
+  ct_write(&ct, ctxt_buf, CCA_STRENGTH);
 
   /* Finish up computing the AES-CBC-MAC and write the resulting
    * 16-byte MAC after the last chunk of the AES-CTR ciphertext */
@@ -81,11 +97,12 @@ encrypt_file (const char *ctxt_fname, void *raw_sk, size_t raw_len, int fin)
   for(i=0; i<CCA_STRENGTH; ++i) {
     mac_buf[i] = mac_buf[i] ^ ctxt_buf[i];
   }
-  aes_encrypt(&aesMac, mac_buf_temp, mac_buf);
+  aes_eencrypt(&aesMac, mac_buf_temp, mac_buf);
   for(i=0; i<CCA_STRENGTH; ++i) {
     mac_buf[i] = mac_buf_temp[i];
   }
-  write(ctxt, mac_buf, CCA_STRENGTH);
+  ct_write(&ct, mac_buf, CCA_STRENGTH);
+  ct_finish(&ct);
   close(ctxt);
 }
 
@@ -93,11 +110,13 @@ void
 usage (const char *pname)
 {
   printf("Personal Vault: Encryption \n");
-  printf("Usage: %s SK-FILE PTEXT-FILE CTEXT-FILE\n", pname);
+  printf("Usage: %s [--armor] SK-FILE PTEXT-FILE CTEXT-FILE\n", pname);
   printf("       Exits if either SK-FILE or PTEXT-FILE don't exist.\n");
   printf("       Otherwise, encrpyts the content of PTEXT-FILE under\n");
   printf("       sk, and place the resulting ciphertext in CTEXT-FILE.\n");
   printf("       If CTEXT-FILE existed, any previous content is lost.\n");
+  printf("       --armor writes CTEXT-FILE as base64 text, which\n");
+  printf("       ecb_decrypt recognizes.\n");
   exit(1);
 }
 
@@ -107,6 +126,7 @@ main (int argc, char **argv)
   int fdsk, fdptxt;
   char *raw_sk;
   size_t raw_len;
+  int armor = armor_from_args(&argc, &argv);
 
   if (argc != 4) {
     usage(argv[0]);
@@ -133,7 +153,7 @@ main (int argc, char **argv)
     close (fdsk);
 
     /* Perform Encryption */
-    encrypt_file (argv[3], raw_sk, raw_len, fdptxt);
+    encrypt_file (argv[3], raw_sk, raw_len, fdptxt, armor);
 
     /* scrub the buffer that's holding the key before exiting */
     for (size_t i = 0; i < raw_len; ++i)
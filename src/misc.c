@@ -1,5 +1,11 @@
 #include "block.h"
 
+#if defined(__linux__) && defined(__GLIBC__) \
+  && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+# include <sys/random.h>
+# define HAVE_GETRANDOM 1
+#endif
+
 #ifndef HAVE_GETPROGNAME
 char *my_progname = NULL;
 
@@ -12,28 +18,15 @@ getprogname(void)
 void
 setprogname(const char *n)
 {
-  int i, j;
+  /* a static buffer, so that startup does not touch the heap */
+  static char buf[MY_MAXNAME + 1];
+  int i;
 
   /* truncate n if longer than MY_MAXNAME chars */
   for (i = 0; (i < MY_MAXNAME) && n[i]; i++)
-    ; /*intentionally empty */
-
-  /* copy into my_progname as long as there is space ... */
-  for (j = 0; (j < i) && (my_progname + j); j++)
-    my_progname[j] = n [j];
-
-  /* need more space? */
-  if ((j < i) || !(my_progname [j])) {
-    my_progname = (char *)realloc(my_progname, (i + 1)* sizeof(char));
-    /* complete the copying */
-    for (; j < i; j++) {
-      assert(my_progname + j);
-      my_progname[j] = n[j];
-    }
-  }
-
-  assert(my_progname + j);
-  my_progname[j] = '\0';
+    buf[i] = n[i];
+  buf[i] = '\0';
+  my_progname = buf;
 }
 #endif /* HAVE_GETPROGNAME */
 
@@ -48,6 +41,19 @@ ri (void)
   int fd;
   int done = 0;
 
+#ifdef HAVE_GETRANDOM
+  {
+    /* no file descriptor needed, and works inside a chroot */
+    char seed[32];
+    if (getrandom(seed, sizeof(seed), 0) == sizeof(seed)) {
+      prng_seed(seed, sizeof(seed));
+      bzero(seed, sizeof(seed));
+      return;
+    }
+    /* ENOSYS from a kernel older than 3.17: use the devices */
+  }
+#endif /* HAVE_GETRANDOM */
+
   /* first, check if one of /dev/random, /dev/urandom or /dev/prandom */
   for (i = 0; (!done) && random_devs[i]; i++) {
     if ((fd = open(random_devs[i], O_RDONLY, 0600)) == -1) {
@@ -105,7 +111,24 @@ import_from_file (int fd)
   size_t bufsize = 512; /* initial bufsize is enough for 1024-bit keys */
   size_t tot;           /* total bytes read so far */
   ssize_t cur;          /* no bytes read in the last read */
-  char *buf = (char *)malloc(bufsize * sizeof(char));
+  struct stat sb;
+  char *buf;
+
+  if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+    /* the size is known: one buffer, one read */
+    buf = (char *)malloc(sb.st_size + 1);
+    if ((cur = read_chunk(fd, buf, sb.st_size)) == -1) {
+      printf ("%s: trouble importing key from file\n", getprogname());
+      perror(getprogname());
+      free(buf);
+      close(fd);
+      exit(-1);
+    }
+    buf[cur] = '\0';
+    return buf;
+  }
+
+  buf = (char *)malloc(bufsize * sizeof(char));
   tot = 0;
   do {
     cur = read(fd, buf + tot, bufsize - tot);
@@ -131,16 +154,46 @@ import_from_file (int fd)
 char *
 import_sk_from_file (char **raw_sk_p, size_t *raw_len_p, int fdsk)
 {
-  char *armored_key = import_from_file (fdsk);
-  ssize_t dearmored_len = dearmor64len (armored_key);
+  /* A key file is one short line of base64.  It is read onto the stack
+     and dearmored into a static buffer, so reading a key needs no heap;
+     anything larger goes through import_from_file. */
+  static char raw_sk[4 * CCA_STRENGTH];
+  char small[8 * CCA_STRENGTH];
+  char *armored_key = NULL;
+  ssize_t dearmored_len, cur;
+  struct stat sb;
+
+  if (fstat(fdsk, &sb) == 0 && S_ISREG(sb.st_mode)
+      && sb.st_size < (off_t)sizeof(small)) {
+    if ((cur = read_chunk(fdsk, small, sb.st_size)) == -1) {
+      printf ("%s: trouble importing key from file\n", getprogname());
+      perror(getprogname());
+      close(fdsk);
+      exit(-1);
+    }
+    small[cur] = '\0';
+  } else {
+    armored_key = import_from_file (fdsk);
+  }
+
+  dearmored_len = dearmor64len (armored_key ? armored_key : small);
   if (dearmored_len == -1) {
     /* error when dearmoring */
     *raw_sk_p = NULL;
     *raw_len_p = 0;
   } else {
     *raw_len_p = (size_t)dearmored_len;
-    *raw_sk_p = (char *)malloc(dearmored_len * sizeof(char));
-    dearmor64(*raw_sk_p, armored_key);
+    if (*raw_len_p <= sizeof(raw_sk))
+      *raw_sk_p = raw_sk;
+    else
+      *raw_sk_p = (char *)malloc(dearmored_len * sizeof(char));
+    dearmor64(*raw_sk_p, armored_key ? armored_key : small);
+  }
+
+  bzero(small, sizeof(small));
+  if (armored_key) {
+    bzero(armored_key, strlen(armored_key));
+    free(armored_key);
   }
   return (*raw_sk_p);
 }
@@ -160,3 +213,207 @@ write_chunk (int fd, const char *buf, u_int len)
   }
   return 0;
 }
+
+/* like read(), but keeps reading until len bytes or EOF; a return
+   value other than -1 and len means EOF was reached */
+int
+read_chunk (int fd, char *buf, u_int len)
+{
+  int cur_bytes_read;
+  u_int bytes_read = 0;
+  while (bytes_read < len) {
+    if ((cur_bytes_read = read(fd, buf + bytes_read,
+                               len - bytes_read)) == -1) {
+      return -1;
+    } else if (cur_bytes_read == 0) {
+      break;
+    }
+    bytes_read += cur_bytes_read;
+  }
+  return bytes_read;
+}
+
+/* sets up keys[0] (encryption) and keys[1] (CBC-MAC) from the two
+   halves of raw_sk */
+void
+setup_sk (aes_ctx keys[2], const char *raw_sk)
+{
+  aes_setkey(&keys[0], raw_sk, CCA_STRENGTH);
+  aes_setkey(&keys[1], raw_sk + CCA_STRENGTH, CCA_STRENGTH);
+}
+
+/* strips a leading "-m MAC" from argv, keeping argv[0]; returns the MAC
+   to use, MAC_CBC if none was given, or -1 if MAC is unknown */
+int
+mac_from_args(int *argcp, char ***argvp)
+{
+  char **argv = *argvp;
+  int mac = MAC_CBC;
+
+  if (*argcp >= 3 && !strcmp(argv[1], "-m")) {
+    if (!strcmp(argv[2], "cbcmac"))
+      mac = MAC_CBC;
+    else if (!strcmp(argv[2], "hmac-sha256"))
+      mac = MAC_HMAC_SHA256;
+    else
+      return -1;
+    argv[2] = argv[0];
+    *argcp -= 2;
+    *argvp += 2;
+  }
+  return mac;
+}
+
+/* removes "--armor" from argv, wherever it is; returns 1 if it was
+   there and 0 otherwise */
+int
+armor_from_args(int *argcp, char ***argvp)
+{
+  char **argv = *argvp;
+
+  for (int i = 1; i < *argcp; i++)
+    if (!strcmp(argv[i], "--armor")) {
+      /* argv[argc] is NULL, and moves down with the rest */
+      for (; i < *argcp; i++)
+        argv[i] = argv[i + 1];
+      --*argcp;
+      return 1;
+    }
+  return 0;
+}
+
+/* starts writing a ciphertext to fd, armored or not */
+void
+ct_create(ctfile *ct, int fd, int armor)
+{
+  ct->fd = fd;
+  ct->armor = armor;
+  if (armor) {
+    armor64_encinit(&ct->enc);
+    write_chunk(fd, ARMOR_BEGIN "\n", sizeof(ARMOR_BEGIN));
+  }
+}
+
+/* like write_chunk; armored text goes out as soon as it is encoded,
+   so at most one chunk of it is ever held */
+int
+ct_write(ctfile *ct, const void *buf, u_int len)
+{
+  const char *p = buf;
+  u_int n;
+  size_t tl;
+
+  if (!ct->armor)
+    return write_chunk(ct->fd, p, len);
+  for (; len; p += n, len -= n) {
+    n = len < CHUNK_SIZE ? len : CHUNK_SIZE;
+    tl = armor64_encupdate(&ct->enc, ct->text, p, n);
+    if (write_chunk(ct->fd, ct->text, tl) == -1)
+      return -1;
+  }
+  return 0;
+}
+
+/* writes out what is left of an armored ciphertext, and the last line */
+int
+ct_finish(ctfile *ct)
+{
+  size_t tl;
+
+  if (!ct->armor)
+    return 0;
+  tl = armor64_encfinal(&ct->enc, ct->text);
+  memcpy(ct->text + tl, ARMOR_END "\n", sizeof(ARMOR_END));
+  return write_chunk(ct->fd, ct->text, tl + sizeof(ARMOR_END));
+}
+
+/* Starts reading the ciphertext in fd, and returns its size once
+   dearmored, or -1 if it cannot be read or is not well formed.  The
+   decrypt tools need that size before they start, to find the tag, so
+   an armored file is decoded once here, checking it throughout, and
+   then again by ct_read; neither pass holds more than a chunk. */
+off_t
+ct_open(ctfile *ct, int fd)
+{
+  char end[sizeof(ARMOR_END) + 2];
+  const char *dash;
+  struct stat sb;
+  ssize_t n, m;
+  off_t off, size = 0;
+
+  ct->fd = fd;
+  ct->armor = 0;
+  ct->have = ct->pos = 0;
+  if (fstat(fd, &sb) == -1)
+    return -1;
+  n = pread(fd, ct->text, strlen(ARMOR_BEGIN), 0);
+  if (n != (ssize_t)strlen(ARMOR_BEGIN)
+      || memcmp(ct->text, ARMOR_BEGIN, strlen(ARMOR_BEGIN)))
+    return sb.st_size;
+
+  ct->armor = 1;
+  armor64_decinit(&ct->dec);
+  for (off = strlen(ARMOR_BEGIN); ; off += n) {
+    if ((n = pread(fd, ct->text, sizeof(ct->text), off)) <= 0)
+      return -1;
+    if ((dash = memchr(ct->text, '-', n)))
+      n = dash - ct->text;
+    if ((m = armor64_decupdate(&ct->dec, ct->plain, ct->text, n)) == -1)
+      return -1;
+    size += m;
+    if (dash)
+      break;
+  }
+  if (armor64_decfinal(&ct->dec) == -1)
+    return -1;
+
+  /* ARMOR_END, with any line end, and nothing after it */
+  off += n;
+  n = pread(fd, end, sizeof(end), off);
+  if (n < (ssize_t)strlen(ARMOR_END)
+      || memcmp(end, ARMOR_END, strlen(ARMOR_END))
+      || off + n != sb.st_size)
+    return -1;
+  for (m = strlen(ARMOR_END); m < n; m++)
+    if (end[m] != '\n' && end[m] != '\r')
+      return -1;
+
+  ct->left = off - strlen(ARMOR_BEGIN);
+  armor64_decinit(&ct->dec);
+  if (lseek(fd, strlen(ARMOR_BEGIN), SEEK_SET) == -1)
+    return -1;
+  return size;
+}
+
+/* like read_chunk, on the ciphertext proper */
+int
+ct_read(ctfile *ct, void *buf, u_int len)
+{
+  char *p = buf;
+  u_int got = 0;
+  ssize_t n, m;
+  size_t k;
+
+  if (!ct->armor)
+    return read_chunk(ct->fd, p, len);
+  while (got < len) {
+    if (ct->pos == ct->have) {
+      if (!ct->left)
+        break;
+      k = ct->left < (off_t)sizeof(ct->text) ? (size_t)ct->left
+                                              : sizeof(ct->text);
+      if ((n = read(ct->fd, ct->text, k)) <= 0
+          || (m = armor64_decupdate(&ct->dec, ct->plain, ct->text, n)) == -1)
+        return -1;
+      ct->left -= n;
+      ct->have = m;
+      ct->pos = 0;
+      continue;
+    }
+    k = ct->have - ct->pos < len - got ? ct->have - ct->pos : len - got;
+    memcpy(p + got, ct->plain + ct->pos, k);
+    ct->pos += k;
+    got += k;
+  }
+  return got;
+}